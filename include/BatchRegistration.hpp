@@ -0,0 +1,47 @@
+#ifndef _BATCH_REGISTRATION_HPP
+#define _BATCH_REGISTRATION_HPP
+
+#include "sfm/bundler_common.h"
+#include "sfm/bundler_incremental.h"
+#include <cstddef>
+#include <vector>
+
+/** Next view registration of sfm::bundler::Incremental for several views
+ * per round. The P3P RANSAC of all candidates runs concurrently against the
+ * current tracks, which registering a view does not move, and the passing
+ * views are committed as Incremental::reconstruct_next_view does. Their
+ * poses are then refined by one bundle adjustment of only these cameras
+ * against the fixed points, like a single camera bundle adjustment of
+ * each. */
+class BatchRegistration {
+public:
+    BatchRegistration(const sfm::bundler::Incremental::Options &opts,
+                      sfm::bundler::ViewportList *viewports,
+                      sfm::bundler::TrackList *tracks);
+
+    /** Estimate the poses of all 'candidates' at once and register up to
+     * 'max_views' of those with enough inliers, in the order of
+     * 'candidates'. Returns the registered views. */
+    std::vector<int> Register(const std::vector<int> &candidates, std::size_t max_views);
+
+    /** Camera only bundle adjustment of 'view_ids'. */
+    void BundleAdjustCameras(const std::vector<int> &view_ids);
+private:
+    struct Estimate {
+        sfm::CameraPose pose;
+        /** Track and feature of every 2D-3D correspondence */
+        std::vector<int> track_ids;
+        std::vector<int> feature_ids;
+        std::vector<int> inliers;
+    };
+
+    void EstimatePose(int view_id, Estimate *estimate) const;
+
+    void Commit(int view_id, const Estimate &estimate);
+private:
+    sfm::bundler::Incremental::Options m_opts;
+    sfm::bundler::ViewportList *m_viewports;
+    sfm::bundler::TrackList *m_tracks;
+};
+
+#endif //_BATCH_REGISTRATION_HPP
@@ -0,0 +1,45 @@
+#ifndef _CHUNKED_POINT_SET_HPP
+#define _CHUNKED_POINT_SET_HPP
+
+#include "mve/mesh.h"
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Point set kept on disk as one chunk file per writer task, so point sets
+ * larger than the memory can be merged. Chunks are written concurrently and
+ * hold the PointCloud columns of their points one after the other, merging
+ * them copies every column of every chunk into the uncompressed .mvpc file.
+ * The chunk directory is removed on destruction. */
+class ChunkedPointSet {
+public:
+    /** Chunks go to 'dir', which is created if missing. */
+    explicit ChunkedPointSet(const std::string &dir);
+
+    ~ChunkedPointSet();
+
+    ChunkedPointSet(const ChunkedPointSet &) = delete;
+
+    ChunkedPointSet &operator=(const ChunkedPointSet &) = delete;
+
+    /** Write the vertices of 'points' with their normals, colors and
+     * confidences and 'values' as chunk 'index'. Distinct indices may be
+     * written concurrently, chunks are merged in index order. */
+    void WriteChunk(std::size_t index, const mve::TriangleMesh &points, const std::vector<float> &values);
+
+    std::size_t GetNumPoints() const;
+
+    /** Merge all chunks into the PointCloud file 'path'. */
+    void Write(const std::string &path) const;
+private:
+    std::string ChunkPath(std::size_t index) const;
+private:
+    std::string m_dir;
+    mutable std::mutex m_mutex;
+    /** Points of each written chunk */
+    std::map<std::size_t, std::size_t> m_chunks;
+};
+
+#endif //_CHUNKED_POINT_SET_HPP
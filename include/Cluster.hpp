@@ -12,12 +12,18 @@ public:
 
     void SetCluster(const std::vector<Vertex> &vertices);
 
+    /** Upload 'count' points from separate position and color arrays of
+     * three floats per point, e.g. the columns of a mapped PointCloud. */
+    void SetCluster(const float *positions, const float *colors, std::size_t count);
+
 private:
     void DrawArray(const Shader &shader) override;
 
     unsigned int m_VAO;
     unsigned int m_VBO;
-    std::vector<Vertex> m_vertices;
+    /** Colors of a cluster set from separate arrays */
+    unsigned int m_colorVBO;
+    std::size_t m_count;
 };
 
 #endif //_CLUSTER_HPP
@@ -26,6 +26,9 @@ public:
     Cluster::Ptr AddCluster(const std::vector<Vertex> &vertices,
                             const glm::mat4 &transform = glm::mat4(1.0f));
 
+    Cluster::Ptr AddCluster(const float *positions, const float *colors, std::size_t count,
+                            const glm::mat4 &transform = glm::mat4(1.0f));
+
     Mesh::Ptr AddMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
                             const glm::mat4 &transform = glm::mat4(1.0f));
     template<typename T>
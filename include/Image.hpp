@@ -2,6 +2,7 @@
 #define _IMAGE_HPP
 
 #include <dmrecon/settings.h>
+#include "math/vector.h"
 #include "mve/image.h"
 #include "mve/view.h"
 #include "mve/scene.h"
@@ -12,7 +13,12 @@
 #define RAND_SEED_SFM 0
 #define MAX_IMAGE_SIZE 500000
 #define ORIGINAL_IMAGE_NAME "original"
+#define THUMBNAIL_IMAGE_NAME "thumbnail"
 #define UNDISTORTED_IMAGE_NAME "undistorted"
+#define THERMAL_IMAGE_NAME "thermal"
+#define FEATURES_BLOB_NAME "features"
+#define FEATURES_BLOB_VERSION 1
+#define THERMAL_CALIBRATION_FILE "calibration.txt"
 
 template<class T>
 typename mve::Image<T>::Ptr limit_image_size(typename mve::Image<T>::Ptr img, int max_pixels);
@@ -21,6 +27,9 @@ mve::ImageBase::Ptr limit_image_size(mve::ImageBase::Ptr image, int max_pixels);
 
 bool has_jpeg_extension(std::string const &filename);
 
+/** True for the extensions load_any_image can decode. */
+bool has_image_extension(std::string const &filename);
+
 std::string remove_file_extension(std::string const &filename);
 
 mve::ByteImage::Ptr load_8bit_image(std::string const &fname, std::string *exif);
@@ -33,17 +42,92 @@ mve::ImageBase::Ptr load_any_image(std::string const &fname, std::string *exif);
 
 void add_exif_to_view(mve::View::Ptr view, std::string const &exif);
 
+/** Latitude and longitude in degrees and altitude in meters from the GPS
+ * tags of the view's exif blob, false if it has none. */
+bool get_exif_gps(mve::View::Ptr view, math::Vec3d *position);
+
 std::string make_image_name(int id);
 
 template<typename T>
 void find_min_max_percentile(typename mve::Image<T>::ConstPtr image, T *vmin, T *vmax);
 
+/** THUMBNAIL_SIZE square, center cropped 8 bit thumbnail of 'img'. 16 bit and
+ * float images are mapped to bytes between the 10th and 90th percentile. */
 mve::ByteImage::Ptr create_thumbnail(mve::ImageBase::ConstPtr img);
 
+/** Feature types for features_and_matching, the SIFT/SURF values are
+ * passed on to sfm::FeatureSet, FEATURE_HARRIS uses HarrisPyramid. */
+enum FeatureType {
+    FEATURE_SIFT = sfm::FeatureSet::FEATURE_SIFT,
+    FEATURE_SURF = sfm::FeatureSet::FEATURE_SURF,
+    FEATURE_ALL = sfm::FeatureSet::FEATURE_ALL,
+    FEATURE_HARRIS = 1 << 8
+};
+
+/** View pairs features_and_matching matches. */
+enum PairSelection {
+    PAIRS_EXHAUSTIVE,
+    /** The most similar views of every view by a vocabulary tree over the
+     * descriptors of the scene */
+    PAIRS_RETRIEVAL,
+    /** The following views by ID of every view, for ordered captures */
+    PAIRS_SEQUENTIAL
+};
+
+struct MatchingOptions {
+    PairSelection pair_selection = PAIRS_EXHAUSTIVE;
+    /** Views retrieved for every view, or for every loop closure check */
+    int retrieval_neighbors = 20;
+    /** Following views every view is matched with by PAIRS_SEQUENTIAL */
+    int sequential_window = 10;
+    /** Views between the loop closure checks of PAIRS_SEQUENTIAL, which
+     * match a view with its retrieved views outside the window. 0 disables
+     * loop closure. */
+    int loop_closure_interval = 10;
+    /** Views nearest by their exif GPS position added for every view, 0
+     * disables the prior */
+    int gps_neighbors = 0;
+    /** SIFT/SURF descriptors are matched as int8 by QuantizedMatcher
+     * instead of by sfm::ExhaustiveMatching */
+    bool quantized_matching = false;
+};
+
+/** Matches of an earlier run of features_and_matching, reused for the
+ * pairs of views whose images have not changed since. Features are
+ * deterministic, so the feature indices of such views still hold. */
+struct PreviousMatching {
+    sfm::bundler::PairwiseMatching matching;
+    /** Whether the view of each ID is the same as in that run, these
+     * views also keep the features stored by that run */
+    std::vector<bool> unchanged;
+    /** That run tried all pairs, so pairs of unchanged views missing from
+     * 'matching' had no matches. Otherwise they are matched again. */
+    bool all_pairs = false;
+};
+
+struct MatchingStats {
+    /** Pairs handed to the two view matching */
+    std::size_t candidate_pairs = 0;
+    /** Views whose stored features were loaded instead of computed */
+    std::size_t reused_views = 0;
+    /** Selected pairs taken from the previous matching */
+    std::size_t reused_pairs = 0;
+    std::size_t matched_pairs = 0;
+    std::size_t num_matches = 0;
+    float feature_ms = 0.f;
+    float selection_ms = 0.f;
+    float matching_ms = 0.f;
+};
+
+/** Features of all views and the verified matches of the selected pairs.
+ * 'stats' and 'previous' may be null. */
 bool features_and_matching(mve::Scene::Ptr scene,
                            sfm::bundler::ViewportList *viewports,
                            sfm::bundler::PairwiseMatching *pairwise_matching,
-                           sfm::FeatureSet::FeatureTypes feature_type);
+                           FeatureType feature_type,
+                           const MatchingOptions &options = MatchingOptions(),
+                           MatchingStats *stats = nullptr,
+                           const PreviousMatching *previous = nullptr);
 
 int get_scale_from_max_pixel(const mve::Scene::Ptr &scene);
 
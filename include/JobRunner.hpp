@@ -0,0 +1,86 @@
+#ifndef _JOB_RUNNER_HPP
+#define _JOB_RUNNER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/** Thrown by JobContext::CheckCancelled to unwind a cancelled job. */
+class JobCancelled : public std::runtime_error {
+public:
+    JobCancelled() : std::runtime_error("Job cancelled") {}
+};
+
+/** Handed to a running job for reporting progress and polling cancellation. */
+class JobContext {
+public:
+    JobContext(const std::atomic<bool> &cancelled, std::function<void(float)> progress);
+
+    bool IsCancelled() const { return m_cancelled; }
+
+    /** Throw JobCancelled if the job has been cancelled. */
+    void CheckCancelled() const;
+
+    /** Report progress in [0, 1]. */
+    void SetProgress(float progress) const;
+private:
+    const std::atomic<bool> &m_cancelled;
+    std::function<void(float)> m_progress;
+};
+
+/** Runs submitted jobs one after another on a background thread. Callbacks
+ * are invoked from that thread, GUI clients have to forward them to their
+ * own event loop. */
+class JobRunner {
+public:
+    using JobFunc = std::function<void(JobContext &)>;
+
+    struct Callbacks {
+        std::function<void(int id, const std::string &name, float progress)> on_progress;
+        /** 'error' is empty if the job succeeded. */
+        std::function<void(int id, const std::string &name,
+                           const std::string &error, bool cancelled)> on_finished;
+    };
+public:
+    explicit JobRunner(const Callbacks &callbacks);
+
+    /** Cancels all jobs and waits for the running one to return. */
+    ~JobRunner();
+
+    /** Queue a job, returns its id as passed to the callbacks. */
+    int Submit(const std::string &name, JobFunc func);
+
+    /** Cancel the running job and drop all queued ones. */
+    void CancelAll();
+
+    bool IsIdle() const;
+private:
+    struct Job {
+        int id;
+        std::string name;
+        JobFunc func;
+    };
+
+    void Run();
+
+    Callbacks m_callbacks;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Job> m_queue;
+    bool m_busy;
+    bool m_stop;
+    int m_nextId;
+
+    /** Cancellation flag of the running job */
+    std::atomic<bool> m_cancelCurrent;
+
+    std::thread m_thread;
+};
+
+#endif //_JOB_RUNNER_HPP
@@ -1,24 +1,23 @@
 #ifndef _MAIN_FRAME_HPP
 #define _MAIN_FRAME_HPP
 
-#include <wx/listctrl.h>
 #include <wx/wx.h>
 
+#include <functional>
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "Cluster.hpp"
-#include "mve/scene.h"
-#include "mve/view.h"
-#include "sgm_stereo.h"
+#include "Image.hpp"
+#include "JobRunner.hpp"
+#include "Pipeline.hpp"
+#include "mve/bundle.h"
 
 class GLPanel;
+class ThumbnailList;
 
 class MainFrame : public wxFrame {
-   public:
-    /** ImageList, first is the list control display on window,
-     * second is the list that holds icon data.*/
-    typedef std::pair<wxListCtrl *, wxImageList *> ImageList;
-
    public:
     explicit MainFrame(wxWindow *parent, wxWindowID id = wxID_ANY,
                        const wxString &title = wxEmptyString,
@@ -29,60 +28,127 @@ class MainFrame : public wxFrame {
         MENU_SCENE_NEW,
         MENU_SCENE_OPEN,
         MENU_DO_SFM,
+        MENU_HARRIS_FEATURES,
+        MENU_RETRIEVAL_MATCHING,
+        MENU_SEQUENTIAL_MATCHING,
+        MENU_QUANTIZED_MATCHING,
+        MENU_BATCHED_SFM,
         MENU_DISPLAY_FRUSTUM,
         MENU_DEPTH_RECON_MVS,
         MENU_DEPTH_RECON_MVS_THERMAL,
         MENU_DEPTH_RECON_SHADING,
         MENU_DEPTH_RECON_SHADING_THERMAL,
+        MENU_THERMAL_CALIBRATION,
+        MENU_THERMAL_REGISTRATION_MVS,
+        MENU_THERMAL_REGISTRATION_SHADING,
         MENU_MESH_RECON_MVS,
         MENU_MESH_RECON_SHADING,
         MENU_FSS_RECON,
-        MENU_GENERATE_DEPTH_IMG
+        MENU_FSS_PARTITIONED,
+        MENU_GENERATE_DEPTH_IMG,
+        MENU_CANCEL_JOBS
+    };
+
+    /** Ids of the wxEVT_THREAD events posted by the job runner */
+    enum JOB_EVENT {
+        JOB_EVENT_PROGRESS = wxID_HIGHEST + 1,
+        JOB_EVENT_FINISHED
     };
 
    private:
+    void OnClose(wxCloseEvent &event);
+
+    void OnMenuCancelJobs(wxCommandEvent &event);
+
+    void OnJobProgress(wxThreadEvent &event);
+
+    void OnJobFinished(wxThreadEvent &event);
+
+    /** Run 'stage' on the job runner, 'on_done' is called on the GUI thread
+     * once the stage succeeded. */
+    void SubmitJob(const std::string &name, std::function<void()> stage,
+                   std::function<void()> on_done);
+
+    /** False with a message if jobs are running, handlers reading the scene
+     * views must not run alongside them. */
+    bool CheckIdle();
+
     void OnMenuOpenScene(wxCommandEvent &event);
 
     void OnMenuNewScene(wxCommandEvent &event);
 
     void OnMenuStructureFromMotion(wxCommandEvent &event);
 
+    void OnMenuHarrisFeatures(wxCommandEvent &event);
+
+    void OnMenuRetrievalMatching(wxCommandEvent &event);
+
+    void OnMenuSequentialMatching(wxCommandEvent &event);
+
+    void OnMenuQuantizedMatching(wxCommandEvent &event);
+
+    void OnMenuBatchedSfM(wxCommandEvent &event);
+
     void OnMenuDisplayFrustum(wxCommandEvent &event);
 
     void OnMenuDepthReconShading(wxCommandEvent &event);
 
     void OnMenuDepthReconMVS(wxCommandEvent &event);
 
+    /** Calibrate from a directory holding thermal-img and normal-img */
+    void OnMenuThermalCalibration(wxCommandEvent &event);
+
+    /** Estimate the depth scale and write the merged thermal embeddings */
+    void OnMenuThermalRegistration(wxCommandEvent &event);
+
     void OnMenuMeshReconstruction(wxCommandEvent &event);
 
     void OnMenuFSSR(wxCommandEvent &event);
 
-    /** Display images owned by m_pScene on 'image_list' which have the name of
-     * 'image_name' */
-    void DisplaySceneImage(const std::string &image_name,
-                           const ImageList &image_list);
+    void OnMenuPartitionedFSSR(wxCommandEvent &event);
+
+    /** List the views of the pipeline scene with their thumbnails, made by
+     * Pipeline::CreateThumbnails on the job thread */
+    void DisplaySceneImage(std::vector<Pipeline::Thumbnail> thumbnails);
+
+    /** Replace the displayed cluster with the bundle's feature points */
+    void DisplayBundle(const mve::Bundle::ConstPtr &bundle);
+
+    /** Replace the displayed cluster with 'point_set', keeping its
+     * transform. 'skip_dark' drops the black area outside of the images. */
+    void DisplayPointSet(const PointCloud::ConstPtr &point_set, bool skip_dark);
+
+    /** Replace the displayed cluster with 'mesh', keeping its transform */
+    void DisplayMesh(const mve::TriangleMesh::ConstPtr &mesh);
 
-    ImageList m_originalImageList;
+    ThumbnailList *m_pThumbnailList;
 
     GLPanel *m_pGLPanel;
 
-    /** The pointer that hold all the data(image, death map...etc)*/
-    mve::Scene::Ptr m_pScene;
+    /** Scene data and the reconstruction stages */
+    Pipeline m_pipeline;
 
-    /** Image down scale factor for speeding up calculation */
-    int m_scale;
+    /** Feature type used for matching in structure from motion */
+    FeatureType m_featureType;
 
-    /** The pointer to OpenGL render target */
-    RenderTarget::Ptr m_pCluster;
+    /** View pairs matched in structure from motion */
+    MatchingOptions m_matchingOptions;
+
+    /** Next view registration of structure from motion */
+    Pipeline::SfmOptions m_sfmOptions;
+
+    /** Mesh the FSSR surface in blocks, see Pipeline::SurfaceOptions */
+    bool m_partitionedFSSR;
 
-    /** The pointer to mvs construct result*/
-    mve::TriangleMesh::Ptr m_point_set;
+    /** Runs the pipeline stages off the GUI thread, declared after
+     * m_pipeline so that it is joined before the pipeline goes away */
+    std::unique_ptr<JobRunner> m_jobRunner;
 
-    void reconstructSMVS(const smvs::SGMStereo::Options &opt,
-                         int scale, bool noOptimize,
-                         const std::string &input_name,
-                         const std::string &dm_name,
-                         const std::string &sgmName);
+    /** GUI work to do after a job succeeded, by job id */
+    std::map<int, std::function<void()>> m_jobContinuations;
+
+    /** The pointer to OpenGL render target */
+    RenderTarget::Ptr m_pCluster;
 };
 
 #endif  //_MAIN_FRAME_HPP
@@ -0,0 +1,66 @@
+#ifndef _MEMORY_BUDGET_HPP
+#define _MEMORY_BUDGET_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/** Admission control for tasks whose peak memory is estimated up front. A
+ * task is admitted once its estimate fits into what the running tasks leave
+ * of the budget, in the order the tasks asked for it, so a large task is not
+ * starved by smaller ones. A task larger than the whole budget runs alone. */
+class MemoryBudget {
+public:
+    struct Stats {
+        std::size_t admitted = 0;
+        /** Tasks that had to wait for memory */
+        std::size_t queued = 0;
+        /** Tasks admitted alone because they exceed the budget */
+        std::size_t oversized = 0;
+        double wait_seconds = 0.0;
+        std::size_t peak_bytes = 0;
+        std::size_t peak_tasks = 0;
+    };
+
+    /** Reserved memory of an admitted task, released on destruction. */
+    class Admission {
+    public:
+        Admission(MemoryBudget &budget, std::size_t bytes);
+
+        ~Admission();
+
+        Admission(const Admission &) = delete;
+
+        Admission &operator=(const Admission &) = delete;
+    private:
+        MemoryBudget &m_budget;
+        std::size_t m_bytes;
+    };
+public:
+    /** 'budget_bytes' of 0 selects DefaultBudget. */
+    explicit MemoryBudget(std::size_t budget_bytes);
+
+    std::size_t GetBudget() const { return m_budget; }
+
+    Stats GetStats() const;
+
+    /** Half of the physical memory, 4 GB if it cannot be queried. */
+    static std::size_t DefaultBudget();
+private:
+    void Acquire(std::size_t bytes);
+
+    void Release(std::size_t bytes);
+private:
+    std::size_t m_budget;
+    std::size_t m_used;
+    std::size_t m_running;
+    /** Tickets in request order, the next one to admit is 'm_serving' */
+    std::uint64_t m_next_ticket;
+    std::uint64_t m_serving;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    Stats m_stats;
+};
+
+#endif //_MEMORY_BUDGET_HPP
@@ -0,0 +1,32 @@
+#ifndef _MESH_CLEANUP_HPP
+#define _MESH_CLEANUP_HPP
+
+#include "mve/mesh.h"
+#include <cstddef>
+
+/** Confidence and component cleanup of an FSSR isosurface in one pass. The
+ * vertices without enough confidence and those of small connected
+ * components go to one kill mask, vertices and faces are compacted once.
+ * Components are found by a lock-free union-find over the faces left by
+ * the confidence test, so the result equals deleting the low confidence
+ * vertices and running mve::geom::mesh_components afterwards. */
+class MeshCleanup {
+public:
+    struct Options {
+        /** Vertices with a confidence of zero or up to this are deleted */
+        float confidence_threshold = 5.f;
+        /** Components of at most this many vertices are deleted */
+        std::size_t component_threshold = 1000;
+    };
+
+    struct Stats {
+        std::size_t low_confidence = 0;
+        /** Vertices of deleted components */
+        std::size_t isolated = 0;
+        std::size_t components = 0;
+    };
+public:
+    static Stats Apply(mve::TriangleMesh &mesh, const Options &options);
+};
+
+#endif //_MESH_CLEANUP_HPP
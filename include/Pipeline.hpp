@@ -0,0 +1,223 @@
+#ifndef _PIPELINE_HPP
+#define _PIPELINE_HPP
+
+#include "Image.hpp"
+#include "JobRunner.hpp"
+#include "PointCloud.hpp"
+#include "StageCache.hpp"
+#include "SurfacePartition.hpp"
+#include "Util.hpp"
+#include "thermal/Calibration.hpp"
+#include "thermal/ScaleEstimator.hpp"
+#include "mve/scene.h"
+#include "mve/bundle.h"
+#include "mve/mesh.h"
+#include "sgm_stereo.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** The reconstruction stages, free of any GUI code. Stages report failures
+ * by throwing std::runtime_error, and JobCancelled once a job context set
+ * with SetJobContext is cancelled. */
+class Pipeline {
+public:
+    struct ImportOptions {
+        /** Images decoded but not yet written, bounds the import memory */
+        int max_images_in_flight = 8;
+        /** Downscale larger images by halving, 0 keeps the original size */
+        int max_pixels = 0;
+        /** Decode, downscale and write threads per stage, 0 for all cores */
+        int num_threads = 0;
+    };
+
+    struct ReprojectionOptions {
+        /** Visual to thermal transform W, THERMAL_CALIBRATION_FILE in the
+         * scene directory if empty */
+        std::string calibration_path;
+        /** Factor from the SfM depth to the depth unit of the calibration,
+         * see EstimateThermalScale */
+        float depth_scale = 1.f;
+        /** Share of the thermal image in the blend, the rest is visual */
+        float thermal_weight = 0.7f;
+        /** Views reprojected at once, 0 for all cores */
+        int num_threads = 0;
+    };
+
+    struct SurfaceOptions {
+        /** Mesh overlapping blocks of the point set in parallel under the
+         * memory budget and stitch them, instead of one octree of all
+         * samples */
+        bool partitioned = false;
+        SurfacePartition::Options partition;
+    };
+
+    /** Thumbnail of a view as plain pixels, detached from the mve::View
+     * objects the stages work on. */
+    struct Thumbnail {
+        int view_id = -1;
+        std::string directory;
+        int width = 0;
+        int height = 0;
+        /** Rgb pixels, empty if the view has no thumbnail */
+        std::vector<unsigned char> rgb;
+    };
+
+    struct SfmOptions {
+        /** Register the passing views of several candidates per round of
+         * the incremental SfM, their P3P RANSAC run concurrently, instead
+         * of the first passing candidate only. Rounds that may add a single
+         * view still try one candidate after the other. The RANSAC runs
+         * share one random generator, so the result differs between runs. */
+        bool batched_registration = false;
+        /** Candidates tried at once by the batched registration */
+        int batch_candidates = 16;
+    };
+public:
+    Pipeline();
+
+    /** Progress and cancellation hooks for the following stages, may be null. */
+    void SetJobContext(JobContext *context) { m_job = context; }
+
+    /** Memory the dense reconstruction tasks may take at once, estimated
+     * from the input sizes. 0 selects MemoryBudget::DefaultBudget. */
+    void SetMemoryBudget(std::size_t bytes) { m_memory_budget = bytes; }
+
+    /** Stereo pairs the SGM initialization of DepthReconShading is fused
+     * from, the first two neighbors by default. */
+    void SetSGMOptions(const Util::SGMPairOptions &options) { m_sgm_opts = options; }
+
+    /** Merge and storage of the point sets. */
+    void SetPointSetOptions(const Util::PointSetOptions &options) { m_point_set_opts = options; }
+
+    /** View pairs StructureFromMotion matches. */
+    void SetMatchingOptions(const MatchingOptions &options) { m_matching_opts = options; }
+
+    /** How StructureFromMotion registers the next views. */
+    void SetSfmOptions(const SfmOptions &options) { m_sfm_opts = options; }
+
+    /** How SurfaceReconstruction builds the isosurface. */
+    void SetSurfaceOptions(const SurfaceOptions &options) { m_surface_opts = options; }
+
+    /** Import all images of 'input_dir' into a new scene in 'input_dir/scene'.
+     * Decoding, EXIF, downscaling and writing run as concurrent stages. */
+    void NewScene(const std::string &input_dir,
+                  const ImportOptions &options = ImportOptions());
+
+    /** Open the scene in 'scene_dir' and map the point set written last. */
+    void OpenScene(const std::string &scene_dir);
+
+    /** Add the thumbnail embedding to views of older scenes lacking it,
+     * NewScene creates them while importing. Returns the thumbnails of all
+     * views for display. */
+    std::vector<Thumbnail> CreateThumbnails();
+
+    /** Feature matching and incremental SfM, the resulting cameras are
+     * applied to the views and undistorted images are saved. */
+    mve::Bundle::Ptr StructureFromMotion(FeatureType feature_type);
+
+    /** Shading based depth maps (SMVS) and the point set generated from them. */
+    void DepthReconShading(bool thermal);
+
+    /** MVE depth maps (DMRecon) and the point set generated from them. */
+    void DepthReconMVS(bool thermal);
+
+    /** Calibrate the thermal camera against the visual one from the circle
+     * grid images in 'thermal_dir' and 'visual_dir', paired by file name,
+     * and save W as THERMAL_CALIBRATION_FILE of the scene. The grids are
+     * detected in parallel, the visual intrinsics are scaled to the input
+     * of the reconstruction, so StructureFromMotion must have run. */
+    void CalibrateThermal(const std::string &thermal_dir, const std::string &visual_dir,
+                          const Thermal::GridOptions &grid = Thermal::GridOptions());
+
+    /** Depth scale for ReprojectThermal, estimated per view from the SMVS
+     * visual depth and the thermal SGM depth in parallel and combined by a
+     * RANSAC consensus. Needs DepthReconShading for both. */
+    float EstimateThermalScale(const std::string &calibration_path = std::string(),
+                               const ScaleEstimator::Options &options = ScaleEstimator::Options());
+
+    /** Reproject the thermal embedding of every view through its visual
+     * depth map and blend it over the visual input. Writes "merged-smvs" from
+     * the SMVS depth if 'shading' is set, "merged-mvs" from the MVS depth
+     * otherwise, the inputs of MeshReconstruction. */
+    void ReprojectThermal(bool shading, const ReprojectionOptions &options = ReprojectionOptions());
+
+    /** Point set of the thermal overlay embeddings. */
+    void MeshReconstruction(bool shading);
+
+    /** Floating scale surface reconstruction of the current point set. */
+    mve::TriangleMesh::Ptr SurfaceReconstruction();
+
+    /** The current scene, safe to call while a job replaces it. The views
+     * themselves must not be touched while a job runs. */
+    mve::Scene::Ptr GetScene() const {
+        std::lock_guard<std::mutex> lock(m_scene_mutex);
+        return m_pScene;
+    }
+
+    int GetScale() const { return m_scale; }
+
+    PointCloud::Ptr GetPointSet() const { return m_point_set; }
+private:
+    bool IsCancelled() const { return m_job != nullptr && m_job->IsCancelled(); }
+
+    void SetScene(const mve::Scene::Ptr &scene);
+
+    void CheckCancelled() const;
+
+    void ReportProgress(std::size_t done, std::size_t total) const;
+
+    /** Hash of the image an input embedding is made from, a downscaled
+     * input made from an older undistorted image is removed. */
+    std::uint64_t InputHash(const mve::View::Ptr &view, const std::string &input_name, int scale);
+
+    /** Point set of the depth maps, regenerated if they changed since the
+     * existing .ply was written. */
+    PointCloud::Ptr GeneratePointSet(const std::string &output_name,
+                                     const std::string &input_name,
+                                     const std::string &dm_name,
+                                     bool smvs);
+
+    /** FSSR isosurface of all samples in one octree. */
+    mve::TriangleMesh::Ptr ExtractSurface(const PointCloud &points);
+
+    /** FSSR isosurface meshed block by block, see SurfacePartition. */
+    mve::TriangleMesh::Ptr ExtractPartitionedSurface(const PointCloud &points);
+
+    void ReconstructSMVS(const smvs::SGMStereo::Options &opt,
+                         int scale, bool noOptimize,
+                         const std::string &input_name,
+                         const std::string &dm_name,
+                         const std::string &sgmName);
+
+    /** The pointer that hold all the data(image, death map...etc)*/
+    mve::Scene::Ptr m_pScene;
+
+    /** Guards replacing m_pScene against GetScene from other threads */
+    mutable std::mutex m_scene_mutex;
+
+    /** Image down scale factor for speeding up calculation */
+    int m_scale;
+
+    /** The pointer to mvs construct result*/
+    PointCloud::Ptr m_point_set;
+
+    /** Input hashes of the stage outputs in the scene directory */
+    std::unique_ptr<StageCache> m_cache;
+
+    JobContext *m_job;
+
+    std::size_t m_memory_budget;
+
+    Util::SGMPairOptions m_sgm_opts;
+
+    Util::PointSetOptions m_point_set_opts;
+
+    SurfaceOptions m_surface_opts;
+
+    MatchingOptions m_matching_opts;
+    SfmOptions m_sfm_opts;
+};
+
+#endif //_PIPELINE_HPP
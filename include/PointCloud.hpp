@@ -0,0 +1,125 @@
+#ifndef _POINT_CLOUD_HPP
+#define _POINT_CLOUD_HPP
+
+#include "math/vector.h"
+#include "mve/mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/** Point set with its attributes in separate arrays, stored in the columnar
+ * .mvpc format: a fixed header followed by the position, normal, color,
+ * scale and confidence arrays, each aligned to 64 bytes and stored raw or
+ * as LZ4 compressed chunks. Load maps the file, raw arrays are used in place
+ * and only compressed ones are decoded. Mapped pages are copied on write, so
+ * changing a loaded point set never touches the file. */
+class PointCloud {
+public:
+    typedef std::shared_ptr<PointCloud> Ptr;
+    typedef std::shared_ptr<const PointCloud> ConstPtr;
+
+    enum Column {
+        COLUMN_POSITION,
+        COLUMN_NORMAL,
+        /** RGB in [0, 1], negative if the points have no color */
+        COLUMN_COLOR,
+        COLUMN_SCALE,
+        COLUMN_CONFIDENCE,
+        NUM_COLUMNS
+    };
+
+    struct SaveOptions {
+        /** LZ4 compress the arrays, needs a build with LZ4 */
+        bool compress = false;
+        /** Points per compressed chunk, chunks are coded in parallel */
+        std::size_t chunk_points = 1 << 20;
+    };
+
+    /** Columns of the file format, public for ChunkedPointSet */
+    struct ColumnHeader {
+        std::uint64_t offset;
+        std::uint64_t bytes;
+        std::uint32_t codec;
+        std::uint32_t chunk_points;
+    };
+
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t num_columns;
+        std::uint64_t num_points;
+        ColumnHeader columns[NUM_COLUMNS];
+    };
+public:
+    ~PointCloud();
+
+    PointCloud(const PointCloud &) = delete;
+
+    PointCloud &operator=(const PointCloud &) = delete;
+
+    /** A point set of 'num_points' uninitialized points. */
+    static Ptr Create(std::size_t num_points);
+
+    /** Copy of the vertices of 'mesh' and their attributes. Missing
+     * normals, scales or confidences are zero, one and one, missing
+     * colors -1. */
+    static Ptr FromMesh(const mve::TriangleMesh &mesh);
+
+    static Ptr Load(const std::string &path);
+
+    void Save(const std::string &path) const { Save(path, SaveOptions()); }
+
+    void Save(const std::string &path, const SaveOptions &options) const;
+
+    /** Copy into a mesh with the scales as vertex values. */
+    mve::TriangleMesh::Ptr ToMesh() const;
+
+    std::size_t GetSize() const { return m_size; }
+
+    /** Whether the columns are read from a mapped file */
+    bool IsMapped() const { return m_mapping != nullptr; }
+
+    math::Vec3f *GetPositions() { return Data<math::Vec3f>(COLUMN_POSITION); }
+    const math::Vec3f *GetPositions() const { return Data<math::Vec3f>(COLUMN_POSITION); }
+
+    math::Vec3f *GetNormals() { return Data<math::Vec3f>(COLUMN_NORMAL); }
+    const math::Vec3f *GetNormals() const { return Data<math::Vec3f>(COLUMN_NORMAL); }
+
+    math::Vec3f *GetColors() { return Data<math::Vec3f>(COLUMN_COLOR); }
+    const math::Vec3f *GetColors() const { return Data<math::Vec3f>(COLUMN_COLOR); }
+
+    float *GetScales() { return Data<float>(COLUMN_SCALE); }
+    const float *GetScales() const { return Data<float>(COLUMN_SCALE); }
+
+    float *GetConfidences() { return Data<float>(COLUMN_CONFIDENCE); }
+    const float *GetConfidences() const { return Data<float>(COLUMN_CONFIDENCE); }
+
+    /** Raw array of 'column', GetSize() elements of ElementBytes() */
+    const void *GetData(Column column) const { return m_columns[column]; }
+
+    /** Bytes of one point in 'column' */
+    static std::size_t ElementBytes(Column column);
+
+    /** Header of an uncompressed file of 'num_points' points, the columns
+     * follow each other in order. */
+    static FileHeader RawHeader(std::size_t num_points);
+
+    /** Offset of the first column and alignment of all columns */
+    static constexpr std::size_t COLUMN_ALIGNMENT = 64;
+private:
+    class Mapping;
+
+    PointCloud();
+
+    template<typename T>
+    T *Data(Column column) const { return reinterpret_cast<T *>(m_columns[column]); }
+private:
+    std::size_t m_size;
+    unsigned char *m_columns[NUM_COLUMNS];
+    /** Decoded or created columns, the others point into the mapping */
+    std::unique_ptr<unsigned char[]> m_owned[NUM_COLUMNS];
+    std::unique_ptr<Mapping> m_mapping;
+};
+
+#endif //_POINT_CLOUD_HPP
@@ -0,0 +1,57 @@
+#ifndef _STAGE_CACHE_HPP
+#define _STAGE_CACHE_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+/** 64 bit hash accumulated over the inputs of a stage. Not cryptographic,
+ * it only has to notice changed inputs. */
+class ContentHash {
+public:
+    ContentHash() : m_hash(14695981039346656037ull) {}
+
+    ContentHash &Add(const void *data, std::size_t size);
+
+    /** Adds the length too, so that ("ab", "c") and ("a", "bc") differ. */
+    ContentHash &Add(const std::string &str);
+
+    template<typename T>
+    ContentHash &AddValue(T value) {
+        static_assert(std::is_arithmetic<T>::value, "Only plain numbers are hashed by value");
+        return Add(&value, sizeof(T));
+    }
+
+    /** Hash the bytes of 'path', returns false if it cannot be read. */
+    bool AddFile(const std::string &path);
+
+    std::uint64_t Get() const { return m_hash; }
+private:
+    std::uint64_t m_hash;
+};
+
+/** Manifest of the stage outputs of a scene and the hash of the inputs they
+ * were computed from, stored as text in the scene directory. A stage may
+ * reuse an output only if its key is recorded with the current input hash. */
+class StageCache {
+public:
+    explicit StageCache(const std::string &scene_path);
+
+    bool IsValid(const std::string &key, std::uint64_t hash) const;
+
+    void Record(const std::string &key, std::uint64_t hash);
+
+    void Invalidate(const std::string &key);
+
+    /** Write the manifest, through a temporary file so that an interrupted
+     * write keeps the previous one. */
+    void Save() const;
+private:
+    std::string m_path;
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::uint64_t> m_entries;
+};
+
+#endif //_STAGE_CACHE_HPP
@@ -0,0 +1,62 @@
+#ifndef _STEREO_VIEW_CACHE_HPP
+#define _STEREO_VIEW_CACHE_HPP
+
+#include "mve/view.h"
+#include "stereo_view.h"
+#include <cstddef>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+/** Neighbor StereoViews shared by the SMVS tasks of ReconstructSMVS. A view
+ * is loaded and its gradients computed once, later requests get the same
+ * instance while it is cached. Views no task holds any more are evicted in
+ * least recently used order once their estimated size exceeds the budget,
+ * views still in use are never evicted. Cached views are only read. */
+class StereoViewCache {
+public:
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        /** Largest estimated size of the cached views in bytes */
+        std::size_t peak_bytes = 0;
+    };
+public:
+    StereoViewCache(const std::string &image_name, std::size_t budget_bytes);
+
+    /** The StereoView of 'view' without shading. Concurrent requests for a
+     * view that is still being created wait for it. */
+    smvs::StereoView::Ptr Get(const mve::View::Ptr &view);
+
+    Stats GetStats() const;
+
+    /** Estimated size of a StereoView of 'view', its float image and the
+     * two gradient channels at the size of the input embedding. */
+    static std::size_t EstimateBytes(const mve::View::Ptr &view, const std::string &image_name);
+
+    static std::size_t EstimateBytes(int width, int height, int channels);
+private:
+    struct Entry {
+        std::shared_future<smvs::StereoView::Ptr> view;
+        std::size_t bytes;
+        std::list<int>::iterator lru;
+    };
+
+    /** Drop unused views from the tail of the LRU list until the cache
+     * fits the budget, 'm_mutex' is held. */
+    void Evict();
+private:
+    std::string m_image_name;
+    std::size_t m_budget;
+    std::size_t m_bytes;
+    mutable std::mutex m_mutex;
+    std::map<int, Entry> m_entries;
+    /** View ids, most recently used first */
+    std::list<int> m_lru;
+    Stats m_stats;
+};
+
+#endif //_STEREO_VIEW_CACHE_HPP
@@ -0,0 +1,70 @@
+#ifndef _SURFACE_PARTITION_HPP
+#define _SURFACE_PARTITION_HPP
+
+#include "PointCloud.hpp"
+#include "math/vector.h"
+#include "mve/mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Split of a point set into octree blocks for meshing it piecewise with
+ * FSSR. Blocks are subdivided until their core holds at most
+ * 'max_block_samples' samples, a block also takes the samples whose support
+ * reaches into its core, so the implicit function is the same as with all
+ * samples there. Every block octree is grown from the same samples in the
+ * same order as the one of the whole point set, so its nodes in the core
+ * match those of the monolithic octree. A block mesh keeps the faces with
+ * their centroid in its core, Stitch welds the block meshes along the
+ * core boundaries. */
+class SurfacePartition {
+public:
+    struct Options {
+        /** Samples in the core of a block before it is split */
+        std::size_t max_block_samples = 1 << 22;
+        /** Margin around the core of a block in scales of each sample, FSSR
+         * samples reach three scales plus the voxels next to the core */
+        float overlap = 6.f;
+    };
+
+    struct Block {
+        math::Vec3f min;
+        float size;
+        /** Indices of the samples of the block in point set order */
+        std::vector<std::uint32_t> samples;
+        /** Samples inside the core */
+        std::size_t num_core;
+    };
+public:
+    SurfacePartition(const PointCloud &points, const Options &options);
+
+    std::size_t GetNumBlocks() const { return m_blocks.size(); }
+
+    const Block &GetBlock(std::size_t index) const { return m_blocks[index]; }
+
+    std::size_t GetNumAnchors() const { return m_anchors.size(); }
+
+    /** FSSR isosurface of block 'index' cropped to its core, uncleaned.
+     * Blocks are independent and may be meshed concurrently. */
+    mve::TriangleMesh::Ptr MeshBlock(std::size_t index) const;
+
+    /** Join the meshes of all blocks, vertices on the core boundaries are
+     * welded with the matching vertex of the neighboring block. */
+    mve::TriangleMesh::Ptr Stitch(const std::vector<mve::TriangleMesh::Ptr> &meshes) const;
+
+    /** Rough peak memory of meshing a block of 'num_samples' samples */
+    static std::size_t EstimateBytes(std::size_t num_samples);
+
+    /** Dark points are not sampled, they are holes of the thermal images. */
+    static bool IsSample(const math::Vec3f &color);
+private:
+    const PointCloud &m_points;
+    std::vector<Block> m_blocks;
+    /** Samples that create or grow the octree root, inserted into every
+     * block so that its octree gets the root of the monolithic one */
+    std::vector<std::uint32_t> m_anchors;
+    /** Distance below which vertices of different blocks are welded */
+    float m_tolerance;
+};
+
+#endif //_SURFACE_PARTITION_HPP
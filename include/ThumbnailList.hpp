@@ -0,0 +1,35 @@
+#ifndef _THUMBNAIL_LIST_HPP
+#define _THUMBNAIL_LIST_HPP
+
+#include <wx/listctrl.h>
+#include <wx/wx.h>
+#include <vector>
+#include "Pipeline.hpp"
+
+/** Virtual list of the scene views. The thumbnails come as plain pixels
+ * from Pipeline::CreateThumbnails run as a job, the list never touches the
+ * mve::View objects the stages work on. A row's icon is made the first
+ * time it is drawn and is then kept in the list's wxImageList. */
+class ThumbnailList : public wxListCtrl {
+public:
+    ThumbnailList(wxWindow *parent, wxWindowID id);
+
+    /** Show the views of 'thumbnails', an empty list clears it */
+    void SetThumbnails(std::vector<Pipeline::Thumbnail> thumbnails);
+protected:
+    wxString OnGetItemText(long item, long column) const override;
+
+    int OnGetItemImage(long item) const override;
+private:
+    enum {
+        THUMBNAIL_NOT_LOADED = -1,
+        THUMBNAIL_MISSING = -2
+    };
+
+    std::vector<Pipeline::Thumbnail> m_thumbnails;
+
+    /** Image list index of each row or one of the values above */
+    mutable std::vector<int> m_imageIndex;
+};
+
+#endif //_THUMBNAIL_LIST_HPP
@@ -4,6 +4,8 @@
 #include "mve/image_io.h"
 #include "mve/scene.h"
 #include "sgm_stereo.h"
+#include "filter/DepthFusion.hpp"
+#include "PointCloud.hpp"
 #include <glm/glm.hpp>
 #include <set>
 
@@ -16,27 +18,58 @@ void GaussFilter(const mve::FloatImage::ConstPtr &img,
                  int filter_range,
                  float sigma);
 
-mve::FloatImage::Ptr ComputeIntegralImg(const mve::FloatImage::ConstPtr &img);
+mve::DoubleImage::Ptr ComputeIntegralImg(const mve::FloatImage::ConstPtr &img);
 
 void MeanFilter(const mve::FloatImage::ConstPtr &img, mve::FloatImage::Ptr &out, int filter_range);
 
-mve::TriangleMesh::Ptr GenerateMeshSMVS(mve::Scene::Ptr scene,
-                                        const std::string &input_name,
-                                        const std::string &dm_name,
-                                        const std::string &output_name,
-                                        bool triangle_mesh);
+/** Merge and storage of the point sets of GenerateMesh and GenerateMeshSMVS. */
+struct PointSetOptions {
+    /** Write every view to a chunk on disk and merge the chunks into the
+     * point set file without holding the point set in memory, MVS only */
+    bool streaming = false;
+    /** LZ4 compress the point set file, streamed ones stay uncompressed */
+    bool compress = false;
+};
 
-mve::TriangleMesh::Ptr GenerateMesh(mve::Scene::Ptr scene,
-                                    const std::string &input_name,
-                                    const std::string &dm_name,
-                                    int scale,
-                                    const std::string &output_name);
+/** Point set file of 'output_name' in the scene directory, a .ply suffix is
+ * replaced by .mvpc. */
+std::string PointSetPath(const mve::Scene::Ptr &scene, const std::string &output_name);
 
+PointCloud::Ptr GenerateMeshSMVS(mve::Scene::Ptr scene,
+                                 const std::string &input_name,
+                                 const std::string &dm_name,
+                                 const std::string &output_name,
+                                 bool triangle_mesh,
+                                 const PointSetOptions &options = PointSetOptions());
+
+/** Point set of the depth maps 'dm_name' of all views, written to the
+ * PointSetPath of 'output_name' or mapped from it if it exists. The views
+ * are triangulated in parallel and copied to their offsets in the merged
+ * point set. A streamed point set is mapped from the written file. */
+PointCloud::Ptr GenerateMesh(mve::Scene::Ptr scene,
+                             const std::string &input_name,
+                             const std::string &dm_name,
+                             int scale,
+                             const std::string &output_name,
+                             const PointSetOptions &options = PointSetOptions());
+
+/** Stereo pairs of reconstructSGMDepthForView and the fusion of their depth. */
+struct SGMPairOptions {
+    /** Neighbors paired with the view, 0 for all of them */
+    std::size_t num_pairs = 2;
+    Filter::DepthFusion fusion = Filter::DEPTH_FUSION_MEDIAN;
+    /** Pairs reconstructed at once, 0 for all of them */
+    int num_threads = 0;
+};
+
+/** SGM depth of 'main_view' against its first neighbors, the pairs are
+ * reconstructed concurrently and their depths fused per pixel. */
 void reconstructSGMDepthForView(const smvs::SGMStereo::Options &opt,
                                 const std::string &outputName,
                                 smvs::StereoView::Ptr main_view,
                                 std::vector<smvs::StereoView::Ptr> neighbors,
-                                mve::Bundle::ConstPtr bundle = nullptr);
+                                mve::Bundle::ConstPtr bundle = nullptr,
+                                const SGMPairOptions &pair_opts = SGMPairOptions());
 
 
 void resizeViews(mve::Scene::ViewList &views,
@@ -0,0 +1,27 @@
+#ifndef _BINARY_MATCHER_HPP
+#define _BINARY_MATCHER_HPP
+
+#include "feature/Brief.hpp"
+#include <vector>
+
+/** Brute force hamming matcher with Lowe's ratio test and cross check. */
+class BinaryMatcher {
+public:
+    struct Options {
+        /** Best distance must be below this ratio of the second best. */
+        float lowe_ratio = 0.8f;
+        /** Matches with more differing bits are rejected. */
+        int max_distance = 64;
+    };
+public:
+    explicit BinaryMatcher(const Options &opts);
+
+    /** For every descriptor of 'set_1' the index of its match in 'set_2', or -1. */
+    void Match(const Brief::Descriptors &set_1,
+               const Brief::Descriptors &set_2,
+               std::vector<int> *matches_1_2) const;
+private:
+    Options m_opts;
+};
+
+#endif //_BINARY_MATCHER_HPP
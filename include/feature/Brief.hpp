@@ -0,0 +1,34 @@
+#ifndef _BRIEF_HPP
+#define _BRIEF_HPP
+
+#include "mve/image.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/** Upright 256 bit BRIEF descriptor over a fixed set of intensity tests. */
+class Brief {
+public:
+    using Descriptor = std::array<std::uint64_t, 4>;
+    using Descriptors = std::vector<Descriptor>;
+
+    /** Half size of the sampled patch, keypoints need this much border. */
+    static constexpr int PATCH_RADIUS = 15;
+public:
+    Brief();
+
+    /** Compute the descriptor at (x, y) of a smoothed single channel image. */
+    Descriptor Compute(const mve::ByteImage &smoothed, int x, int y) const;
+
+    static int Distance(const Descriptor &d1, const Descriptor &d2) {
+        return __builtin_popcountll(d1[0] ^ d2[0]) + __builtin_popcountll(d1[1] ^ d2[1])
+            + __builtin_popcountll(d1[2] ^ d2[2]) + __builtin_popcountll(d1[3] ^ d2[3]);
+    }
+private:
+    struct Test {
+        int x1, y1, x2, y2;
+    };
+    std::vector<Test> m_tests;
+};
+
+#endif //_BRIEF_HPP
@@ -6,12 +6,6 @@
 
 class Harris {
 public:
-    struct Derivatives {
-        mve::FloatImage::Ptr Ix;
-        mve::FloatImage::Ptr Iy;
-        mve::FloatImage::Ptr Ixy;
-    };
-
     struct KeyPoint {
         int x;
         int y;
@@ -27,14 +21,26 @@ public:
 
     void Process();
 
+    /** Corner measure of Process, shrunk by 1 + filter_range on every side. */
+    mve::FloatImage::ConstPtr GetResponses() const { return m_harris_responses; }
+
+    /** Strongest 'percentage' of the pixel amount among the local maxima,
+     * greedily suppressing points within 'suppression_radius' of a stronger one. */
     KeyPoints GetMaximaPoints(float percentage, int suppression_radius);
-private:
-    Derivatives ComputeDerivatives();
 
-    void ApplyGaussToDerivatives(float sigma);
+    /** At most 'num_points' local maxima spread evenly over buckets of
+     * 'cell_size' pixels, strongest points first inside each bucket. */
+    KeyPoints GetGridMaximaPoints(std::size_t num_points, int cell_size);
+private:
+    /** Positive 3x3 local maxima of the response map, in response coordinates. */
+    KeyPoints FindLocalMaxima() const;
 
-    void ApplyMeanToDerivatives();
+    /** Window applied to the structure tensor, gaussian for sigma > 0 and
+     * mean otherwise. */
+    std::vector<float> WindowKernel() const;
 
+    /** Sobel gradients, tensor products, windowing and the corner measure
+     * fused per tile, only the response map is written. */
     void ComputeHarrisResponses();
 private:
     float m_k;
@@ -43,7 +49,6 @@ private:
 
     mve::FloatImage::ConstPtr m_orig; // Original input image
     mve::FloatImage::Ptr m_harris_responses;
-    Derivatives m_derivatives;
 };
 
 #endif //_HARRIS_HPP
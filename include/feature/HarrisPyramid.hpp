@@ -0,0 +1,51 @@
+#ifndef _HARRIS_PYRAMID_HPP
+#define _HARRIS_PYRAMID_HPP
+
+#include "feature/Brief.hpp"
+#include "mve/image.h"
+#include <vector>
+
+/** Harris corners detected on a half size image pyramid and described with BRIEF. */
+class HarrisPyramid {
+public:
+    struct Options {
+        int num_octaves = 4;
+        /** Feature budget, shared by the octaves in proportion to their area. */
+        std::size_t max_features = 4000;
+        /** Bucket size in pixels for spreading corners over each octave. */
+        int cell_size = 32;
+        float k = 0.04f;
+        int filter_range = 2;
+        float sigma = 1.f;
+        /** Smoothing applied before sampling the descriptor tests. */
+        float descriptor_sigma = 2.f;
+    };
+
+    struct Feature {
+        float x; // Position in the input image
+        float y;
+        int octave;
+        float corner_response;
+    };
+
+    using Features = std::vector<Feature>;
+public:
+    explicit HarrisPyramid(const Options &opts);
+
+    void SetImage(const mve::ByteImage::ConstPtr &img);
+
+    void Process();
+
+    const Features &GetFeatures() const { return m_features; }
+
+    const Brief::Descriptors &GetDescriptors() const { return m_descriptors; }
+private:
+    Options m_opts;
+    Brief m_brief;
+
+    mve::ByteImage::ConstPtr m_orig; // Gray input image
+    Features m_features;
+    Brief::Descriptors m_descriptors;
+};
+
+#endif //_HARRIS_PYRAMID_HPP
@@ -0,0 +1,48 @@
+#ifndef _QUANTIZED_MATCHER_HPP
+#define _QUANTIZED_MATCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Brute force L2 matcher of float descriptors quantized to int8, with
+ * Lowe's ratio test and cross check. Dot products are taken with AVX2
+ * vpmaddubsw over tiles of 'set_2' that stay in cache while a block of
+ * 'set_1' runs over them, and the two nearest neighbors of every 'set_1'
+ * descriptor and the nearest of every 'set_2' descriptor are updated in
+ * the same sweep. */
+class QuantizedMatcher {
+public:
+    struct Options {
+        /** Best distance must be below this ratio of the second best. */
+        float lowe_ratio = 0.8f;
+    };
+
+    /** Rows of int8 values scaled to [-127, 127] each, padded with zeros to
+     * a multiple of 32 values and of 4 rows. Distances come from the dot
+     * product of the rows, their scales and the squared norms of the float
+     * descriptors. */
+    struct Descriptors {
+        int stride = 0;
+        std::vector<std::int8_t> values;
+        /** Float value of one quantization step of every row */
+        std::vector<float> steps;
+        std::vector<float> square_norms;
+
+        std::size_t size() const { return steps.size(); }
+    };
+public:
+    explicit QuantizedMatcher(const Options &opts);
+
+    /** Quantize descriptors given as rows of 'dim' floats. */
+    static Descriptors Quantize(const std::vector<float> &rows, int dim);
+
+    /** For every descriptor of 'set_1' the index of its match in 'set_2', or -1. */
+    void Match(const Descriptors &set_1,
+               const Descriptors &set_2,
+               std::vector<int> *matches_1_2) const;
+private:
+    Options m_opts;
+};
+
+#endif //_QUANTIZED_MATCHER_HPP
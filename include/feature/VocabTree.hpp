@@ -0,0 +1,74 @@
+#ifndef _VOCAB_TREE_HPP
+#define _VOCAB_TREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Vocabulary tree of hierarchical k-means over feature descriptors for
+ * image retrieval. Images are described by their tf-idf weighted, L1
+ * normalized word histograms and scored by histogram intersection through
+ * an inverted file, which ranks like the L1 distance of Nister and
+ * Stewenius. */
+class VocabTree {
+public:
+    struct Options {
+        int branching = 10;
+        int depth = 4;
+        /** Descriptors sampled evenly from all images to train the tree */
+        std::size_t max_training = 200000;
+        int kmeans_iterations = 10;
+    };
+
+    /** Descriptors as rows of 'dim' floats */
+    using Descriptors = std::vector<float>;
+
+    /** Word counts or weights of an image, sorted by word */
+    using BagOfWords = std::vector<std::pair<std::uint32_t, float>>;
+public:
+    VocabTree(const Options &opts, int dim);
+
+    int GetDimension() const { return m_dim; }
+
+    std::size_t GetNumWords() const { return m_num_words; }
+
+    /** Build the tree from 'samples', replacing any previous one. */
+    void Train(const Descriptors &samples);
+
+    /** Word counts of 'descriptors', may be called concurrently. */
+    BagOfWords Quantize(const Descriptors &descriptors) const;
+
+    /** Weight the word counts of all images and build the inverted file. */
+    void Index(std::vector<BagOfWords> images);
+
+    /** Up to 'k' other indexed images sharing words with 'image', the most
+     * similar first, with their scores in [0, 1]. */
+    std::vector<std::pair<std::size_t, float>> Query(std::size_t image, std::size_t k) const;
+private:
+    struct Node {
+        /** First of the consecutive children, 0 for leaves */
+        std::size_t first_child;
+        int num_children;
+        /** Word of a leaf */
+        std::uint32_t word;
+    };
+
+    void Split(std::size_t node, const Descriptors &samples,
+               std::vector<std::size_t> &indices, int level);
+
+    std::uint32_t Word(const float *descriptor) const;
+private:
+    Options m_opts;
+    int m_dim;
+    std::vector<Node> m_nodes;
+    /** Center of every node, the root's is unused */
+    std::vector<float> m_centers;
+    std::size_t m_num_words;
+    /** Weighted histogram of every indexed image */
+    std::vector<BagOfWords> m_images;
+    /** Images and their weights for every word */
+    std::vector<std::vector<std::pair<std::uint32_t, float>>> m_inverted;
+};
+
+#endif //_VOCAB_TREE_HPP
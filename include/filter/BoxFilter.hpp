@@ -0,0 +1,32 @@
+#ifndef _BOX_FILTER_HPP
+#define _BOX_FILTER_HPP
+
+#include "mve/image.h"
+#include <cstdint>
+
+namespace Filter {
+
+/** Accumulator used by the running sums of BoxFilter. */
+enum BoxAccumulator {
+    BOX_ACCUMULATE_FLOAT,
+    BOX_ACCUMULATE_DOUBLE
+};
+
+/** Mean of the (2 * filter_range + 1)^2 window around every pixel, computed
+ * with running sums along columns and rows. Only the valid region is written,
+ * so 'out' is shrunk by 2 * filter_range. 'img' and 'out' may alias. */
+void BoxFilter(const mve::FloatImage::ConstPtr &img,
+               mve::FloatImage::Ptr &out,
+               int filter_range,
+               BoxAccumulator accumulator = BOX_ACCUMULATE_DOUBLE);
+
+/** Integral image with a zero first row and column, one pixel larger than
+ * 'img' in both dimensions. Rows and columns are summed in parallel. */
+mve::DoubleImage::Ptr IntegralImage(const mve::FloatImage::ConstPtr &img);
+
+/** Exact integral image of a single channel byte image. */
+mve::Image<std::int64_t>::Ptr IntegralImage(const mve::ByteImage::ConstPtr &img);
+
+} // namespace Filter
+
+#endif //_BOX_FILTER_HPP
@@ -0,0 +1,26 @@
+#ifndef _CONVOLUTION_HPP
+#define _CONVOLUTION_HPP
+
+#include "mve/image.h"
+#include <vector>
+
+namespace Filter {
+
+/** Normalized 1D gaussian kernel with 2 * radius + 1 taps. */
+std::vector<float> GaussKernel(int radius, float sigma);
+
+/** Convolve a single channel image with 'kernel' along rows and columns.
+ * Only the valid region is written, so 'out' is shrunk by kernel.size() - 1
+ * in both dimensions. 'img' and 'out' may refer to the same image. */
+void SeparableFilter(const mve::FloatImage::ConstPtr &img,
+                     mve::FloatImage::Ptr &out,
+                     const std::vector<float> &kernel);
+
+void GaussFilter(const mve::FloatImage::ConstPtr &img,
+                 mve::FloatImage::Ptr &out,
+                 int filter_range,
+                 float sigma);
+
+} // namespace Filter
+
+#endif //_CONVOLUTION_HPP
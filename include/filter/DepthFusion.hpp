@@ -0,0 +1,30 @@
+#ifndef _DEPTH_FUSION_HPP
+#define _DEPTH_FUSION_HPP
+
+#include "mve/image.h"
+#include <vector>
+
+namespace Filter {
+
+/** How FuseDepths combines the hypotheses of a pixel. */
+enum DepthFusion {
+    /** Median of the valid hypotheses, the mean of the two middle ones for
+     * an even count */
+    DEPTH_FUSION_MEDIAN,
+    /** Mean weighted by the squared number of hypotheses agreeing with each
+     * one, so isolated outliers hardly count */
+    DEPTH_FUSION_CONSENSUS
+};
+
+/** Most hypotheses FuseDepths takes per pixel. */
+constexpr int MAX_FUSED_DEPTHS = 16;
+
+/** Fuse depth maps of equal size pixel by pixel, 0 marks a missing depth
+ * and is written where no map has one. Two depths agree if they differ by
+ * at most 'agreement' times the first. Eight pixels are fused at once. */
+mve::FloatImage::Ptr FuseDepths(const std::vector<mve::FloatImage::ConstPtr> &depths,
+                                DepthFusion fusion, float agreement = 0.05f);
+
+} // namespace Filter
+
+#endif //_DEPTH_FUSION_HPP
@@ -0,0 +1,97 @@
+#ifndef _KERNEL_HPP
+#define _KERNEL_HPP
+
+#include <cstddef>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* Row kernels shared by the filters and detectors, not meant as public API. */
+namespace Filter {
+
+/** Tap count known at compile time, lets the compiler unroll the kernel loops. */
+template<int N>
+struct FixedTaps {
+    static constexpr int size() { return N; }
+};
+
+struct DynamicTaps {
+    int n;
+    int size() const { return n; }
+};
+
+/** Call 'func' with the FixedTaps matching 'taps' for the kernels of the
+ * common radii 1 to 5 and 7, DynamicTaps otherwise. */
+template<typename Func>
+inline void DispatchTaps(int taps, Func &&func) {
+    switch (taps) {
+    case 3:func(FixedTaps<3>());
+        break;
+    case 5:func(FixedTaps<5>());
+        break;
+    case 7:func(FixedTaps<7>());
+        break;
+    case 9:func(FixedTaps<9>());
+        break;
+    case 11:func(FixedTaps<11>());
+        break;
+    case 15:func(FixedTaps<15>());
+        break;
+    default:func(DynamicTaps{taps});
+        break;
+    }
+}
+
+#if defined(__AVX__)
+inline __m256 MulAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128 MulAdd(__m128 a, __m128 b, __m128 c) {
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+/** dst[x] = sum_k kernel[k] * src[x + k * step] for x in [0, width) */
+template<typename Taps>
+inline void Convolve1D(Taps taps, const float *src, std::size_t step, int width,
+                       const float *kernel, float *dst) {
+    int x = 0;
+#if defined(__AVX__)
+    for (; x + 8 <= width; x += 8) {
+        __m256 acc = _mm256_mul_ps(_mm256_set1_ps(kernel[0]), _mm256_loadu_ps(src + x));
+        for (int k = 1; k < taps.size(); ++k)
+            acc = MulAdd(_mm256_set1_ps(kernel[k]), _mm256_loadu_ps(src + x + k * step), acc);
+        _mm256_storeu_ps(dst + x, acc);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; x + 4 <= width; x += 4) {
+        __m128 acc = _mm_mul_ps(_mm_set1_ps(kernel[0]), _mm_loadu_ps(src + x));
+        for (int k = 1; k < taps.size(); ++k)
+            acc = MulAdd(_mm_set1_ps(kernel[k]), _mm_loadu_ps(src + x + k * step), acc);
+        _mm_storeu_ps(dst + x, acc);
+    }
+#endif
+    for (; x < width; ++x) {
+        float acc = kernel[0] * src[x];
+        for (int k = 1; k < taps.size(); ++k)
+            acc += kernel[k] * src[x + k * step];
+        dst[x] = acc;
+    }
+}
+
+} // namespace Filter
+
+#endif //_KERNEL_HPP
@@ -0,0 +1,81 @@
+#ifndef _CALIBRATION_HPP
+#define _CALIBRATION_HPP
+
+#include "math/matrix.h"
+#include "math/vector.h"
+#include "mve/image.h"
+#include <string>
+#include <vector>
+
+/* Native ThermalVisualCalibrator of scripts/calibration.py: circle grids
+ * are detected in both image sets, each camera is calibrated on its own and
+ * the visual to thermal pixel transform W is composed from the poses. */
+namespace Thermal {
+
+/** Asymmetric circle grid, 'points_per_row' dots in each of 'rows' rows with
+ * every other row shifted by half a step, (3, 9) in scripts/main.py. */
+struct GridOptions {
+    int points_per_row = 3;
+    int rows = 9;
+    /** Distance of neighboring dots in a row and of neighboring rows, the
+     * unit of the calibrated translation */
+    double h_step = 50.0;
+    double v_step = 25.0;
+    /** Dots darker than the board, the thermal images show them bright */
+    bool dark_dots = true;
+    /** Dot area in pixels */
+    int min_area = 10;
+    int max_area = 100000;
+    /** Dots are this much darker than the mean of their neighborhood */
+    int threshold_offset = 8;
+};
+
+/** Dot centers ordered row by row, rows from top to bottom and dots from
+ * left to right in the image, and their board coordinates with z = 0.
+ * Which rows are shifted is read from the image, so both cameras label a
+ * dot the same as long as they see the board the same way up. Returns false
+ * if the grid is not found. The centers are intensity weighted centroids
+ * and thus subpixel accurate. */
+bool DetectCircleGrid(const mve::ByteImage::ConstPtr &image, const GridOptions &opts,
+                      std::vector<math::Vec2d> *centers,
+                      std::vector<math::Vec3d> *board_points);
+
+/** Pinhole camera with two radial distortion coefficients, the model of
+ * cv2.calibrateCamera without tangential terms. */
+struct CameraCalibration {
+    double fx, fy, cx, cy;
+    double k1, k2;
+    int width, height;
+    /** Board to camera pose per image, unused if 'valid' is false */
+    struct Pose {
+        bool valid;
+        math::Matrix3d R;
+        math::Vec3d t;
+    };
+    std::vector<Pose> poses;
+    /** Reprojection error in pixels */
+    double rms;
+};
+
+/** Zhang's closed form initialization refined with Levenberg-Marquardt.
+ * 'image_points' and 'board_points' hold the detections per image, empty
+ * ones are skipped and keep an invalid pose. Throws if fewer than two images
+ * have a grid. */
+CameraCalibration CalibrateCamera(const std::vector<std::vector<math::Vec2d>> &image_points,
+                                  const std::vector<std::vector<math::Vec3d>> &board_points,
+                                  int width, int height);
+
+/** W = K_thermal * Rt_thermal * Rt_visual^-1 * K_visual^-1 as in
+ * Matching.calibrate, with the visual intrinsics scaled to images of
+ * 'visual_width' x 'visual_height'. The relative pose is averaged over all
+ * images in which both cameras found the grid. */
+math::Matrix4d ThermalVisualTransform(const CameraCalibration &visual,
+                                      const CameraCalibration &thermal,
+                                      int visual_width, int visual_height);
+
+/** Write W in the numpy.savetxt format read by LoadCalibration. */
+void SaveCalibration(const std::string &path, const math::Matrix4d &W);
+
+} // namespace Thermal
+
+#endif //_CALIBRATION_HPP
@@ -0,0 +1,45 @@
+#ifndef _MUTUAL_INFORMATION_HPP
+#define _MUTUAL_INFORMATION_HPP
+
+#include "mve/image.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Thermal {
+
+/** Mutual information of two images from their joint histogram, the measure
+ * of utils.mutualInformation2D. Samples are binned by chunks of the input in
+ * private histograms, which are then summed bin range by bin range, so no
+ * two threads ever write the same counter. */
+struct MIOptions {
+    /** Bins per image, the joint histogram has bins * bins entries */
+    int bins = 256;
+    /** Gaussian smoothing of the joint histogram in bins, 0 disables it */
+    float sigma = 1.f;
+    /** Spread every sample over 4 x 4 bins with a cubic B-spline Parzen
+     * window instead of counting it in one bin */
+    bool parzen = false;
+    /** (H(a) + H(b)) / H(a, b) - 1 instead of H(a) + H(b) - H(a, b) */
+    bool normalized = false;
+    /** Histogram chunks binned in parallel, 0 for all cores. Callers that
+     * already run in parallel pass 1. */
+    int num_threads = 0;
+};
+
+/** MI of 'n' byte samples, those with a zero 'mask' entry are skipped.
+ * 'mask' may be null. */
+float MutualInformation(const std::uint8_t *a, const std::uint8_t *b, std::size_t n,
+                        const std::uint8_t *mask, const MIOptions &opts = MIOptions());
+
+/** MI of two single channel images of equal size. */
+float MutualInformation(const mve::ByteImage &a, const mve::ByteImage &b,
+                        const MIOptions &opts = MIOptions(), const mve::ByteImage *mask = nullptr);
+
+/** MI of two single channel float images, each binned over the range of its
+ * finite, unmasked values like numpy.histogram2d. */
+float MutualInformation(const mve::FloatImage &a, const mve::FloatImage &b,
+                        const MIOptions &opts = MIOptions(), const mve::ByteImage *mask = nullptr);
+
+} // namespace Thermal
+
+#endif //_MUTUAL_INFORMATION_HPP
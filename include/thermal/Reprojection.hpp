@@ -0,0 +1,40 @@
+#ifndef _REPROJECTION_HPP
+#define _REPROJECTION_HPP
+
+#include "math/matrix.h"
+#include "mve/image.h"
+#include <string>
+
+/* The image functions are single threaded, the pipeline runs them for
+ * several views at once. */
+namespace Thermal {
+
+/** Read the 4x4 visual to thermal transform W written by numpy.savetxt in
+ * scripts/matching.py. A visual pixel (u, v) at depth z maps to the thermal
+ * pixel of z' * [u', v', 1, 1/z'] = W * z * [u, v, 1, 1/z]. */
+math::Matrix4f LoadCalibration(const std::string &path);
+
+/** Thermal pixel coordinates of the visual pixels (x, y) for x in [0, width).
+ * 'depth' holds the unscaled visual depth of the row, pixels without depth
+ * or projecting behind the thermal camera get -2 in 'u' and 'v', which samples no tap. */
+void ProjectRow(const math::Matrix4f &W, int y, const float *depth, int width,
+                float depth_scale, float *u, float *v);
+
+/** 'src' resampled into the visual image through the depth map, the depth
+ * is resized to width x height first. Pixels sampling outside of 'src' are
+ * bilinearly blended with black, like cv2.remap with a constant border. */
+mve::ByteImage::Ptr ReprojectImage(const mve::ByteImage::ConstPtr &src,
+                                   const mve::FloatImage::ConstPtr &depth,
+                                   const math::Matrix4f &W, float depth_scale,
+                                   int width, int height);
+
+/** (1 - thermal_weight) * visual + thermal_weight * thermal, rounded and
+ * saturated like cv2.addWeighted. A single channel 'thermal' is blended into
+ * all channels of 'visual'. */
+mve::ByteImage::Ptr BlendImages(const mve::ByteImage::ConstPtr &visual,
+                                const mve::ByteImage::ConstPtr &thermal,
+                                float thermal_weight);
+
+} // namespace Thermal
+
+#endif //_REPROJECTION_HPP
@@ -0,0 +1,65 @@
+#ifndef _SCALE_ESTIMATOR_HPP
+#define _SCALE_ESTIMATOR_HPP
+
+#include "math/matrix.h"
+#include "thermal/MutualInformation.hpp"
+#include "mve/image.h"
+#include <vector>
+
+/** Factor between the SfM depth and the depth unit of the thermal
+ * calibration, the native Matching.guessScale of scripts/matching.py. A
+ * scale is scored by the mutual information between the visual depth and
+ * the thermal depth reprojected with it, weighted by the covered area. */
+class ScaleEstimator {
+public:
+    struct Options {
+        float min_scale = 1.f;
+        float max_scale = 500.f;
+        /** Scales tried per pyramid level, log spaced over the search range */
+        int num_samples = 24;
+        /** Half size levels, the coarsest one scans the whole range and each
+         * finer one refines around the best scale of the previous */
+        int num_levels = 3;
+        /** Consensus over the views as in scripts/ransac.py */
+        int ransac_iterations = 100;
+        float ransac_threshold = 20.f;
+        int ransac_sample_size = 10;
+        /** Histogram of the score, its thread count is ignored */
+        Thermal::MIOptions mi_options;
+    };
+
+    struct ViewScale {
+        int view_id;
+        float scale;
+        float score;
+    };
+public:
+    ScaleEstimator(const Options &opts, const math::Matrix4f &W);
+
+    /** Best scale of one view. 'visual_depth' is resized to the visual input
+     * size 'width' x 'height', 'thermal_depth' to 'thermal_width' x
+     * 'thermal_height', the thermal image size W maps to. Both are loaded
+     * into a pyramid once and only the warp is repeated per scale. */
+    ViewScale EstimateView(int view_id,
+                           const mve::FloatImage::ConstPtr &visual_depth, int width, int height,
+                           const mve::FloatImage::ConstPtr &thermal_depth,
+                           int thermal_width, int thermal_height) const;
+
+    /** Score weighted mean scale of the largest band of views within
+     * ransac_threshold of each other. */
+    float Consensus(const std::vector<ViewScale> &scales) const;
+private:
+    struct Level {
+        mve::FloatImage::Ptr depth;
+        mve::ByteImage::Ptr thermal;
+        /** W between the pixel grids of this level */
+        math::Matrix4f W;
+    };
+
+    float Score(const Level &level, float scale) const;
+private:
+    Options m_opts;
+    math::Matrix4f m_W;
+};
+
+#endif //_SCALE_ESTIMATOR_HPP
@@ -0,0 +1,154 @@
+#include "BatchRegistration.hpp"
+#include "sfm/ransac_pose_p3p.h"
+#include "sfm/bundle_adjustment.h"
+#include "sfm/ba_types.h"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+BatchRegistration::BatchRegistration(const sfm::bundler::Incremental::Options &opts,
+                                     sfm::bundler::ViewportList *viewports,
+                                     sfm::bundler::TrackList *tracks)
+    : m_opts(opts), m_viewports(viewports), m_tracks(tracks) {
+
+}
+
+std::vector<int> BatchRegistration::Register(const std::vector<int> &candidates, std::size_t max_views) {
+    std::vector<Estimate> estimates(candidates.size());
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t c = 0; c < candidates.size(); ++c) {
+        try {
+            EstimatePose(candidates[c], &estimates[c]);
+        } catch (...) {
+#pragma omp critical
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+    std::vector<int> registered;
+    for (std::size_t c = 0; c < candidates.size() && registered.size() < max_views; ++c) {
+        Estimate const &estimate = estimates[c];
+        /* Same 33% inlier limit as Incremental::reconstruct_next_view. */
+        bool const valid = !estimate.track_ids.empty()
+            && 3 * estimate.inliers.size() >= estimate.track_ids.size();
+        if (m_opts.verbose_output) {
+            std::cout << "View " << candidates[c] << ": " << estimate.inliers.size() << " of "
+                      << estimate.track_ids.size() << " 2D-3D correspondences inliers"
+                      << (valid ? "." : ", skipping.") << std::endl;
+        }
+        if (!valid)
+            continue;
+        Commit(candidates[c], estimate);
+        registered.push_back(candidates[c]);
+    }
+    return registered;
+}
+
+void BatchRegistration::EstimatePose(int view_id, Estimate *estimate) const {
+    sfm::bundler::Viewport const &viewport = m_viewports->at(view_id);
+    sfm::Correspondences2D3D corr;
+    for (std::size_t i = 0; i < viewport.track_ids.size(); ++i) {
+        int const track_id = viewport.track_ids[i];
+        if (track_id < 0 || !m_tracks->at(track_id).is_valid())
+            continue;
+        math::Vec2f const &pos2d = viewport.features.positions[i];
+        math::Vec3f const &pos3d = m_tracks->at(track_id).pos;
+        corr.emplace_back();
+        std::copy(pos3d.begin(), pos3d.end(), corr.back().p3d);
+        std::copy(pos2d.begin(), pos2d.end(), corr.back().p2d);
+        estimate->track_ids.push_back(track_id);
+        estimate->feature_ids.push_back(static_cast<int>(i));
+    }
+
+    estimate->pose.set_k_matrix(viewport.focal_length, 0.0, 0.0);
+    /* P3P needs three correspondences. */
+    if (corr.size() < 3) {
+        estimate->track_ids.clear();
+        return;
+    }
+    sfm::RansacPoseP3P::Result ransac_result;
+    sfm::RansacPoseP3P ransac(m_opts.pose_p3p_opts);
+    ransac.estimate(corr, estimate->pose.K, &ransac_result);
+    estimate->pose.R = ransac_result.pose.delete_col(3);
+    estimate->pose.t = ransac_result.pose.col(3);
+    estimate->inliers.swap(ransac_result.inliers);
+}
+
+void BatchRegistration::Commit(int view_id, const Estimate &estimate) {
+    /* Outliers leave their tracks and the view. */
+    std::vector<bool> inlier(estimate.track_ids.size(), false);
+    for (int i : estimate.inliers)
+        inlier[i] = true;
+    sfm::bundler::Viewport &viewport = m_viewports->at(view_id);
+    for (std::size_t i = 0; i < estimate.track_ids.size(); ++i) {
+        if (inlier[i])
+            continue;
+        m_tracks->at(estimate.track_ids[i]).remove_view(view_id);
+        viewport.track_ids[estimate.feature_ids[i]] = -1;
+    }
+    viewport.pose = estimate.pose;
+}
+
+void BatchRegistration::BundleAdjustCameras(const std::vector<int> &view_ids) {
+    sfm::ba::BundleAdjustment::Options ba_opts;
+    ba_opts.fixed_intrinsics = m_opts.ba_fixed_intrinsics;
+    ba_opts.verbose_output = m_opts.verbose_ba;
+    ba_opts.bundle_mode = sfm::ba::BundleAdjustment::BA_CAMERAS;
+    ba_opts.lm_max_iterations = 25;
+    ba_opts.cg_max_iterations = 1000;
+    sfm::ba::BundleAdjustment ba(ba_opts);
+
+    /* The cameras of 'view_ids' and the tracks they observe. */
+    std::vector<sfm::ba::Camera> ba_cameras;
+    std::vector<sfm::ba::Point3D> ba_points;
+    std::vector<sfm::ba::Observation> ba_observations;
+    std::vector<int> point_ids(m_tracks->size(), -1);
+    for (int view_id : view_ids) {
+        sfm::bundler::Viewport const &viewport = m_viewports->at(view_id);
+        sfm::CameraPose const &pose = viewport.pose;
+        sfm::ba::Camera cam;
+        cam.focal_length = pose.get_focal_length();
+        std::copy(pose.t.begin(), pose.t.end(), cam.translation);
+        std::copy(pose.R.begin(), pose.R.end(), cam.rotation);
+        std::copy(viewport.radial_distortion, viewport.radial_distortion + 2, cam.distortion);
+        int const camera_id = static_cast<int>(ba_cameras.size());
+        ba_cameras.push_back(cam);
+
+        for (std::size_t i = 0; i < viewport.track_ids.size(); ++i) {
+            int const track_id = viewport.track_ids[i];
+            if (track_id < 0 || !m_tracks->at(track_id).is_valid())
+                continue;
+            if (point_ids[track_id] < 0) {
+                sfm::ba::Point3D point;
+                std::copy(m_tracks->at(track_id).pos.begin(), m_tracks->at(track_id).pos.end(), point.pos);
+                point_ids[track_id] = static_cast<int>(ba_points.size());
+                ba_points.push_back(point);
+            }
+            sfm::ba::Observation observation;
+            std::copy(viewport.features.positions[i].begin(), viewport.features.positions[i].end(),
+                      observation.pos);
+            observation.camera_id = camera_id;
+            observation.point_id = point_ids[track_id];
+            ba_observations.push_back(observation);
+        }
+    }
+    ba.set_cameras(&ba_cameras);
+    ba.set_points(&ba_points);
+    ba.set_observations(&ba_observations);
+    ba.optimize();
+    ba.print_status();
+
+    for (std::size_t c = 0; c < view_ids.size(); ++c) {
+        sfm::bundler::Viewport &viewport = m_viewports->at(view_ids[c]);
+        sfm::CameraPose &pose = viewport.pose;
+        sfm::ba::Camera const &cam = ba_cameras[c];
+        std::copy(cam.translation, cam.translation + 3, pose.t.begin());
+        std::copy(cam.rotation, cam.rotation + 9, pose.R.begin());
+        std::copy(cam.distortion, cam.distortion + 2, viewport.radial_distortion);
+        pose.set_k_matrix(cam.focal_length, pose.K[2], pose.K[5]);
+    }
+}
@@ -0,0 +1,110 @@
+#include "ChunkedPointSet.hpp"
+#include "PointCloud.hpp"
+#include "util/file_system.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+/** Bytes copied at once while merging */
+constexpr std::size_t MERGE_BUFFER_BYTES = 1 << 22;
+
+/** Offset of 'column' in a chunk of 'num_points' points. */
+static std::size_t ChunkColumnOffset(PointCloud::Column column, std::size_t num_points) {
+    std::size_t offset = 0;
+    for (int c = 0; c < column; ++c)
+        offset += num_points * PointCloud::ElementBytes(static_cast<PointCloud::Column>(c));
+    return offset;
+}
+
+ChunkedPointSet::ChunkedPointSet(const std::string &dir) : m_dir(dir) {
+    if (!util::fs::dir_exists(m_dir.c_str()) && !util::fs::mkdir(m_dir.c_str()))
+        throw std::runtime_error("Cannot create point set chunk directory " + m_dir);
+}
+
+ChunkedPointSet::~ChunkedPointSet() {
+    for (const auto &chunk : m_chunks)
+        util::fs::unlink(ChunkPath(chunk.first).c_str());
+    util::fs::rmdir(m_dir.c_str());
+}
+
+void ChunkedPointSet::WriteChunk(std::size_t index, const mve::TriangleMesh &points,
+                                 const std::vector<float> &values) {
+    mve::TriangleMesh::VertexList const &verts(points.get_vertices());
+    mve::TriangleMesh::NormalList const &normals(points.get_vertex_normals());
+    mve::TriangleMesh::ColorList const &colors(points.get_vertex_colors());
+    mve::TriangleMesh::ConfidenceList const &confs(points.get_vertex_confidences());
+    if (normals.size() != verts.size() || values.size() != verts.size())
+        throw std::invalid_argument("Point set chunk without normals or values");
+
+    std::vector<math::Vec3f> rgb(verts.size(), math::Vec3f(-1.0f));
+    if (colors.size() == verts.size())
+        for (std::size_t i = 0; i < verts.size(); ++i)
+            rgb[i] = math::Vec3f(*colors[i]);
+    std::vector<float> conf(verts.size(), 1.0f);
+    if (confs.size() == verts.size())
+        std::copy(confs.begin(), confs.end(), conf.begin());
+
+    const std::string path = ChunkPath(index);
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot write point set chunk " + path);
+    out.write(reinterpret_cast<const char *>(verts.data()), verts.size() * sizeof(math::Vec3f));
+    out.write(reinterpret_cast<const char *>(normals.data()), normals.size() * sizeof(math::Vec3f));
+    out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size() * sizeof(math::Vec3f));
+    out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(float));
+    out.write(reinterpret_cast<const char *>(conf.data()), conf.size() * sizeof(float));
+    if (!out)
+        throw std::runtime_error("Cannot write point set chunk " + path);
+    out.close();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_chunks[index] = verts.size();
+}
+
+std::size_t ChunkedPointSet::GetNumPoints() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t num = 0;
+    for (const auto &chunk : m_chunks)
+        num += chunk.second;
+    return num;
+}
+
+void ChunkedPointSet::Write(const std::string &path) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t num = 0;
+    for (const auto &chunk : m_chunks)
+        num += chunk.second;
+    PointCloud::FileHeader const header = PointCloud::RawHeader(num);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    std::size_t position = sizeof(header);
+    std::vector<char> buffer(MERGE_BUFFER_BYTES, 0);
+    for (int c = 0; c < PointCloud::NUM_COLUMNS; ++c) {
+        PointCloud::Column const column = static_cast<PointCloud::Column>(c);
+        std::fill(buffer.begin(), buffer.begin() + PointCloud::COLUMN_ALIGNMENT, 0);
+        out.write(buffer.data(), static_cast<std::streamsize>(header.columns[c].offset - position));
+        for (const auto &chunk : m_chunks) {
+            const std::string chunk_path = ChunkPath(chunk.first);
+            std::ifstream in(chunk_path, std::ios::binary);
+            in.seekg(static_cast<std::streamoff>(ChunkColumnOffset(column, chunk.second)));
+            std::size_t left = chunk.second * PointCloud::ElementBytes(column);
+            while (in && left > 0) {
+                in.read(buffer.data(), static_cast<std::streamsize>(std::min(left, buffer.size())));
+                out.write(buffer.data(), in.gcount());
+                left -= static_cast<std::size_t>(in.gcount());
+            }
+            if (left > 0)
+                throw std::runtime_error("Cannot read point set chunk " + chunk_path);
+        }
+        position = header.columns[c].offset + header.columns[c].bytes;
+    }
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+std::string ChunkedPointSet::ChunkPath(std::size_t index) const {
+    return util::fs::join_path(m_dir, "chunk-" + std::to_string(index) + ".bin");
+}
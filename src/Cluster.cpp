@@ -3,14 +3,15 @@
 using namespace gl;
 
 Cluster::Cluster(const glm::mat4 &model)
-    : RenderTarget(model), m_VAO(0), m_VBO(0) {
+    : RenderTarget(model), m_VAO(0), m_VBO(0), m_colorVBO(0), m_count(0) {
 
     glGenVertexArrays(1, &m_VAO);
     glBindVertexArray(m_VAO);
 
     glGenBuffers(1, &m_VBO);
+    glGenBuffers(1, &m_colorVBO);
     glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * m_vertices.size(), m_vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) nullptr);
@@ -24,13 +25,28 @@ void Cluster::DrawArray(const Shader &shader) {
     shader.use();
     shader.setMat4f("model", GetTransform());
     glBindVertexArray(m_VAO);
-    glDrawArrays(GL_POINTS, 0, m_vertices.size());
+    glDrawArrays(GL_POINTS, 0, m_count);
     glBindVertexArray(0);
 }
 
 void Cluster::SetCluster(const std::vector<Vertex> &vertices) {
-    m_vertices.resize(vertices.size());
-    std::copy(vertices.begin(), vertices.end(), m_vertices.data());
+    m_count = vertices.size();
+    glBindVertexArray(m_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * m_vertices.size(), m_vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) nullptr);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) offsetof(Vertex, Color));
+    glBindVertexArray(0);
+}
+
+void Cluster::SetCluster(const float *positions, const float *colors, std::size_t count) {
+    m_count = count;
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float) * count, positions, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, m_colorVBO);
+    glBufferData(GL_ARRAY_BUFFER, 3 * sizeof(float) * count, colors, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) nullptr);
+    glBindVertexArray(0);
 }
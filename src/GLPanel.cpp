@@ -88,6 +88,14 @@ Cluster::Ptr GLPanel::AddCluster(const std::vector<Vertex> &vertices, const glm:
     return cluster;
 }
 
+Cluster::Ptr GLPanel::AddCluster(const float *positions, const float *colors, std::size_t count,
+                                 const glm::mat4 &transform) {
+    Cluster::Ptr cluster = RenderTarget::Create<Cluster>(transform);
+    cluster->SetCluster(positions, colors, count);
+    m_targets.emplace_back(cluster);
+    return cluster;
+}
+
 void GLPanel::OpenGLDebugMessage(gl::GLenum, gl::GLenum, gl::GLuint, gl::GLenum severity,
                                  gl::GLsizei, const gl::GLchar *message, const void *) {
     switch (severity) {
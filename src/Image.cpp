@@ -5,7 +5,22 @@
 #include "util/file_system.h"
 #include "sfm/bundler_features.h"
 #include "sfm/bundler_matching.h"
+#include "sfm/exhaustive_matching.h"
 #include "util/timer.h"
+#include "sfm/ransac_fundamental.h"
+#include "feature/HarrisPyramid.hpp"
+#include "feature/BinaryMatcher.hpp"
+#include "feature/VocabTree.hpp"
+#include "feature/QuantizedMatcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
 
 template<class T>
 typename mve::Image<T>::Ptr
@@ -39,6 +54,16 @@ has_jpeg_extension(std::string const &filename) {
         || util::string::right(lcfname, 5) == ".jpeg";
 }
 
+bool
+has_image_extension(std::string const &filename) {
+    std::string lcfname(util::string::lowercase(filename));
+    std::string ext4 = util::string::right(lcfname, 4);
+    std::string ext5 = util::string::right(lcfname, 5);
+    return ext4 == ".jpg" || ext5 == ".jpeg" || ext4 == ".png"
+        || ext4 == ".ppm" || ext4 == ".tif" || ext5 == ".tiff"
+        || ext4 == ".pfm";
+}
+
 std::string
 remove_file_extension(std::string const &filename) {
     std::size_t pos = filename.find_last_of('.');
@@ -131,6 +156,92 @@ add_exif_to_view(mve::View::Ptr view, std::string const &exif) {
     view->set_blob(exif_image, "exif");
 }
 
+/** Unsigned value of 'bytes' bytes at 'offset' of a TIFF structure. */
+static bool
+exif_read(const unsigned char *data, std::size_t size, std::size_t offset,
+          int bytes, bool big_endian, std::uint32_t *value) {
+    if (offset + bytes > size)
+        return false;
+    *value = 0;
+    for (int i = 0; i < bytes; ++i)
+        *value = (*value << 8) | data[offset + (big_endian ? i : bytes - 1 - i)];
+    return true;
+}
+
+/** Degrees, minutes and seconds, or a single value if 'count' is 1. */
+static bool
+exif_read_rationals(const unsigned char *data, std::size_t size, std::size_t offset,
+                    int count, bool big_endian, double *value) {
+    double result = 0.0, unit = 1.0;
+    for (int i = 0; i < count; ++i, unit /= 60.0) {
+        std::uint32_t num, den;
+        if (!exif_read(data, size, offset + 8 * i, 4, big_endian, &num)
+            || !exif_read(data, size, offset + 8 * i + 4, 4, big_endian, &den) || den == 0)
+            return false;
+        result += unit * num / den;
+    }
+    *value = result;
+    return true;
+}
+
+bool
+get_exif_gps(mve::View::Ptr view, math::Vec3d *position) {
+    mve::ByteImage::Ptr blob = view->get_blob("exif");
+    if (blob == nullptr)
+        return false;
+    const unsigned char *data = blob->get_data_pointer();
+    std::size_t size = blob->get_byte_size();
+    /* The blob is the APP1 payload, the TIFF header follows "Exif\0\0". */
+    if (size >= 6 && std::equal(data, data + 4, "Exif")) {
+        data += 6;
+        size -= 6;
+    }
+    if (size < 8 || data[0] != data[1] || (data[0] != 'I' && data[0] != 'M'))
+        return false;
+    bool const big_endian = data[0] == 'M';
+
+    std::uint32_t ifd, num_entries, gps_ifd = 0;
+    if (!exif_read(data, size, 4, 4, big_endian, &ifd)
+        || !exif_read(data, size, ifd, 2, big_endian, &num_entries))
+        return false;
+    for (std::uint32_t e = 0; e < num_entries; ++e) {
+        std::uint32_t tag;
+        std::size_t const entry = ifd + 2 + 12 * e;
+        if (exif_read(data, size, entry, 2, big_endian, &tag) && tag == 0x8825)
+            exif_read(data, size, entry + 8, 4, big_endian, &gps_ifd);
+    }
+    if (gps_ifd == 0 || !exif_read(data, size, gps_ifd, 2, big_endian, &num_entries))
+        return false;
+
+    double latitude = std::numeric_limits<double>::quiet_NaN();
+    double longitude = std::numeric_limits<double>::quiet_NaN();
+    double altitude = 0.0;
+    char latitude_ref = 'N', longitude_ref = 'E';
+    bool below_sea_level = false;
+    for (std::uint32_t e = 0; e < num_entries; ++e) {
+        std::size_t const entry = gps_ifd + 2 + 12 * e;
+        std::uint32_t tag, offset;
+        if (!exif_read(data, size, entry, 2, big_endian, &tag) || entry + 12 > size)
+            return false;
+        exif_read(data, size, entry + 8, 4, big_endian, &offset);
+        switch (tag) {
+        case 0x0001: latitude_ref = static_cast<char>(data[entry + 8]); break;
+        case 0x0002: exif_read_rationals(data, size, offset, 3, big_endian, &latitude); break;
+        case 0x0003: longitude_ref = static_cast<char>(data[entry + 8]); break;
+        case 0x0004: exif_read_rationals(data, size, offset, 3, big_endian, &longitude); break;
+        case 0x0005: below_sea_level = data[entry + 8] == 1; break;
+        case 0x0006: exif_read_rationals(data, size, offset, 1, big_endian, &altitude); break;
+        default:break;
+        }
+    }
+    if (std::isnan(latitude) || std::isnan(longitude))
+        return false;
+    (*position)[0] = latitude_ref == 'S' ? -latitude : latitude;
+    (*position)[1] = longitude_ref == 'W' ? -longitude : longitude;
+    (*position)[2] = below_sea_level ? -altitude : altitude;
+    return true;
+}
+
 std::string make_image_name(int id) {
     return "view_" + util::string::get_filled(id, 4) + ".mve";
 }
@@ -144,25 +255,576 @@ void find_min_max_percentile(typename mve::Image<T>::ConstPtr image,
     *vmax = copy->at(9 * copy->get_value_amount() / 10);
 }
 
+mve::ByteImage::Ptr
+create_thumbnail(mve::ImageBase::ConstPtr img) {
+    switch (img->get_type()) {
+    case mve::IMAGE_TYPE_UINT8:
+        return mve::image::create_thumbnail<uint8_t>
+            (std::dynamic_pointer_cast<mve::ByteImage const>(img),
+             THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    case mve::IMAGE_TYPE_UINT16: {
+        mve::RawImage::Ptr temp = mve::image::create_thumbnail<uint16_t>
+            (std::dynamic_pointer_cast<mve::RawImage const>(img),
+             THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+        uint16_t vmin, vmax;
+        find_min_max_percentile<uint16_t>(temp, &vmin, &vmax);
+        return mve::image::raw_to_byte_image(temp, vmin, vmax);
+    }
+    case mve::IMAGE_TYPE_FLOAT: {
+        mve::FloatImage::Ptr temp = mve::image::create_thumbnail<float>
+            (std::dynamic_pointer_cast<mve::FloatImage const>(img),
+             THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+        float vmin, vmax;
+        find_min_max_percentile<float>(temp, &vmin, &vmax);
+        return mve::image::float_to_byte_image(temp, vmin, vmax);
+    }
+    default:break;
+    }
+    return mve::ByteImage::Ptr();
+}
+
+/** Features of one view, with positions normalized the same way
+ * sfm::bundler::Features::compute does. False without an original image. */
+static bool
+compute_view_features(mve::View::Ptr view, FeatureType feature_type,
+                      sfm::FeatureSet *features, Brief::Descriptors *descriptors) {
+    mve::ByteImage::Ptr image = view->get_byte_image(ORIGINAL_IMAGE_NAME);
+    if (image == nullptr)
+        return false;
+    image = limit_image_size<uint8_t>(image, MAX_IMAGE_SIZE);
+
+    if (feature_type == FEATURE_HARRIS) {
+        HarrisPyramid::Options harris_opts;
+        HarrisPyramid harris(harris_opts);
+        harris.SetImage(image);
+        harris.Process();
+
+        features->width = image->width();
+        features->height = image->height();
+        features->positions.clear();
+        features->colors.clear();
+        for (auto const &f : harris.GetFeatures()) {
+            features->positions.emplace_back(f.x, f.y);
+            int const x = static_cast<int>(f.x + 0.5f);
+            int const y = static_cast<int>(f.y + 0.5f);
+            math::Vec3uc color;
+            for (int c = 0; c < 3; ++c)
+                color[c] = image->at(x, y, std::min(c, image->channels() - 1));
+            features->colors.push_back(color);
+        }
+        *descriptors = harris.GetDescriptors();
+    } else {
+        sfm::FeatureSet::Options feature_options;
+        feature_options.feature_types = static_cast<sfm::FeatureSet::FeatureTypes>(feature_type);
+        features->set_options(feature_options);
+        features->compute_features(image);
+    }
+
+    float const fnorm = static_cast<float>(std::max(features->width, features->height));
+    for (auto &pos : features->positions) {
+        pos[0] = (pos[0] + 0.5f - features->width / 2.0f) / fnorm;
+        pos[1] = (pos[1] + 0.5f - features->height / 2.0f) / fnorm;
+    }
+    return true;
+}
+
+template<typename T>
+static void
+blob_write(std::vector<unsigned char> *blob, T const *values, std::size_t count) {
+    unsigned char const *bytes = reinterpret_cast<unsigned char const *>(values);
+    blob->insert(blob->end(), bytes, bytes + count * sizeof(T));
+}
+
+template<typename T>
+static bool
+blob_read(unsigned char const **data, unsigned char const *end, T *values, std::size_t count) {
+    if (static_cast<std::size_t>(end - *data) < count * sizeof(T))
+        return false;
+    std::memcpy(values, *data, count * sizeof(T));
+    *data += count * sizeof(T);
+    return true;
+}
+
+/** Position, scale, orientation and data of SIFT or SURF descriptors. */
+template<typename T>
+static void
+write_descriptors(std::vector<unsigned char> *blob, std::vector<T> const &descriptors) {
+    for (auto const &d : descriptors) {
+        float const keypoint[4] = {d.x, d.y, d.scale, d.orientation};
+        blob_write(blob, keypoint, 4);
+        blob_write(blob, d.data.begin(), d.data.end() - d.data.begin());
+    }
+}
+
+template<typename T>
+static bool
+read_descriptors(unsigned char const **data, unsigned char const *end, std::vector<T> *descriptors) {
+    for (auto &d : *descriptors) {
+        float keypoint[4];
+        if (!blob_read(data, end, keypoint, 4)
+            || !blob_read(data, end, d.data.begin(), d.data.end() - d.data.begin()))
+            return false;
+        d.x = keypoint[0];
+        d.y = keypoint[1];
+        d.scale = keypoint[2];
+        d.orientation = keypoint[3];
+    }
+    return true;
+}
+
+/** Keeps the features of a view in its FEATURES_BLOB_NAME blob. */
+static void
+store_view_features(mve::View::Ptr view, FeatureType feature_type,
+                    sfm::FeatureSet const &features, Brief::Descriptors const &descriptors) {
+    std::int32_t const header[] = {FEATURES_BLOB_VERSION, static_cast<std::int32_t>(feature_type), features.width, features.height,
+                                   static_cast<std::int32_t>(features.positions.size()),
+                                   static_cast<std::int32_t>(features.sift_descriptors.size()),
+                                   static_cast<std::int32_t>(features.surf_descriptors.size()),
+                                   static_cast<std::int32_t>(descriptors.size())};
+    std::vector<unsigned char> blob;
+    blob_write(&blob, header, sizeof(header) / sizeof(header[0]));
+    for (auto const &pos : features.positions)
+        blob_write(&blob, pos.begin(), 2);
+    for (auto const &color : features.colors)
+        blob_write(&blob, color.begin(), 3);
+    write_descriptors(&blob, features.sift_descriptors);
+    write_descriptors(&blob, features.surf_descriptors);
+    for (auto const &descriptor : descriptors)
+        blob_write(&blob, descriptor.data(), descriptor.size());
+
+    mve::ByteImage::Ptr blob_image = mve::ByteImage::create(blob.size(), 1, 1);
+    std::copy(blob.begin(), blob.end(), blob_image->begin());
+    view->set_blob(blob_image, FEATURES_BLOB_NAME);
+    view->save_view();
+}
+
+/** Features stored by store_view_features, false if there are none for
+ * 'feature_type' or the blob is from another version. */
+static bool
+load_view_features(mve::View::Ptr view, FeatureType feature_type,
+                   sfm::FeatureSet *features, Brief::Descriptors *descriptors) {
+    if (!view->has_blob(FEATURES_BLOB_NAME))
+        return false;
+    mve::ByteImage::Ptr blob = view->get_blob(FEATURES_BLOB_NAME);
+    if (blob == nullptr)
+        return false;
+    unsigned char const *data = blob->get_data_pointer();
+    unsigned char const *end = data + blob->get_byte_size();
+    std::int32_t header[8];
+    if (!blob_read(&data, end, header, 8) || header[0] != FEATURES_BLOB_VERSION || header[1] != feature_type
+        || std::any_of(header + 4, header + 8, [](std::int32_t n) { return n < 0; }))
+        return false;
+
+    features->width = header[2];
+    features->height = header[3];
+    features->positions.resize(header[4]);
+    features->colors.resize(header[4]);
+    features->sift_descriptors.resize(header[5]);
+    features->surf_descriptors.resize(header[6]);
+    descriptors->resize(header[7]);
+    for (auto &pos : features->positions)
+        if (!blob_read(&data, end, pos.begin(), 2))
+            return false;
+    for (auto &color : features->colors)
+        if (!blob_read(&data, end, color.begin(), 3))
+            return false;
+    if (!read_descriptors(&data, end, &features->sift_descriptors)
+        || !read_descriptors(&data, end, &features->surf_descriptors))
+        return false;
+    for (auto &descriptor : *descriptors)
+        if (!blob_read(&data, end, descriptor.data(), descriptor.size()))
+            return false;
+    return data == end;
+}
+
+/** Features of all views. Unchanged views of 'previous' load the features
+ * stored by the run that matched them, the others are computed and stored.
+ * Harris descriptors live outside of the viewports, sfm::FeatureSet only
+ * knows about SIFT and SURF. */
+static void
+compute_features(mve::Scene::Ptr scene, FeatureType feature_type, const PreviousMatching *previous,
+                 sfm::bundler::ViewportList *viewports, std::vector<Brief::Descriptors> *descriptors,
+                 MatchingStats *stats) {
+    mve::Scene::ViewList const &views = scene->get_views();
+    viewports->clear();
+    viewports->resize(views.size());
+    std::vector<Brief::Descriptors> view_descriptors(views.size());
+
+    std::size_t num_done = 0;
+    std::size_t total_features = 0;
+    std::size_t reused_views = 0;
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < views.size(); ++i) {
+        mve::View::Ptr view = views[i];
+        if (view == nullptr)
+            continue;
+
+        sfm::FeatureSet &features = viewports->at(i).features;
+        bool const unchanged = previous != nullptr && i < previous->unchanged.size() && previous->unchanged[i];
+        bool const reused = unchanged && load_view_features(view, feature_type, &features, &view_descriptors[i]);
+        if (!reused) {
+            features = sfm::FeatureSet();
+            view_descriptors[i].clear();
+            if (!compute_view_features(view, feature_type, &features, &view_descriptors[i]))
+                continue;
+            store_view_features(view, feature_type, features, view_descriptors[i]);
+        }
+
+#pragma omp critical
+        {
+            num_done += 1;
+            reused_views += reused;
+            total_features += features.positions.size();
+            std::cout << "\rDetecting features, view " << num_done << " of "
+                      << views.size() << "..." << std::flush;
+        }
+        view->cache_cleanup();
+    }
+    std::cout << std::endl << "Detected " << total_features << " features, reused the features of "
+              << reused_views << " unchanged views." << std::endl;
+    stats->reused_views = reused_views;
+    if (feature_type == FEATURE_HARRIS)
+        descriptors->swap(view_descriptors);
+    else
+        descriptors->clear();
+}
+
+/** Rows of floats of SIFT or SURF descriptors. */
+template<typename T>
+static std::vector<float>
+descriptor_rows(std::vector<T> const &descriptors) {
+    std::vector<float> rows;
+    for (auto const &descriptor : descriptors)
+        rows.insert(rows.end(), descriptor.data.begin(), descriptor.data.end());
+    return rows;
+}
+
+/** Rows of floats for the vocabulary tree, SIFT unless only SURF was
+ * computed, BRIEF bits become 0 or 1. */
+static int
+retrieval_dimension(FeatureType feature_type) {
+    if (feature_type == FEATURE_HARRIS)
+        return 256;
+    return feature_type == FEATURE_SURF ? 64 : 128;
+}
+
+/** Number of descriptors of a view for the vocabulary tree. */
+static std::size_t
+retrieval_count(sfm::FeatureSet const &features, Brief::Descriptors const *harris,
+                FeatureType feature_type) {
+    if (feature_type == FEATURE_HARRIS)
+        return harris->size();
+    if (feature_type == FEATURE_SURF)
+        return features.surf_descriptors.size();
+    return features.sift_descriptors.size();
+}
+
+/** Descriptor 'index' of a view as retrieval_dimension floats at 'row'. */
+static void
+retrieval_row(sfm::FeatureSet const &features, Brief::Descriptors const *harris,
+              FeatureType feature_type, std::size_t index, float *row) {
+    if (feature_type == FEATURE_HARRIS) {
+        Brief::Descriptor const &descriptor = (*harris)[index];
+        for (int bit = 0; bit < 256; ++bit)
+            row[bit] = static_cast<float>((descriptor[bit / 64] >> (bit % 64)) & 1);
+    } else if (feature_type == FEATURE_SURF) {
+        auto const &data = features.surf_descriptors[index].data;
+        std::copy(data.begin(), data.end(), row);
+    } else {
+        auto const &data = features.sift_descriptors[index].data;
+        std::copy(data.begin(), data.end(), row);
+    }
+}
+
+/** Vocabulary tree trained on the descriptors of all views and indexed
+ * with them, null if the views have no descriptors. Only the sampled
+ * training rows of all views are converted to floats at once, the views
+ * are quantized one at a time per thread. */
+static std::unique_ptr<VocabTree>
+retrieval_tree(sfm::bundler::ViewportList const &viewports,
+               std::vector<Brief::Descriptors> const &harris_descriptors,
+               FeatureType feature_type) {
+    std::size_t const num_views = viewports.size();
+    int const dim = retrieval_dimension(feature_type);
+    auto harris = [&harris_descriptors](std::size_t i) {
+        return harris_descriptors.empty() ? nullptr : &harris_descriptors[i];
+    };
+
+    /* Every stride-th descriptor of all views trains the tree. */
+    std::unique_ptr<VocabTree> tree(new VocabTree(VocabTree::Options(), dim));
+    std::size_t num_descriptors = 0;
+    for (std::size_t i = 0; i < num_views; ++i)
+        num_descriptors += retrieval_count(viewports[i].features, harris(i), feature_type);
+    if (num_descriptors == 0)
+        return nullptr;
+    std::size_t const max_training = VocabTree::Options().max_training;
+    std::size_t const stride = (num_descriptors + max_training - 1) / max_training;
+    VocabTree::Descriptors training;
+    training.reserve((num_descriptors + stride - 1) / stride * dim);
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < num_views; ++i) {
+        std::size_t const count = retrieval_count(viewports[i].features, harris(i), feature_type);
+        for (std::size_t r = 0; r < count; ++r, ++next) {
+            if (next % stride != 0)
+                continue;
+            training.resize(training.size() + dim);
+            retrieval_row(viewports[i].features, harris(i), feature_type, r, &training[training.size() - dim]);
+        }
+    }
+    tree->Train(training);
+    training = VocabTree::Descriptors();
+
+    std::vector<VocabTree::BagOfWords> bags(num_views);
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < num_views; ++i) {
+        std::size_t const count = retrieval_count(viewports[i].features, harris(i), feature_type);
+        VocabTree::Descriptors rows(count * dim);
+        for (std::size_t r = 0; r < count; ++r)
+            retrieval_row(viewports[i].features, harris(i), feature_type, r, &rows[r * dim]);
+        bags[i] = tree->Quantize(rows);
+    }
+    tree->Index(std::move(bags));
+    return tree;
+}
+
+/** Pairs of every geotagged view with its 'neighbors' nearest views, the
+ * positions in meters on a plane tangent at the first of them. */
+static void
+add_gps_pairs(mve::Scene::Ptr scene, std::size_t num_views, int neighbors,
+              std::set<std::pair<int, int>> *pairs) {
+    std::size_t const num_pairs = pairs->size();
+    std::vector<std::pair<int, math::Vec3d>> positions;
+    mve::Scene::ViewList const &views = scene->get_views();
+    for (std::size_t i = 0; i < views.size() && i < num_views; ++i) {
+        math::Vec3d gps;
+        if (views[i] != nullptr && get_exif_gps(views[i], &gps))
+            positions.emplace_back(static_cast<int>(i), gps);
+    }
+    double const earth_radius = 6378137.0;
+    double const to_rad = std::acos(-1.0) / 180.0;
+    math::Vec3d const origin = positions.empty() ? math::Vec3d(0.0) : positions[0].second;
+    for (auto &position : positions) {
+        math::Vec3d const gps = position.second;
+        position.second[0] = (gps[0] - origin[0]) * to_rad * earth_radius;
+        position.second[1] = (gps[1] - origin[1]) * to_rad * earth_radius * std::cos(origin[0] * to_rad);
+    }
+    for (auto const &position : positions) {
+        std::vector<std::pair<double, int>> nearest;
+        for (auto const &other : positions)
+            if (other.first != position.first)
+                nearest.emplace_back((other.second - position.second).square_norm(), other.first);
+        std::size_t const k = std::min<std::size_t>(neighbors, nearest.size());
+        std::partial_sort(nearest.begin(), nearest.begin() + k, nearest.end());
+        for (std::size_t n = 0; n < k; ++n)
+            pairs->emplace(std::min(position.first, nearest[n].second),
+                           std::max(position.first, nearest[n].second));
+    }
+    std::cout << "GPS prior added " << pairs->size() - num_pairs << " pairs of "
+              << positions.size() << " geotagged views." << std::endl;
+}
+
+/** Pairs of every view with its most similar views by a vocabulary tree
+ * trained on the scene's own descriptors, or with the following views in
+ * a sliding window by ID and, every few views, with the retrieved views
+ * outside of it to close loops. Optionally also with the views closest by
+ * GPS position. */
+static std::vector<std::pair<int, int>>
+select_pairs(mve::Scene::Ptr scene,
+             sfm::bundler::ViewportList const &viewports,
+             std::vector<Brief::Descriptors> const &harris_descriptors,
+             FeatureType feature_type,
+             MatchingOptions const &options) {
+    int const num_views = static_cast<int>(viewports.size());
+    bool const sequential = options.pair_selection == PAIRS_SEQUENTIAL;
+    int const window = std::max(1, options.sequential_window);
+    std::set<std::pair<int, int>> pairs;
+    if (sequential) {
+        for (int i = 0; i < num_views; ++i)
+            for (int j = i + 1; j < num_views && j <= i + window; ++j)
+                pairs.emplace(i, j);
+    }
+
+    if (!sequential || options.loop_closure_interval > 0) {
+        std::size_t const num_pairs = pairs.size();
+        std::unique_ptr<VocabTree> tree = retrieval_tree(viewports, harris_descriptors, feature_type);
+        int const interval = sequential ? options.loop_closure_interval : 1;
+        for (int i = 0; tree != nullptr && i < num_views; i += interval) {
+            for (auto const &neighbor : tree->Query(i, std::max(0, options.retrieval_neighbors))) {
+                int const j = static_cast<int>(neighbor.first);
+                if (!sequential || std::abs(i - j) > window)
+                    pairs.emplace(std::min(i, j), std::max(i, j));
+            }
+        }
+        if (tree != nullptr) {
+            std::cout << (sequential ? "Loop closure added " : "Retrieved ") << pairs.size() - num_pairs
+                      << " pairs with a vocabulary tree of " << tree->GetNumWords() << " words." << std::endl;
+        }
+    }
+
+    if (options.gps_neighbors > 0)
+        add_gps_pairs(scene, viewports.size(), options.gps_neighbors, &pairs);
+    std::cout << "Selected " << pairs.size() << " of "
+              << static_cast<std::size_t>(num_views) * (num_views - 1) / 2 << " pairs." << std::endl;
+    return std::vector<std::pair<int, int>>(pairs.begin(), pairs.end());
+}
+
+/** Two view matching of 'pairs' filtered with the fundamental RANSAC and
+ * the inlier limits of sfm::bundler::Matching. Harris features are matched
+ * by their BRIEF descriptors, SIFT and SURF by sfm::ExhaustiveMatching or,
+ * if 'quantized', by QuantizedMatcher. */
+static void
+match_pairs(sfm::bundler::ViewportList *viewports,
+            std::vector<Brief::Descriptors> const &harris_descriptors,
+            std::vector<std::pair<int, int>> const &pairs,
+            sfm::bundler::Matching::Options const &matching_opts,
+            bool quantized,
+            sfm::bundler::PairwiseMatching *pairwise_matching) {
+    bool const harris = !harris_descriptors.empty();
+    BinaryMatcher binary_matcher((BinaryMatcher::Options()));
+    QuantizedMatcher quantized_matcher((QuantizedMatcher::Options()));
+    sfm::ExhaustiveMatching float_matcher;
+    std::vector<QuantizedMatcher::Descriptors> sift_rows, surf_rows;
+    if (!harris && quantized) {
+        sift_rows.resize(viewports->size());
+        surf_rows.resize(viewports->size());
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < viewports->size(); ++i) {
+            sfm::FeatureSet const &features = viewports->at(i).features;
+            sift_rows[i] = QuantizedMatcher::Quantize(descriptor_rows(features.sift_descriptors), 128);
+            surf_rows[i] = QuantizedMatcher::Quantize(descriptor_rows(features.surf_descriptors), 64);
+        }
+    } else if (!harris) {
+        float_matcher.init(viewports);
+    }
+
+    std::vector<sfm::bundler::TwoViewMatching> results(pairs.size());
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t p = 0; p < pairs.size(); ++p) {
+        int const view_1_id = pairs[p].first;
+        int const view_2_id = pairs[p].second;
+        results[p].view_1_id = view_1_id;
+        results[p].view_2_id = view_2_id;
+
+        std::vector<int> matches_1_2;
+        if (harris) {
+            binary_matcher.Match(harris_descriptors[view_1_id], harris_descriptors[view_2_id], &matches_1_2);
+        } else if (quantized) {
+            /* Feature positions list the SIFT features before the SURF ones. */
+            std::vector<int> surf_matches;
+            quantized_matcher.Match(sift_rows[view_1_id], sift_rows[view_2_id], &matches_1_2);
+            quantized_matcher.Match(surf_rows[view_1_id], surf_rows[view_2_id], &surf_matches);
+            int const surf_offset = static_cast<int>(sift_rows[view_2_id].size());
+            for (int match : surf_matches)
+                matches_1_2.push_back(match < 0 ? -1 : match + surf_offset);
+        } else {
+            sfm::Matching::Result result;
+            float_matcher.pairwise_match(view_1_id, view_2_id, &result);
+            sfm::Matching::remove_inconsistent_matches(&result);
+            matches_1_2.swap(result.matches_1_2);
+        }
+
+        sfm::FeatureSet const &features_1 = viewports->at(view_1_id).features;
+        sfm::FeatureSet const &features_2 = viewports->at(view_2_id).features;
+        sfm::Correspondences2D2D unfiltered_matches;
+        sfm::CorrespondenceIndices unfiltered_indices;
+        for (std::size_t i = 0; i < matches_1_2.size(); ++i) {
+            if (matches_1_2[i] < 0)
+                continue;
+            sfm::Correspondence2D2D match;
+            std::copy(features_1.positions[i].begin(), features_1.positions[i].end(), match.p1);
+            std::copy(features_2.positions[matches_1_2[i]].begin(),
+                      features_2.positions[matches_1_2[i]].end(), match.p2);
+            unfiltered_matches.push_back(match);
+            unfiltered_indices.emplace_back(i, matches_1_2[i]);
+        }
+        if (static_cast<int>(unfiltered_matches.size()) < matching_opts.min_feature_matches)
+            continue;
+
+        sfm::RansacFundamental::Result ransac_result;
+        sfm::RansacFundamental ransac(matching_opts.ransac_opts);
+        ransac.estimate(unfiltered_matches, &ransac_result);
+        if (static_cast<int>(ransac_result.inliers.size()) < matching_opts.min_matching_inliers)
+            continue;
+
+        for (int inlier : ransac_result.inliers)
+            results[p].matches.push_back(unfiltered_indices[inlier]);
+    }
+
+    pairwise_matching->clear();
+    for (auto &result : results) {
+        if (!result.matches.empty())
+            pairwise_matching->push_back(result);
+    }
+}
+
 bool features_and_matching(mve::Scene::Ptr scene,
                            sfm::bundler::ViewportList *viewports,
                            sfm::bundler::PairwiseMatching *pairwise_matching,
-                           sfm::FeatureSet::FeatureTypes feature_type) {
-    sfm::bundler::Features::Options feature_opts;
-    feature_opts.image_embedding = ORIGINAL_IMAGE_NAME;
-    feature_opts.max_image_size = MAX_IMAGE_SIZE;
-    feature_opts.feature_options.feature_types = feature_type;
+                           FeatureType feature_type,
+                           const MatchingOptions &options,
+                           MatchingStats *stats,
+                           const PreviousMatching *previous) {
+    std::vector<Brief::Descriptors> harris_descriptors;
+    MatchingStats local_stats;
+    if (stats == nullptr)
+        stats = &local_stats;
 
     std::cout << "Computing image feature..." << std::endl;
     {
         util::WallTimer timer;
-        sfm::bundler::Features bundler_features(feature_opts);
-        bundler_features.compute(scene, viewports);
-
-        std::cout << "Computing features took " << timer.get_elapsed()
+        compute_features(scene, feature_type, previous, viewports, &harris_descriptors, stats);
+        stats->feature_ms = timer.get_elapsed();
+        std::cout << "Computing features took " << stats->feature_ms
                   << " ms." << std::endl;
     }
-    /* Exhaustive matching between all pairs of views. */
+
+    /* Exhaustive matching between all pairs of views, or between the pairs
+     * picked by retrieval or the sequential window. */
+    std::vector<std::pair<int, int>> pairs;
+    {
+        util::WallTimer timer;
+        if (options.pair_selection != PAIRS_EXHAUSTIVE) {
+            pairs = select_pairs(scene, *viewports, harris_descriptors, feature_type, options);
+        } else {
+            for (std::size_t i = 0; i < viewports->size(); ++i)
+                for (std::size_t j = i + 1; j < viewports->size(); ++j)
+                    pairs.emplace_back(i, j);
+        }
+        stats->selection_ms = timer.get_elapsed();
+        stats->candidate_pairs = pairs.size();
+    }
+
+    /* Pairs of unchanged views keep their previous matches, only the
+     * remaining pairs are matched. */
+    sfm::bundler::PairwiseMatching reused_matching;
+    if (previous != nullptr) {
+        std::map<std::pair<int, int>, std::size_t> previous_pairs;
+        for (std::size_t m = 0; m < previous->matching.size(); ++m) {
+            int const view_1_id = previous->matching[m].view_1_id;
+            int const view_2_id = previous->matching[m].view_2_id;
+            previous_pairs.emplace(std::make_pair(std::min(view_1_id, view_2_id),
+                                                  std::max(view_1_id, view_2_id)), m);
+        }
+        auto unchanged = [previous](int view_id) {
+            return view_id < static_cast<int>(previous->unchanged.size()) && previous->unchanged[view_id];
+        };
+        std::vector<std::pair<int, int>> remaining;
+        for (auto const &pair : pairs) {
+            auto const found = previous_pairs.find(pair);
+            if (!unchanged(pair.first) || !unchanged(pair.second)
+                || (found == previous_pairs.end() && !previous->all_pairs)) {
+                remaining.push_back(pair);
+                continue;
+            }
+            if (found != previous_pairs.end())
+                reused_matching.push_back(previous->matching[found->second]);
+            ++stats->reused_pairs;
+        }
+        pairs.swap(remaining);
+        std::cout << "Reusing the matching of " << stats->reused_pairs << " pairs of unchanged views, "
+                  << pairs.size() << " pairs left." << std::endl;
+    }
+
     sfm::bundler::Matching::Options matching_opts;
     //matching_opts.ransac_opts.max_iterations = 1000;
     //matching_opts.ransac_opts.threshold = 0.0015;
@@ -173,12 +835,28 @@ bool features_and_matching(mve::Scene::Ptr scene,
     std::cout << "Performing feature matching..." << std::endl;
     {
         util::WallTimer timer;
-        sfm::bundler::Matching bundler_matching(matching_opts);
-        bundler_matching.init(viewports);
-        bundler_matching.compute(pairwise_matching);
-        std::cout << "Matching took " << timer.get_elapsed()
+        if (feature_type != FEATURE_HARRIS && options.pair_selection == PAIRS_EXHAUSTIVE
+            && !options.quantized_matching && stats->reused_pairs == 0) {
+            sfm::bundler::Matching bundler_matching(matching_opts);
+            bundler_matching.init(viewports);
+            bundler_matching.compute(pairwise_matching);
+        } else {
+            match_pairs(viewports, harris_descriptors, pairs, matching_opts,
+                        options.quantized_matching, pairwise_matching);
+        }
+        stats->matching_ms = timer.get_elapsed();
+        std::cout << "Matching took " << stats->matching_ms
                   << " ms." << std::endl;
     }
+    pairwise_matching->insert(pairwise_matching->end(), reused_matching.begin(), reused_matching.end());
+
+    std::size_t num_matches = 0;
+    for (auto const &matching : *pairwise_matching)
+        num_matches += matching.matches.size();
+    stats->matched_pairs = pairwise_matching->size();
+    stats->num_matches = num_matches;
+    std::cout << "Found " << num_matches << " matches in "
+              << pairwise_matching->size() << " of " << stats->candidate_pairs << " image pairs." << std::endl;
 
     if (pairwise_matching->empty()) {
         std::cerr << "Error: No matching image pairs." << std::endl;
@@ -0,0 +1,103 @@
+#include "JobRunner.hpp"
+#include <algorithm>
+
+JobContext::JobContext(const std::atomic<bool> &cancelled, std::function<void(float)> progress)
+    : m_cancelled(cancelled), m_progress(std::move(progress)) {
+
+}
+
+void JobContext::CheckCancelled() const {
+    if (m_cancelled)
+        throw JobCancelled();
+}
+
+void JobContext::SetProgress(float progress) const {
+    if (m_progress)
+        m_progress(std::min(1.f, std::max(0.f, progress)));
+}
+
+JobRunner::JobRunner(const Callbacks &callbacks)
+    : m_callbacks(callbacks), m_busy(false), m_stop(false), m_nextId(0),
+      m_cancelCurrent(false) {
+    m_thread = std::thread(&JobRunner::Run, this);
+}
+
+JobRunner::~JobRunner() {
+    CancelAll();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+int JobRunner::Submit(const std::string &name, JobFunc func) {
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextId++;
+        m_queue.push_back(Job{id, name, std::move(func)});
+    }
+    m_cond.notify_one();
+    return id;
+}
+
+void JobRunner::CancelAll() {
+    std::deque<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dropped.swap(m_queue);
+        if (m_busy)
+            m_cancelCurrent = true;
+    }
+    if (m_callbacks.on_finished) {
+        for (const auto &job : dropped)
+            m_callbacks.on_finished(job.id, job.name, "Job cancelled", true);
+    }
+}
+
+bool JobRunner::IsIdle() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_busy && m_queue.empty();
+}
+
+void JobRunner::Run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy = true;
+            m_cancelCurrent = false;
+        }
+
+        JobContext context(m_cancelCurrent, [this, &job](float progress) {
+          if (m_callbacks.on_progress)
+              m_callbacks.on_progress(job.id, job.name, progress);
+        });
+        std::string error;
+        bool cancelled = false;
+        try {
+            job.func(context);
+        } catch (const JobCancelled &e) {
+            error = e.what();
+            cancelled = true;
+        } catch (const std::exception &e) {
+            error = e.what();
+        } catch (...) {
+            error = "Unknown error";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+        }
+        if (m_callbacks.on_finished)
+            m_callbacks.on_finished(job.id, job.name, error, cancelled);
+    }
+}
@@ -0,0 +1,699 @@
+#include "Image.hpp"
+#include "thermal/MutualInformation.hpp"
+#include "feature/BinaryMatcher.hpp"
+#include "feature/Harris.hpp"
+#include "feature/HarrisPyramid.hpp"
+#include "filter/BoxFilter.hpp"
+#include "filter/Convolution.hpp"
+#include "feature/QuantizedMatcher.hpp"
+#include "PointCloud.hpp"
+#include "SurfacePartition.hpp"
+#include "fssr/iso_octree.h"
+#include "fssr/iso_surface.h"
+#include "sfm/feature_set.h"
+#include "sfm/matching.h"
+#include "sfm/bundler_features.h"
+#include "sfm/exhaustive_matching.h"
+#include "mve/scene.h"
+#include "mve/image_io.h"
+#include "mve/image_tools.h"
+#include "util/arguments.h"
+#include "util/file_system.h"
+#include "util/system.h"
+#include "util/timer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct BenchSettings {
+    std::string mode;
+    std::string path;
+    int repeat = 10;
+    FeatureType feature_type = FEATURE_ALL;
+    std::size_t block_samples = 1 << 18;
+};
+
+static BenchSettings parse_args(int argc, char **argv) {
+    util::Arguments args;
+    args.set_exit_on_error(true);
+    args.set_nonopt_maxnum(2);
+    args.set_nonopt_minnum(2);
+    args.set_helptext_indent(22);
+    args.set_usage("Usage: " + std::string(argv[0]) + " [ OPTS ] MODE PATH");
+    args.set_description("Micro-benchmarks of the reconstruction kernels. Modes:\n"
+                         "  mi     mutual information of the thermal and visual "
+                         "images of PATH/thermal-img and PATH/normal-img (res/)\n"
+                         "  box    running sum box filter against the float integral image "
+                         "mean filter on the images of the directory PATH (res/normal-img)\n"
+                         "  harris  staged against tiled Harris responses on the image "
+                         "PATH scaled to 12MP\n"
+                         "  features  Harris against SIFT+SURF detection and matching "
+                         "of consecutive images of the directory PATH (res/thermal-img)\n"
+                         "  match  exhaustive against retrieval and sequential pair selection on "
+                         "the views of the scene directory PATH, one run each\n"
+                         "  matcher  MVE against the quantized SIFT/SURF matcher on "
+                         "all pairs of views of the scene directory PATH\n"
+                         "  surface  FSSR of the point set file PATH at once against "
+                         "the partitioned FSSR, with the differences of the meshes");
+    args.add_option('r', "repeat", true, "Runs per measurement [10]");
+    args.add_option('\0', "harris", false, "Match Harris features instead of SIFT/SURF");
+    args.add_option('\0', "block-samples", true, "Samples per block of the partitioned FSSR [262144]");
+    args.parse(argc, argv);
+
+    BenchSettings conf;
+    conf.mode = args.get_nth_nonopt(0);
+    conf.path = args.get_nth_nonopt(1);
+    for (util::ArgResult const *arg = args.next_option();
+         arg != nullptr; arg = args.next_option()) {
+        if (arg->opt->lopt == "repeat")
+            conf.repeat = std::max(1, arg->get_arg<int>());
+        else if (arg->opt->lopt == "harris")
+            conf.feature_type = FEATURE_HARRIS;
+        else if (arg->opt->lopt == "block-samples")
+            conf.block_samples = static_cast<std::size_t>(std::max(1, arg->get_arg<int>()));
+    }
+    return conf;
+}
+
+/** Mean wall time of 'func' over 'repeat' runs in milliseconds. */
+static double measure(int repeat, const std::function<void()> &func) {
+    func();
+    util::WallTimer timer;
+    for (int r = 0; r < repeat; ++r)
+        func();
+    return static_cast<double>(timer.get_elapsed()) / repeat;
+}
+
+static mve::ByteImage::Ptr load_gray(const std::string &path) {
+    mve::ByteImage::Ptr image = mve::image::load_file(path);
+    if (image->channels() == 3)
+        image = mve::image::desaturate<uint8_t>(image, mve::image::DESATURATE_LUMINANCE);
+    return image;
+}
+
+static int benchmark_mi(const BenchSettings &conf) {
+    std::string const thermal_dir = util::fs::join_path(conf.path, "thermal-img");
+    std::string const visual_dir = util::fs::join_path(conf.path, "normal-img");
+
+    /* Pairs share the file name, the visual image is resized to the thermal one. */
+    std::vector<std::pair<mve::ByteImage::Ptr, mve::ByteImage::Ptr>> pairs;
+    util::fs::Directory dir(thermal_dir);
+    std::sort(dir.begin(), dir.end());
+    for (auto const &file : dir) {
+        std::string const visual_path = util::fs::join_path(visual_dir, file.name);
+        if (file.is_dir || !util::fs::file_exists(visual_path.c_str()))
+            continue;
+        mve::ByteImage::Ptr thermal = load_gray(file.get_absolute_name());
+        mve::ByteImage::Ptr visual = load_gray(visual_path);
+        visual = mve::image::rescale<uint8_t>(visual, mve::image::RESCALE_LINEAR,
+                                              thermal->width(), thermal->height());
+        pairs.emplace_back(thermal, visual);
+    }
+    if (pairs.empty()) {
+        std::cerr << "No image pairs found in " << conf.path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::size_t num_pixels = 0;
+    for (auto const &pair : pairs)
+        num_pixels += pair.first->get_pixel_amount();
+    std::cout << "Benchmarking " << pairs.size() << " pairs, "
+              << num_pixels << " pixels per run." << std::endl;
+
+    /* Thermal pixels that are not saturated, like a coverage mask. */
+    std::vector<mve::ByteImage::Ptr> masks;
+    for (auto const &pair : pairs) {
+        mve::ByteImage::Ptr mask = mve::ByteImage::create(pair.first->width(), pair.first->height(), 1);
+        for (int p = 0; p < mask->get_pixel_amount(); ++p)
+            mask->at(p) = pair.first->at(p) > 0 && pair.first->at(p) < 255;
+        masks.push_back(mask);
+    }
+
+    struct Variant {
+        std::string name;
+        Thermal::MIOptions opts;
+        bool masked;
+        bool floats;
+    };
+    std::vector<Variant> variants;
+    Thermal::MIOptions opts;
+    opts.num_threads = 1;
+    variants.push_back({"256 bins, 1 thread", opts, false, false});
+    opts.num_threads = 0;
+    variants.push_back({"256 bins, all cores", opts, false, false});
+    variants.push_back({"256 bins, masked", opts, true, false});
+    variants.push_back({"256 bins, float input", opts, false, true});
+    opts.bins = 64;
+    variants.push_back({"64 bins", opts, false, false});
+    opts.sigma = 0.f;
+    variants.push_back({"64 bins, unsmoothed", opts, false, false});
+    opts.bins = 32;
+    opts.parzen = true;
+    variants.push_back({"32 bins, Parzen window", opts, false, false});
+    opts.num_threads = 1;
+    variants.push_back({"32 bins, Parzen, 1 thread", opts, false, false});
+
+    std::vector<std::pair<mve::FloatImage::Ptr, mve::FloatImage::Ptr>> float_pairs;
+    for (auto const &pair : pairs)
+        float_pairs.emplace_back(mve::image::byte_to_float_image(pair.first),
+                                 mve::image::byte_to_float_image(pair.second));
+
+    std::cout << std::left << std::setw(30) << "Variant" << std::setw(12) << "ms/run"
+              << std::setw(12) << "MPixel/s" << "mean MI" << std::endl;
+    for (auto const &variant : variants) {
+        double mean_mi = 0;
+        double ms = measure(conf.repeat, [&] {
+          mean_mi = 0;
+          for (std::size_t i = 0; i < pairs.size(); ++i) {
+              mve::ByteImage const *mask = variant.masked ? masks[i].get() : nullptr;
+              if (variant.floats)
+                  mean_mi += Thermal::MutualInformation(*float_pairs[i].first, *float_pairs[i].second,
+                                                        variant.opts, mask);
+              else
+                  mean_mi += Thermal::MutualInformation(*pairs[i].first, *pairs[i].second,
+                                                        variant.opts, mask);
+          }
+          mean_mi /= pairs.size();
+        });
+        std::cout << std::left << std::setw(30) << variant.name << std::setw(12) << ms
+                  << std::setw(12) << num_pixels / (ms * 1000.0) << mean_mi << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Rows of floats of SIFT or SURF descriptors. */
+template<typename T>
+static std::vector<float> descriptor_rows(const std::vector<T> &descriptors) {
+    std::vector<float> rows;
+    for (const auto &descriptor : descriptors)
+        rows.insert(rows.end(), descriptor.data.begin(), descriptor.data.end());
+    return rows;
+}
+
+/** Cross checked matches of two descriptor sets by sfm::Matching. */
+static std::size_t float_matches(const std::vector<float> &set_1, const std::vector<float> &set_2, int dim) {
+    if (set_1.empty() || set_2.empty())
+        return 0;
+    sfm::Matching::Options opts;
+    opts.descriptor_length = dim;
+    opts.lowe_ratio_threshold = 0.8f;
+    sfm::Matching::Result result;
+    sfm::Matching::twoway_match(opts, set_1.data(), static_cast<int>(set_1.size() / dim),
+                                set_2.data(), static_cast<int>(set_2.size() / dim), &result);
+    return static_cast<std::size_t>(sfm::Matching::count_consistent_matches(result));
+}
+
+/** Window mean of the valid region through a float integral image, the
+ * mean filter before Filter::BoxFilter. */
+static mve::FloatImage::Ptr integral_mean(const mve::FloatImage::ConstPtr &img, int filter_range) {
+    mve::FloatImage::Ptr out = mve::FloatImage::create(img->width() - 2 * filter_range,
+                                                       img->height() - 2 * filter_range, 1);
+    mve::FloatImage::Ptr integral = mve::FloatImage::create(img->width() + 1, img->height() + 1, 1);
+    for (int r = 0; r < img->height(); r++) {
+        float sum = 0;
+        for (int c = 0; c < img->width(); c++) {
+            sum += img->at(c, r, 0);
+            integral->at(c + 1, r + 1, 0) = integral->at(c + 1, r, 0) + sum;
+        }
+    }
+    int const k_size = 2 * filter_range + 1;
+    float const normal = 1.f / (k_size * k_size);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int r = filter_range + 1; r < img->height() - filter_range + 1; r++) {
+        for (int c = filter_range + 1; c < img->width() - filter_range + 1; c++) {
+            float const sum = integral->at(c + filter_range, r + filter_range, 0)
+                + integral->at(c - filter_range - 1, r - filter_range - 1, 0)
+                - integral->at(c + filter_range, r - filter_range - 1, 0)
+                - integral->at(c - filter_range - 1, r + filter_range, 0);
+            out->at(c - filter_range - 1, r - filter_range - 1, 0) = sum * normal;
+        }
+    }
+    return out;
+}
+
+/** Window mean of the valid region summed in double, the reference. */
+static mve::FloatImage::Ptr exact_mean(const mve::FloatImage::ConstPtr &img, int filter_range) {
+    int const width = img->width() + 1;
+    std::vector<double> integral(static_cast<std::size_t>(width) * (img->height() + 1), 0.0);
+    for (int r = 0; r < img->height(); r++)
+        for (int c = 0; c < img->width(); c++)
+            integral[(r + 1) * width + c + 1] = img->at(c, r, 0) + integral[r * width + c + 1]
+                + integral[(r + 1) * width + c] - integral[r * width + c];
+    int const k_size = 2 * filter_range + 1;
+    mve::FloatImage::Ptr out = mve::FloatImage::create(img->width() - 2 * filter_range,
+                                                       img->height() - 2 * filter_range, 1);
+    for (int r = 0; r < out->height(); r++) {
+        for (int c = 0; c < out->width(); c++) {
+            double const sum = integral[(r + k_size) * width + c + k_size] + integral[r * width + c]
+                - integral[r * width + c + k_size] - integral[(r + k_size) * width + c];
+            out->at(c, r, 0) = static_cast<float>(sum / (k_size * k_size));
+        }
+    }
+    return out;
+}
+
+static float max_difference(const mve::FloatImage &a, const mve::FloatImage &b) {
+    float error = 0.f;
+    for (int p = 0; p < a.get_pixel_amount(); ++p)
+        error = std::max(error, std::abs(a.at(p) - b.at(p)));
+    return error;
+}
+
+static int benchmark_box(const BenchSettings &conf) {
+    std::vector<mve::FloatImage::Ptr> images;
+    util::fs::Directory dir(conf.path);
+    std::sort(dir.begin(), dir.end());
+    for (auto const &file : dir) {
+        if (!file.is_dir)
+            images.push_back(mve::image::byte_to_float_image(load_gray(file.get_absolute_name())));
+    }
+    if (images.empty()) {
+        std::cerr << "No images found in " << conf.path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Benchmarking " << images.size() << " images of " << images[0]->width() << "x"
+              << images[0]->height() << "." << std::endl;
+
+    std::cout << std::left << std::setw(8) << "radius" << std::setw(12) << "integral ms" << std::setw(12)
+              << "box ms" << std::setw(10) << "speedup" << std::setw(14) << "box-integral"
+              << std::setw(14) << "integral err" << "box err" << std::endl;
+    for (int radius : {1, 2, 3, 5, 7, 15}) {
+        float box_integral = 0.f, integral_error = 0.f, box_error = 0.f;
+        for (auto const &image : images) {
+            mve::FloatImage::Ptr box;
+            Filter::BoxFilter(image, box, radius);
+            mve::FloatImage::Ptr const integral = integral_mean(image, radius);
+            mve::FloatImage::Ptr const exact = exact_mean(image, radius);
+            box_integral = std::max(box_integral, max_difference(*box, *integral));
+            integral_error = std::max(integral_error, max_difference(*integral, *exact));
+            box_error = std::max(box_error, max_difference(*box, *exact));
+        }
+        double const integral_ms = measure(conf.repeat, [&] {
+            for (auto const &image : images)
+                integral_mean(image, radius);
+        });
+        double const box_ms = measure(conf.repeat, [&] {
+            mve::FloatImage::Ptr box;
+            for (auto const &image : images)
+                Filter::BoxFilter(image, box, radius);
+        });
+        std::cout << std::left << std::setw(8) << radius << std::setw(12) << integral_ms / images.size()
+                  << std::setw(12) << box_ms / images.size() << std::setw(10) << integral_ms / box_ms
+                  << std::setw(14) << box_integral << std::setw(14) << integral_error << box_error << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Harris responses computed stage by stage over whole images, as before
+ * the tiled Harris::ComputeHarrisResponses: Sobel gradients, the three
+ * tensor products, the separable window of each and the corner measure. */
+static mve::FloatImage::Ptr staged_harris(const mve::FloatImage::ConstPtr &img,
+                                          const HarrisPyramid::Options &opts) {
+    int const width = img->width() - 2;
+    int const height = img->height() - 2;
+    mve::FloatImage::Ptr xx = mve::FloatImage::create(width, height, 1);
+    mve::FloatImage::Ptr yy = mve::FloatImage::create(width, height, 1);
+    mve::FloatImage::Ptr xy = mve::FloatImage::create(width, height, 1);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            auto at = [&img](int i, int j) { return img->at(i, j, 0); };
+            float const dx = (at(x + 2, y) + 2 * at(x + 2, y + 1) + at(x + 2, y + 2))
+                - (at(x, y) + 2 * at(x, y + 1) + at(x, y + 2));
+            float const dy = (at(x, y) + 2 * at(x + 1, y) + at(x + 2, y))
+                - (at(x, y + 2) + 2 * at(x + 1, y + 2) + at(x + 2, y + 2));
+            xx->at(x, y, 0) = dx * dx;
+            yy->at(x, y, 0) = dy * dy;
+            xy->at(x, y, 0) = dx * dy;
+        }
+    }
+    int const k_size = 2 * opts.filter_range + 1;
+    std::vector<float> const kernel = opts.sigma > 1e-7f ? Filter::GaussKernel(opts.filter_range, opts.sigma)
+                                                         : std::vector<float>(k_size, 1.f / k_size);
+    Filter::SeparableFilter(xx, xx, kernel);
+    Filter::SeparableFilter(yy, yy, kernel);
+    Filter::SeparableFilter(xy, xy, kernel);
+    mve::FloatImage::Ptr responses = mve::FloatImage::create(xx->width(), xx->height(), 1);
+    for (int p = 0; p < responses->get_pixel_amount(); ++p) {
+        float const det = xx->at(p) * yy->at(p) - xy->at(p) * xy->at(p);
+        float const trace = xx->at(p) + yy->at(p);
+        responses->at(p) = det - opts.k * trace * trace;
+    }
+    return responses;
+}
+
+static int benchmark_harris(const BenchSettings &conf) {
+    mve::ByteImage::Ptr image = mve::image::rescale<uint8_t>(load_gray(conf.path), mve::image::RESCALE_LINEAR,
+                                                             4000, 3000);
+    mve::FloatImage::Ptr gray = mve::image::byte_to_float_image(image);
+    std::cout << "Benchmarking Harris responses on " << conf.path << " scaled to "
+              << image->width() << "x" << image->height() << "." << std::endl;
+
+    HarrisPyramid::Options const opts;
+    mve::FloatImage::Ptr staged;
+    double const staged_ms = measure(conf.repeat, [&] { staged = staged_harris(gray, opts); });
+    Harris harris(opts.k, opts.filter_range, opts.sigma);
+    harris.SetImage(image);
+    double const tiled_ms = measure(conf.repeat, [&] { harris.Process(); });
+    mve::FloatImage::ConstPtr tiled = harris.GetResponses();
+    if (tiled->width() != staged->width() || tiled->height() != staged->height())
+        throw std::runtime_error("Response maps differ in size");
+
+    float max_error = 0.f, max_response = 0.f;
+    for (int p = 0; p < tiled->get_pixel_amount(); ++p) {
+        max_error = std::max(max_error, std::abs(tiled->at(p) - staged->at(p)));
+        max_response = std::max(max_response, std::abs(staged->at(p)));
+    }
+    std::cout << std::left << std::setw(14) << "Variant" << "ms" << std::endl;
+    std::cout << std::left << std::setw(14) << "staged" << staged_ms << std::endl;
+    std::cout << std::left << std::setw(14) << "tiled" << tiled_ms << std::endl;
+    std::cout << "Speedup " << staged_ms / tiled_ms << "x, max abs difference " << max_error
+              << " of responses up to " << max_response << "." << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int benchmark_features(const BenchSettings &conf) {
+    std::vector<mve::ByteImage::Ptr> images;
+    util::fs::Directory dir(conf.path);
+    std::sort(dir.begin(), dir.end());
+    for (auto const &file : dir) {
+        if (!file.is_dir)
+            images.push_back(load_gray(file.get_absolute_name()));
+    }
+    if (images.size() < 2) {
+        std::cerr << "Less than two images found in " << conf.path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Benchmarking " << images.size() << " images, "
+              << images.size() - 1 << " consecutive pairs." << std::endl;
+
+    /* Detection of every image, then matching of consecutive images. */
+    std::vector<Brief::Descriptors> harris(images.size());
+    double const harris_ms = measure(conf.repeat, [&] {
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            HarrisPyramid detector((HarrisPyramid::Options()));
+            detector.SetImage(images[i]);
+            detector.Process();
+            harris[i] = detector.GetDescriptors();
+        }
+    });
+    std::vector<std::vector<float>> sift(images.size()), surf(images.size());
+    double const sift_surf_ms = measure(conf.repeat, [&] {
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            sfm::FeatureSet::Options opts;
+            opts.feature_types = sfm::FeatureSet::FEATURE_ALL;
+            sfm::FeatureSet features(opts);
+            features.compute_features(images[i]);
+            sift[i] = descriptor_rows(features.sift_descriptors);
+            surf[i] = descriptor_rows(features.surf_descriptors);
+        }
+    });
+
+    std::size_t num_harris = 0, num_sift_surf = 0;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+        num_harris += harris[i].size();
+        num_sift_surf += sift[i].size() / 128 + surf[i].size() / 64;
+    }
+    std::size_t harris_matches = 0, sift_surf_matches = 0;
+    BinaryMatcher binary_matcher((BinaryMatcher::Options()));
+    double const harris_match_ms = measure(conf.repeat, [&] {
+        harris_matches = 0;
+        for (std::size_t i = 0; i + 1 < images.size(); ++i) {
+            std::vector<int> matches;
+            binary_matcher.Match(harris[i], harris[i + 1], &matches);
+            harris_matches += std::count_if(matches.begin(), matches.end(), [](int j) { return j >= 0; });
+        }
+    });
+    double const sift_surf_match_ms = measure(conf.repeat, [&] {
+        sift_surf_matches = 0;
+        for (std::size_t i = 0; i + 1 < images.size(); ++i)
+            sift_surf_matches += float_matches(sift[i], sift[i + 1], 128) + float_matches(surf[i], surf[i + 1], 64);
+    });
+
+    /* Per image and per pair means. */
+    std::size_t const num_pairs = images.size() - 1;
+    std::cout << std::left << std::setw(14) << "Detector" << std::setw(14) << "detect ms" << std::setw(12)
+              << "features" << std::setw(14) << "match ms" << "matches" << std::endl;
+    std::cout << std::left << std::setw(14) << "harris" << std::setw(14) << harris_ms / images.size()
+              << std::setw(12) << num_harris / images.size() << std::setw(14) << harris_match_ms / num_pairs
+              << harris_matches / num_pairs << std::endl;
+    std::cout << std::left << std::setw(14) << "sift+surf" << std::setw(14) << sift_surf_ms / images.size()
+              << std::setw(12) << num_sift_surf / images.size() << std::setw(14) << sift_surf_match_ms / num_pairs
+              << sift_surf_matches / num_pairs << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int benchmark_match(const BenchSettings &conf) {
+    mve::Scene::Ptr scene = mve::Scene::create(conf.path);
+    std::size_t const num_views = scene->get_views().size();
+    std::cout << "Benchmarking pair selection on " << num_views << " views, "
+              << num_views * (num_views - 1) / 2 << " pairs in total." << std::endl;
+
+    struct Variant {
+        std::string name;
+        MatchingOptions opts;
+    };
+    std::vector<Variant> variants;
+    MatchingOptions opts;
+    variants.push_back({"exhaustive", opts});
+    opts.pair_selection = PAIRS_RETRIEVAL;
+    for (int neighbors : {10, 20, 40}) {
+        opts.retrieval_neighbors = neighbors;
+        variants.push_back({"retrieval top " + std::to_string(neighbors), opts});
+    }
+    opts.retrieval_neighbors = 20;
+    opts.gps_neighbors = 10;
+    variants.push_back({"retrieval top 20 + GPS 10", opts});
+    opts = MatchingOptions();
+    opts.pair_selection = PAIRS_SEQUENTIAL;
+    variants.push_back({"sequential 10 + loops", opts});
+    opts.loop_closure_interval = 0;
+    variants.push_back({"sequential 10", opts});
+
+    std::vector<std::pair<std::string, MatchingStats>> results;
+    for (auto const &variant : variants) {
+        sfm::bundler::ViewportList viewports;
+        sfm::bundler::PairwiseMatching pairwise_matching;
+        MatchingStats stats;
+        features_and_matching(scene, &viewports, &pairwise_matching, conf.feature_type, variant.opts, &stats);
+        scene->cache_cleanup();
+        results.emplace_back(variant.name, stats);
+    }
+
+    std::cout << std::left << std::setw(28) << "Variant" << std::setw(10) << "pairs"
+              << std::setw(10) << "matched" << std::setw(12) << "matches" << std::setw(14)
+              << "select ms" << "match ms" << std::endl;
+    for (auto const &result : results) {
+        MatchingStats const &stats = result.second;
+        std::cout << std::left << std::setw(28) << result.first << std::setw(10) << stats.candidate_pairs
+                  << std::setw(10) << stats.matched_pairs << std::setw(12) << stats.num_matches
+                  << std::setw(14) << stats.selection_ms << stats.matching_ms << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int benchmark_matcher(const BenchSettings &conf) {
+    if (conf.feature_type == FEATURE_HARRIS)
+        throw std::invalid_argument("The matcher benchmark takes SIFT/SURF features");
+    mve::Scene::Ptr scene = mve::Scene::create(conf.path);
+    sfm::bundler::ViewportList viewports;
+    sfm::bundler::Features::Options feature_opts;
+    feature_opts.image_embedding = ORIGINAL_IMAGE_NAME;
+    feature_opts.max_image_size = MAX_IMAGE_SIZE;
+    feature_opts.feature_options.feature_types = static_cast<sfm::FeatureSet::FeatureTypes>(conf.feature_type);
+    sfm::bundler::Features(feature_opts).compute(scene, &viewports);
+    scene->cache_cleanup();
+
+    std::vector<std::pair<int, int>> pairs;
+    for (std::size_t i = 0; i < viewports.size(); ++i)
+        for (std::size_t j = i + 1; j < viewports.size(); ++j)
+            pairs.emplace_back(i, j);
+    std::cout << "Benchmarking descriptor matching on " << pairs.size() << " pairs." << std::endl;
+
+    /* Both runs include preparing the descriptors, the matches of every
+     * pair are kept to compare them. */
+    std::vector<std::vector<int>> mve_matches(pairs.size()), quantized_matches(pairs.size());
+    util::WallTimer mve_timer;
+    {
+        sfm::ExhaustiveMatching matcher;
+        matcher.init(&viewports);
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t p = 0; p < pairs.size(); ++p) {
+            sfm::Matching::Result result;
+            matcher.pairwise_match(pairs[p].first, pairs[p].second, &result);
+            sfm::Matching::remove_inconsistent_matches(&result);
+            mve_matches[p].swap(result.matches_1_2);
+        }
+    }
+    double const mve_ms = mve_timer.get_elapsed();
+
+    util::WallTimer quantized_timer;
+    {
+        QuantizedMatcher matcher((QuantizedMatcher::Options()));
+        std::vector<QuantizedMatcher::Descriptors> sift_rows(viewports.size()), surf_rows(viewports.size());
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < viewports.size(); ++i) {
+            sift_rows[i] = QuantizedMatcher::Quantize(descriptor_rows(viewports[i].features.sift_descriptors), 128);
+            surf_rows[i] = QuantizedMatcher::Quantize(descriptor_rows(viewports[i].features.surf_descriptors), 64);
+        }
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t p = 0; p < pairs.size(); ++p) {
+            int const view_1 = pairs[p].first;
+            int const view_2 = pairs[p].second;
+            std::vector<int> surf_matches;
+            matcher.Match(sift_rows[view_1], sift_rows[view_2], &quantized_matches[p]);
+            matcher.Match(surf_rows[view_1], surf_rows[view_2], &surf_matches);
+            int const surf_offset = static_cast<int>(sift_rows[view_2].size());
+            for (int match : surf_matches)
+                quantized_matches[p].push_back(match < 0 ? -1 : match + surf_offset);
+        }
+    }
+    double const quantized_ms = quantized_timer.get_elapsed();
+
+    std::size_t num_mve = 0, num_quantized = 0, num_shared = 0;
+    for (std::size_t p = 0; p < pairs.size(); ++p) {
+        for (std::size_t i = 0; i < mve_matches[p].size() && i < quantized_matches[p].size(); ++i) {
+            num_mve += mve_matches[p][i] >= 0;
+            num_quantized += quantized_matches[p][i] >= 0;
+            num_shared += mve_matches[p][i] >= 0 && mve_matches[p][i] == quantized_matches[p][i];
+        }
+    }
+    std::cout << std::left << std::setw(14) << "Matcher" << std::setw(12) << "ms"
+              << std::setw(12) << "pairs/s" << "matches" << std::endl;
+    std::cout << std::left << std::setw(14) << "mve" << std::setw(12) << mve_ms
+              << std::setw(12) << pairs.size() / (mve_ms / 1000.0) << num_mve << std::endl;
+    std::cout << std::left << std::setw(14) << "quantized" << std::setw(12) << quantized_ms
+              << std::setw(12) << pairs.size() / (quantized_ms / 1000.0) << num_quantized << std::endl;
+    std::cout << num_shared << " matches are found by both." << std::endl;
+    return EXIT_SUCCESS;
+}
+
+/** Vertex positions of 'mesh' and its faces as their sorted vertex
+ * positions, sorted for comparing meshes regardless of their order. */
+static void mesh_keys(const mve::TriangleMesh &mesh,
+                      std::vector<std::array<float, 3>> *vertices,
+                      std::vector<std::array<float, 9>> *faces) {
+    for (auto const &v : mesh.get_vertices())
+        vertices->push_back({v[0], v[1], v[2]});
+    mve::TriangleMesh::FaceList const &mesh_faces = mesh.get_faces();
+    for (std::size_t f = 0; f + 2 < mesh_faces.size(); f += 3) {
+        std::array<std::array<float, 3>, 3> corners;
+        for (int c = 0; c < 3; ++c) {
+            math::Vec3f const &v = mesh.get_vertices()[mesh_faces[f + c]];
+            corners[c] = {v[0], v[1], v[2]};
+        }
+        std::sort(corners.begin(), corners.end());
+        std::array<float, 9> key;
+        for (int c = 0; c < 3; ++c)
+            std::copy(corners[c].begin(), corners[c].end(), key.begin() + 3 * c);
+        faces->push_back(key);
+    }
+    std::sort(vertices->begin(), vertices->end());
+    std::sort(faces->begin(), faces->end());
+}
+
+template<typename T>
+static std::size_t count_shared(const std::vector<T> &a, const std::vector<T> &b) {
+    std::size_t shared = 0;
+    for (auto i = a.begin(), j = b.begin(); i != a.end() && j != b.end();) {
+        if (*i < *j) {
+            ++i;
+        } else if (*j < *i) {
+            ++j;
+        } else {
+            ++shared, ++i, ++j;
+        }
+    }
+    return shared;
+}
+
+static int benchmark_surface(const BenchSettings &conf) {
+    PointCloud::Ptr points = PointCloud::Load(conf.path);
+    std::cout << "Meshing " << points->GetSize() << " points of " << conf.path << std::endl;
+
+    /* All samples in one octree, as Pipeline::ExtractSurface does. */
+    mve::TriangleMesh::Ptr whole;
+    util::WallTimer timer;
+    {
+        fssr::IsoOctree octree;
+        for (std::size_t i = 0; i < points->GetSize(); ++i) {
+            if (!SurfacePartition::IsSample(points->GetColors()[i]))
+                continue;
+            fssr::Sample sample;
+            sample.pos = points->GetPositions()[i];
+            sample.normal = points->GetNormals()[i];
+            sample.scale = points->GetScales()[i];
+            sample.confidence = points->GetConfidences()[i];
+            sample.color = points->GetColors()[i];
+            octree.insert_sample(sample);
+        }
+        octree.limit_octree_level();
+        octree.compute_voxels();
+        octree.clear_samples();
+        fssr::IsoSurface iso_surface(&octree, fssr::INTERPOLATION_CUBIC);
+        whole = iso_surface.extract_mesh();
+    }
+    std::size_t const whole_ms = timer.get_elapsed();
+
+    timer.reset();
+    SurfacePartition::Options options;
+    options.max_block_samples = conf.block_samples;
+    SurfacePartition const partition(*points, options);
+    std::vector<mve::TriangleMesh::Ptr> meshes(partition.GetNumBlocks());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t b = 0; b < meshes.size(); ++b)
+        meshes[b] = partition.MeshBlock(b);
+    mve::TriangleMesh::Ptr partitioned = partition.Stitch(meshes);
+    std::size_t const partitioned_ms = timer.get_elapsed();
+
+    std::vector<std::array<float, 3>> whole_vertices, partitioned_vertices;
+    std::vector<std::array<float, 9>> whole_faces, partitioned_faces;
+    mesh_keys(*whole, &whole_vertices, &whole_faces);
+    mesh_keys(*partitioned, &partitioned_vertices, &partitioned_faces);
+    std::size_t const shared_vertices = count_shared(whole_vertices, partitioned_vertices);
+    std::size_t const shared_faces = count_shared(whole_faces, partitioned_faces);
+
+    std::cout << partition.GetNumBlocks() << " blocks of up to " << conf.block_samples << " samples, "
+              << partition.GetNumAnchors() << " anchors." << std::endl;
+    std::cout << std::left << std::setw(14) << "Variant" << std::setw(12) << "ms" << std::setw(12)
+              << "vertices" << "faces" << std::endl;
+    std::cout << std::left << std::setw(14) << "whole" << std::setw(12) << whole_ms << std::setw(12)
+              << whole_vertices.size() << whole_faces.size() << std::endl;
+    std::cout << std::left << std::setw(14) << "partitioned" << std::setw(12) << partitioned_ms << std::setw(12)
+              << partitioned_vertices.size() << partitioned_faces.size() << std::endl;
+    std::cout << "Vertices only in the whole mesh: " << whole_vertices.size() - shared_vertices
+              << ", only in the partitioned one: " << partitioned_vertices.size() - shared_vertices << std::endl;
+    std::cout << "Faces only in the whole mesh: " << whole_faces.size() - shared_faces
+              << ", only in the partitioned one: " << partitioned_faces.size() - shared_faces << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    util::system::register_segfault_handler();
+    BenchSettings conf = parse_args(argc, argv);
+    try {
+        if (conf.mode == "mi")
+            return benchmark_mi(conf);
+        if (conf.mode == "box")
+            return benchmark_box(conf);
+        if (conf.mode == "harris")
+            return benchmark_harris(conf);
+        if (conf.mode == "features")
+            return benchmark_features(conf);
+        if (conf.mode == "match")
+            return benchmark_match(conf);
+        if (conf.mode == "matcher")
+            return benchmark_matcher(conf);
+        if (conf.mode == "surface")
+            return benchmark_surface(conf);
+    } catch (const std::exception &e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cerr << "Unknown mode " << conf.mode << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,215 @@
+#include "Pipeline.hpp"
+#include "util/arguments.h"
+#include "util/file_system.h"
+#include "util/system.h"
+#include "util/timer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+struct AppSettings {
+    std::string input_dir;
+    FeatureType feature_type = FEATURE_ALL;
+    bool use_mvs = false;
+    bool thermal = false;
+    bool skip_fssr = false;
+    bool reproject = false;
+    bool estimate_scale = true;
+    std::string calibration_dir;
+    std::size_t memory_budget = 0;
+    Util::SGMPairOptions sgm_opts;
+    Util::PointSetOptions point_set_opts;
+    Pipeline::SurfaceOptions surface_opts;
+    MatchingOptions matching_opts;
+    Pipeline::SfmOptions sfm_opts;
+    Pipeline::ImportOptions import_opts;
+    Pipeline::ReprojectionOptions reproject_opts;
+};
+
+static AppSettings parse_args(int argc, char **argv) {
+    util::Arguments args;
+    args.set_exit_on_error(true);
+    args.set_nonopt_maxnum(1);
+    args.set_nonopt_minnum(1);
+    args.set_helptext_indent(22);
+    args.set_usage("Usage: " + std::string(argv[0]) + " [ OPTS ] IMAGE_DIR");
+    args.set_description("Runs the reconstruction pipeline without the GUI: "
+                         "image import, structure from motion, depth maps, "
+                         "point set and FSSR surface. The scene is written "
+                         "to IMAGE_DIR/scene.");
+    args.add_option('\0', "harris", false, "Match Harris features instead of SIFT/SURF");
+    args.add_option('\0', "match-pairs", true, "View pairs to match: exhaustive, retrieval, sequential [exhaustive]");
+    args.add_option('\0', "retrieval-neighbors", true, "Views retrieved for every view [20]");
+    args.add_option('\0', "sequential-window", true, "Following views every view is matched with [10]");
+    args.add_option('\0', "loop-closure", true, "Views between sequential loop closure checks, 0 for none [10]");
+    args.add_option('\0', "quantized-matching", false, "Match SIFT/SURF descriptors quantized to int8");
+    args.add_option('\0', "gps-neighbors", true, "Also match the views nearest by exif GPS [0]");
+    args.add_option('\0', "batched-sfm", false, "Register several next views per SfM round, not reproducible");
+    args.add_option('\0', "sfm-batch", true, "Most next views tried at once by --batched-sfm [16]");
+    args.add_option('\0', "mvs", false, "Depth maps with MVS instead of SMVS");
+    args.add_option('\0', "thermal", false, "Depth maps from the thermal embedding");
+    args.add_option('\0', "no-fssr", false, "Stop after the point set");
+    args.add_option('\0', "reproject", false, "Blend the thermal images over the visual depth, "
+                                              "FSSR runs on the thermal point set");
+    args.add_option('\0', "calibrate", true, "Calibrate from the circle grids of DIR/thermal-img "
+                                             "and DIR/normal-img into the scene");
+    args.add_option('\0', "calibration", true, "Visual to thermal transform [SCENE/calibration.txt]");
+    args.add_option('\0', "depth-scale", true, "SfM depth to calibration unit factor [estimated]");
+    args.add_option('\0', "sgm-pairs", true, "Neighbors the SGM depth is fused from, 0 for all [2]");
+    args.add_option('\0', "sgm-fusion", true, "Fusion of the SGM depths: median, consensus [median]");
+    args.add_option('\0', "stream-point-set", false, "Merge the MVS point set through chunks on disk");
+    args.add_option('\0', "compress-point-set", false, "LZ4 compress the point set file");
+    args.add_option('\0', "fssr-blocks", false, "Mesh the surface in overlapping blocks under the memory budget");
+    args.add_option('\0', "fssr-block-samples", true, "Samples in the core of an FSSR block [4194304]");
+    args.add_option('\0', "memory-budget", true, "Memory of the parallel depth map and FSSR tasks in MB [half the RAM]");
+    args.add_option('\0', "import-images", true, "Images held in memory during import [8]");
+    args.add_option('\0', "max-pixels", true, "Downscale imported images above this size [off]");
+    args.parse(argc, argv);
+
+    AppSettings conf;
+    conf.input_dir = args.get_nth_nonopt(0);
+    for (util::ArgResult const *arg = args.next_option();
+         arg != nullptr; arg = args.next_option()) {
+        if (arg->opt->lopt == "harris")
+            conf.feature_type = FEATURE_HARRIS;
+        else if (arg->opt->lopt == "match-pairs") {
+            if (arg->arg == "exhaustive")
+                conf.matching_opts.pair_selection = PAIRS_EXHAUSTIVE;
+            else if (arg->arg == "retrieval")
+                conf.matching_opts.pair_selection = PAIRS_RETRIEVAL;
+            else if (arg->arg == "sequential")
+                conf.matching_opts.pair_selection = PAIRS_SEQUENTIAL;
+            else {
+                std::cerr << "Unknown pair selection " << arg->arg << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg->opt->lopt == "retrieval-neighbors")
+            conf.matching_opts.retrieval_neighbors = std::max(1, arg->get_arg<int>());
+        else if (arg->opt->lopt == "sequential-window")
+            conf.matching_opts.sequential_window = std::max(1, arg->get_arg<int>());
+        else if (arg->opt->lopt == "loop-closure")
+            conf.matching_opts.loop_closure_interval = std::max(0, arg->get_arg<int>());
+        else if (arg->opt->lopt == "quantized-matching")
+            conf.matching_opts.quantized_matching = true;
+        else if (arg->opt->lopt == "gps-neighbors")
+            conf.matching_opts.gps_neighbors = std::max(0, arg->get_arg<int>());
+        else if (arg->opt->lopt == "batched-sfm")
+            conf.sfm_opts.batched_registration = true;
+        else if (arg->opt->lopt == "sfm-batch")
+            conf.sfm_opts.batch_candidates = std::max(1, arg->get_arg<int>());
+        else if (arg->opt->lopt == "mvs")
+            conf.use_mvs = true;
+        else if (arg->opt->lopt == "thermal")
+            conf.thermal = true;
+        else if (arg->opt->lopt == "no-fssr")
+            conf.skip_fssr = true;
+        else if (arg->opt->lopt == "reproject")
+            conf.reproject = true;
+        else if (arg->opt->lopt == "calibrate")
+            conf.calibration_dir = util::fs::sanitize_path(arg->arg);
+        else if (arg->opt->lopt == "calibration")
+            conf.reproject_opts.calibration_path = util::fs::sanitize_path(arg->arg);
+        else if (arg->opt->lopt == "depth-scale") {
+            conf.reproject_opts.depth_scale = arg->get_arg<float>();
+            conf.estimate_scale = false;
+        }
+        else if (arg->opt->lopt == "sgm-pairs")
+            conf.sgm_opts.num_pairs = static_cast<std::size_t>(std::max(0, arg->get_arg<int>()));
+        else if (arg->opt->lopt == "sgm-fusion") {
+            if (arg->arg == "median")
+                conf.sgm_opts.fusion = Filter::DEPTH_FUSION_MEDIAN;
+            else if (arg->arg == "consensus")
+                conf.sgm_opts.fusion = Filter::DEPTH_FUSION_CONSENSUS;
+            else {
+                std::cerr << "Unknown SGM fusion " << arg->arg << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg->opt->lopt == "stream-point-set")
+            conf.point_set_opts.streaming = true;
+        else if (arg->opt->lopt == "compress-point-set")
+            conf.point_set_opts.compress = true;
+        else if (arg->opt->lopt == "fssr-blocks")
+            conf.surface_opts.partitioned = true;
+        else if (arg->opt->lopt == "fssr-block-samples")
+            conf.surface_opts.partition.max_block_samples = static_cast<std::size_t>(std::max(1, arg->get_arg<int>()));
+        else if (arg->opt->lopt == "memory-budget")
+            conf.memory_budget = static_cast<std::size_t>(arg->get_arg<int>()) << 20;
+        else if (arg->opt->lopt == "import-images")
+            conf.import_opts.max_images_in_flight = arg->get_arg<int>();
+        else if (arg->opt->lopt == "max-pixels")
+            conf.import_opts.max_pixels = arg->get_arg<int>();
+    }
+    return conf;
+}
+
+int main(int argc, char **argv) {
+    util::system::register_segfault_handler();
+    util::system::print_build_timestamp("Multi-View Thermal CLI");
+    AppSettings conf = parse_args(argc, argv);
+
+    Pipeline pipeline;
+    pipeline.SetMemoryBudget(conf.memory_budget);
+    pipeline.SetSGMOptions(conf.sgm_opts);
+    pipeline.SetPointSetOptions(conf.point_set_opts);
+    pipeline.SetSurfaceOptions(conf.surface_opts);
+    pipeline.SetMatchingOptions(conf.matching_opts);
+    pipeline.SetSfmOptions(conf.sfm_opts);
+    std::vector<std::pair<std::string, std::function<void()>>> stages;
+    stages.emplace_back("Import", [&] { pipeline.NewScene(conf.input_dir, conf.import_opts); });
+    stages.emplace_back("SfM", [&] { pipeline.StructureFromMotion(conf.feature_type); });
+    if (!conf.calibration_dir.empty()) {
+        stages.emplace_back("Thermal calibration", [&] {
+          pipeline.CalibrateThermal(util::fs::join_path(conf.calibration_dir, "thermal-img"),
+                                    util::fs::join_path(conf.calibration_dir, "normal-img"));
+        });
+    }
+    if (conf.use_mvs)
+        stages.emplace_back("Depth (MVS) + point set", [&] { pipeline.DepthReconMVS(conf.thermal); });
+    else
+        stages.emplace_back("Depth (SMVS) + point set", [&] { pipeline.DepthReconShading(conf.thermal); });
+    if (conf.reproject && conf.estimate_scale) {
+        stages.emplace_back("Depth scale estimation", [&] {
+          // compares the SMVS visual depth with the thermal SGM depth, depth
+          // maps that are already up to date are kept by the stage cache
+          pipeline.DepthReconShading(false);
+          pipeline.DepthReconShading(true);
+          conf.reproject_opts.depth_scale =
+              pipeline.EstimateThermalScale(conf.reproject_opts.calibration_path);
+        });
+    }
+    if (conf.reproject) {
+        stages.emplace_back("Thermal reprojection", [&] {
+          pipeline.ReprojectThermal(!conf.use_mvs, conf.reproject_opts);
+        });
+        stages.emplace_back("Thermal point set", [&] { pipeline.MeshReconstruction(!conf.use_mvs); });
+    }
+    if (!conf.skip_fssr)
+        stages.emplace_back("FSSR", [&] { pipeline.SurfaceReconstruction(); });
+
+    std::vector<std::pair<std::string, float>> timings;
+    util::WallTimer total_timer;
+    for (auto &stage : stages) {
+        std::cout << "=== " << stage.first << " ===" << std::endl;
+        util::WallTimer timer;
+        try {
+            stage.second();
+        } catch (const std::exception &e) {
+            std::cerr << "Stage " << stage.first << " failed: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        timings.emplace_back(stage.first, timer.get_elapsed_sec());
+    }
+
+    std::cout << std::endl << "Stage timings:" << std::endl;
+    for (auto const &timing : timings)
+        std::cout << "  " << std::left << std::setw(28) << timing.first
+                  << timing.second << "s" << std::endl;
+    std::cout << "  " << std::left << std::setw(28) << "Total"
+              << total_timer.get_elapsed_sec() << "s" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#include "MemoryBudget.hpp"
+#include <algorithm>
+#include <chrono>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+MemoryBudget::Admission::Admission(MemoryBudget &budget, std::size_t bytes)
+    : m_budget(budget), m_bytes(bytes) {
+    m_budget.Acquire(m_bytes);
+}
+
+MemoryBudget::Admission::~Admission() {
+    m_budget.Release(m_bytes);
+}
+
+MemoryBudget::MemoryBudget(std::size_t budget_bytes)
+    : m_budget(budget_bytes != 0 ? budget_bytes : DefaultBudget()),
+      m_used(0), m_running(0), m_next_ticket(0), m_serving(0) {
+}
+
+void MemoryBudget::Acquire(std::size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::uint64_t const ticket = m_next_ticket++;
+    // an oversized task waits until it has the budget for itself
+    auto fits = [&] {
+      return ticket == m_serving && (m_used + bytes <= m_budget || m_running == 0);
+    };
+    if (!fits()) {
+        m_stats.queued++;
+        auto const start = std::chrono::steady_clock::now();
+        m_cond.wait(lock, fits);
+        m_stats.wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    m_serving++;
+    m_used += bytes;
+    m_running++;
+    m_stats.admitted++;
+    if (bytes > m_budget)
+        m_stats.oversized++;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_used);
+    m_stats.peak_tasks = std::max(m_stats.peak_tasks, m_running);
+    lock.unlock();
+    // the next ticket may fit as well
+    m_cond.notify_all();
+}
+
+void MemoryBudget::Release(std::size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= bytes;
+        m_running--;
+    }
+    m_cond.notify_all();
+}
+
+MemoryBudget::Stats MemoryBudget::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::size_t MemoryBudget::DefaultBudget() {
+    std::size_t physical = 0;
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+        physical = static_cast<std::size_t>(status.ullTotalPhys);
+#else
+    long const pages = sysconf(_SC_PHYS_PAGES);
+    long const page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && page_size > 0)
+        physical = static_cast<std::size_t>(pages) * static_cast<std::size_t>(page_size);
+#endif
+    if (physical == 0)
+        return std::size_t(4) << 30;
+    return physical / 2;
+}
@@ -0,0 +1,191 @@
+#include "MeshCleanup.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/** Elements counted by one task of the prefix sums */
+constexpr std::size_t SCAN_BLOCK = 1 << 16;
+
+namespace {
+
+/** Lock-free union-find, every link points to the smaller index so
+ * concurrent unions cannot form cycles. */
+class UnionFind {
+public:
+    explicit UnionFind(std::size_t size) : m_parent(new std::atomic<std::uint32_t>[size]) {
+#pragma omp parallel for
+        for (std::size_t i = 0; i < size; ++i)
+            m_parent[i].store(static_cast<std::uint32_t>(i), std::memory_order_relaxed);
+    }
+
+    std::uint32_t Find(std::uint32_t x) const {
+        for (;;) {
+            std::uint32_t parent = m_parent[x].load(std::memory_order_relaxed);
+            if (parent == x)
+                return x;
+            std::uint32_t const grand = m_parent[parent].load(std::memory_order_relaxed);
+            /* Path halving, losing the race only leaves a longer path. */
+            if (grand != parent)
+                m_parent[x].compare_exchange_weak(parent, grand, std::memory_order_relaxed);
+            x = grand;
+        }
+    }
+
+    void Union(std::uint32_t a, std::uint32_t b) {
+        for (;;) {
+            a = Find(a);
+            b = Find(b);
+            if (a == b)
+                return;
+            if (a < b)
+                std::swap(a, b);
+            if (m_parent[a].compare_exchange_strong(a, b, std::memory_order_relaxed))
+                return;
+        }
+    }
+private:
+    std::unique_ptr<std::atomic<std::uint32_t>[]> m_parent;
+};
+
+/** New index of every kept element, an exclusive prefix sum of 'keep'
+ * counted and written in parallel blocks. Returns the number kept. */
+std::size_t CompactionIndex(const std::vector<std::uint8_t> &keep, std::vector<std::uint32_t> *index) {
+    std::size_t const num_blocks = (keep.size() + SCAN_BLOCK - 1) / SCAN_BLOCK;
+    std::vector<std::size_t> offsets(num_blocks + 1, 0);
+#pragma omp parallel for
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        std::size_t const end = std::min(keep.size(), (b + 1) * SCAN_BLOCK);
+        offsets[b + 1] = std::count(keep.begin() + b * SCAN_BLOCK, keep.begin() + end, 1);
+    }
+    for (std::size_t b = 0; b < num_blocks; ++b)
+        offsets[b + 1] += offsets[b];
+
+    index->resize(keep.size());
+#pragma omp parallel for
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        std::size_t const end = std::min(keep.size(), (b + 1) * SCAN_BLOCK);
+        std::size_t next = offsets[b];
+        for (std::size_t i = b * SCAN_BLOCK; i < end; ++i) {
+            (*index)[i] = static_cast<std::uint32_t>(next);
+            next += keep[i];
+        }
+    }
+    return offsets.back();
+}
+
+/** Keep the entries of a per vertex or per face list that are kept, a list
+ * of another size is stale and cleared. */
+template<typename T>
+void CompactList(std::vector<T> &list, const std::vector<std::uint8_t> &keep,
+                 const std::vector<std::uint32_t> &index, std::size_t num_kept) {
+    if (list.size() != keep.size()) {
+        list.clear();
+        return;
+    }
+    std::vector<T> out(num_kept);
+#pragma omp parallel for
+    for (std::size_t i = 0; i < keep.size(); ++i)
+        if (keep[i])
+            out[index[i]] = list[i];
+    list.swap(out);
+}
+
+} // namespace
+
+MeshCleanup::Stats MeshCleanup::Apply(mve::TriangleMesh &mesh, const Options &options) {
+    mve::TriangleMesh::VertexList &verts = mesh.get_vertices();
+    mve::TriangleMesh::FaceList &faces = mesh.get_faces();
+    mve::TriangleMesh::ConfidenceList const &confs = mesh.get_vertex_confidences();
+    std::size_t const num_verts = verts.size();
+    std::size_t const num_faces = faces.size() / 3;
+    if (num_verts >= std::numeric_limits<std::uint32_t>::max())
+        throw std::invalid_argument("Mesh too large to clean");
+    Stats stats;
+
+    /* Kill mask of the confidence test. */
+    std::vector<std::uint8_t> alive(num_verts, 1);
+    if (confs.size() == num_verts) {
+        std::size_t num_killed = 0;
+#pragma omp parallel for reduction(+:num_killed)
+        for (std::size_t i = 0; i < num_verts; ++i) {
+            if (confs[i] == 0.f || !(confs[i] > options.confidence_threshold)) {
+                alive[i] = 0;
+                num_killed += 1;
+            }
+        }
+        stats.low_confidence = num_killed;
+    }
+
+    /* Components over the faces whose vertices all survived. */
+    UnionFind components(num_verts);
+#pragma omp parallel for
+    for (std::size_t f = 0; f < num_faces; ++f) {
+        unsigned int const *v = &faces[f * 3];
+        if (!alive[v[0]] || !alive[v[1]] || !alive[v[2]])
+            continue;
+        components.Union(v[0], v[1]);
+        components.Union(v[0], v[2]);
+    }
+    std::unique_ptr<std::atomic<std::uint32_t>[]> sizes(new std::atomic<std::uint32_t>[num_verts]);
+    std::vector<std::uint32_t> roots(num_verts);
+#pragma omp parallel for
+    for (std::size_t i = 0; i < num_verts; ++i)
+        sizes[i].store(0, std::memory_order_relaxed);
+#pragma omp parallel for
+    for (std::size_t i = 0; i < num_verts; ++i) {
+        if (!alive[i])
+            continue;
+        roots[i] = components.Find(static_cast<std::uint32_t>(i));
+        sizes[roots[i]].fetch_add(1, std::memory_order_relaxed);
+    }
+    std::size_t num_components = 0, num_isolated = 0;
+#pragma omp parallel for reduction(+:num_components, num_isolated)
+    for (std::size_t i = 0; i < num_verts; ++i) {
+        if (!alive[i])
+            continue;
+        if (roots[i] == i)
+            num_components += 1;
+        if (sizes[roots[i]].load(std::memory_order_relaxed) <= options.component_threshold) {
+            alive[i] = 0;
+            num_isolated += 1;
+        }
+    }
+    stats.components = num_components;
+    stats.isolated = num_isolated;
+    sizes.reset();
+    roots = std::vector<std::uint32_t>();
+
+    /* Compact the vertices and the faces of the surviving vertices once. */
+    std::vector<std::uint32_t> vert_index;
+    std::size_t const num_kept_verts = CompactionIndex(alive, &vert_index);
+    std::vector<std::uint8_t> keep_face(num_faces);
+#pragma omp parallel for
+    for (std::size_t f = 0; f < num_faces; ++f)
+        keep_face[f] = alive[faces[f * 3]] & alive[faces[f * 3 + 1]] & alive[faces[f * 3 + 2]];
+    std::vector<std::uint32_t> face_index;
+    std::size_t const num_kept_faces = CompactionIndex(keep_face, &face_index);
+
+    mve::TriangleMesh::FaceList new_faces(num_kept_faces * 3);
+#pragma omp parallel for
+    for (std::size_t f = 0; f < num_faces; ++f) {
+        if (!keep_face[f])
+            continue;
+        for (int k = 0; k < 3; ++k)
+            new_faces[face_index[f] * 3 + k] = vert_index[faces[f * 3 + k]];
+    }
+    faces.swap(new_faces);
+
+    CompactList(mesh.get_vertex_normals(), alive, vert_index, num_kept_verts);
+    CompactList(mesh.get_vertex_colors(), alive, vert_index, num_kept_verts);
+    CompactList(mesh.get_vertex_confidences(), alive, vert_index, num_kept_verts);
+    CompactList(mesh.get_vertex_values(), alive, vert_index, num_kept_verts);
+    CompactList(mesh.get_vertex_texcoords(), alive, vert_index, num_kept_verts);
+    CompactList(verts, alive, vert_index, num_kept_verts);
+    CompactList(mesh.get_face_normals(), keep_face, face_index, num_kept_faces);
+    CompactList(mesh.get_face_colors(), keep_face, face_index, num_kept_faces);
+    return stats;
+}
@@ -0,0 +1,1624 @@
+#include "Pipeline.hpp"
+#include "BatchRegistration.hpp"
+#include "BoundedQueue.hpp"
+#include "MemoryBudget.hpp"
+#include "MeshCleanup.hpp"
+#include "StageCache.hpp"
+#include "StereoViewCache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <dmrecon/dmrecon.h>
+#include "util/system.h"
+#include "util/timer.h"
+#include "util/file_system.h"
+#include "sfm/feature_set.h"
+#include "sfm/bundler_common.h"
+#include "sfm/bundler_intrinsics.h"
+#include "sfm/bundler_tracks.h"
+#include "sfm/bundler_init_pair.h"
+#include "sfm/bundler_incremental.h"
+#include "mve/image_io.h"
+#include "mve/image_tools.h"
+#include "mve/bundle_io.h"
+#include "math/octree_tools.h"
+#include "mve/mesh_info.h"
+#include "mve/mesh_io.h"
+#include "mve/mesh_io_ply.h"
+#include "mve/mesh_tools.h"
+#include "fssr/sample_io.h"
+#include "fssr/iso_octree.h"
+#include "fssr/iso_surface.h"
+#include "fssr/mesh_clean.h"
+#include "Util.hpp"
+#include "thermal/Reprojection.hpp"
+
+#include "thread_pool.h"
+#include "stereo_view.h"
+#include "depth_optimizer.h"
+#include "view_selection.h"
+
+/** Hashes the SGM depth of a view besides the inputs, bump it whenever
+ * reconstructSGMDepthForView or the SGM options passed to it change. */
+#define SGM_CACHE_VERSION 1
+
+/** Hashes the pairwise matching besides the views, bump it whenever
+ * features_and_matching changes its output. */
+#define PREBUNDLE_CACHE_VERSION 2
+
+/** Candidates of the batched registration beyond the views it may add */
+#define SFM_BATCH_SLACK 3
+
+/** Part of the memory budget of ReconstructSMVS given to the neighbor
+ * StereoViews shared by its tasks, 1 / STEREO_VIEW_CACHE_SHARE of it. The
+ * tasks are admitted against the rest. */
+#define STEREO_VIEW_CACHE_SHARE 4
+
+/** Content hash of an embedding, read from its file unless it has unsaved
+ * changes. 0 if the view has no such embedding. */
+static std::uint64_t EmbeddingHash(const mve::View::Ptr &view, const std::string &name) {
+    mve::View::ImageProxy const *proxy = view->get_image_proxy(name);
+    if (proxy == nullptr)
+        return 0;
+    ContentHash hash;
+    hash.AddValue(proxy->width).AddValue(proxy->height).AddValue(proxy->channels);
+    if (!proxy->is_dirty) {
+        std::string path = proxy->filename;
+        if (path.empty() || path[0] != '/')
+            path = util::fs::join_path(view->get_directory(), path);
+        if (hash.AddFile(path))
+            return hash.Get();
+    }
+    mve::ImageBase::ConstPtr image = view->get_image(name);
+    if (image != nullptr)
+        hash.Add(image->get_byte_pointer(), image->get_byte_size());
+    return hash.Get();
+}
+
+static void AddCameraHash(ContentHash *hash, const mve::CameraInfo &cam) {
+    hash->AddValue(cam.flen).AddValue(cam.paspect);
+    hash->Add(cam.ppoint, sizeof(cam.ppoint)).Add(cam.dist, sizeof(cam.dist));
+    hash->Add(cam.trans, sizeof(cam.trans)).Add(cam.rot, sizeof(cam.rot));
+}
+
+/** Content hash of all columns of a point set, mapped ones are read once. */
+static std::uint64_t PointSetHash(const PointCloud &points) {
+    ContentHash hash;
+    hash.AddValue(points.GetSize());
+    for (int c = 0; c < PointCloud::NUM_COLUMNS; ++c) {
+        PointCloud::Column const column = static_cast<PointCloud::Column>(c);
+        hash.Add(points.GetData(column), points.GetSize() * PointCloud::ElementBytes(column));
+    }
+    return hash.Get();
+}
+
+Pipeline::Pipeline() : m_scale(0), m_job(nullptr), m_memory_budget(0) {
+
+}
+
+void Pipeline::CheckCancelled() const {
+    if (m_job != nullptr)
+        m_job->CheckCancelled();
+}
+
+void Pipeline::ReportProgress(std::size_t done, std::size_t total) const {
+    if (m_job != nullptr && total > 0)
+        m_job->SetProgress(static_cast<float>(done) / total);
+}
+
+void Pipeline::NewScene(const std::string &input_dir, const ImportOptions &options) {
+    util::system::print_build_timestamp("New MVE Scene");
+
+    util::WallTimer timer;
+
+    util::fs::Directory dir;
+
+    std::string aPath = util::fs::sanitize_path(input_dir);
+    std::string scenePath = util::fs::join_path(aPath, "scene");
+    std::string viewsPath = util::fs::join_path(scenePath, MVE_SCENE_VIEWS_DIR);
+    util::fs::mkdir(scenePath.c_str());
+    util::fs::mkdir(viewsPath.c_str());
+
+    try {
+        dir.scan(aPath);
+    } catch (std::exception &e) {
+        throw std::runtime_error(std::string("Error scanning input dir: ") + e.what());
+    }
+    std::cout << "Found " << dir.size() << " directory entries" << std::endl;
+
+    std::sort(dir.begin(), dir.end());
+
+    /* View ids are assigned up front from the sorted listing, so the stages
+     * below need no ordering barrier. Files that fail to decode leave a gap. */
+    std::vector<std::size_t> image_files;
+    for (std::size_t i = 0; i < dir.size(); ++i) {
+        if (dir[i].is_dir)
+            std::cout << "Skipping directory " << dir[i].name << std::endl;
+        else if (!has_image_extension(dir[i].name))
+            std::cout << "Skipping file " << dir[i].name << ", unknown extension." << std::endl;
+        else
+            image_files.push_back(i);
+    }
+
+    struct ImportItem {
+        int id;
+        std::string fname;
+        std::string afname;
+        std::string exif;
+        mve::ImageBase::Ptr image;
+        mve::View::Ptr view;
+    };
+    typedef std::unique_ptr<ImportItem> ItemPtr;
+
+    /* Every item holds one of 'max_images_in_flight' slots from decoding
+     * until it is written, which caps the resident images. */
+    std::size_t max_in_flight = std::max(options.max_images_in_flight, 1);
+    BoundedQueue<int> slots(max_in_flight);
+    for (std::size_t i = 0; i < max_in_flight; ++i)
+        slots.Push(0);
+    BoundedQueue<ItemPtr> decoded(max_in_flight);
+    BoundedQueue<ItemPtr> with_exif(max_in_flight);
+    BoundedQueue<ItemPtr> scaled(max_in_flight);
+
+    std::size_t num_threads = options.num_threads > 0
+                              ? static_cast<std::size_t>(options.num_threads)
+                              : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    std::atomic_size_t next_file(0);
+    std::atomic_size_t num_done(0);
+    std::atomic_int num_imported(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex mutex;
+
+    auto aborted = [&] { return failed || IsCancelled(); };
+    auto fail = [&] {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!failed)
+          error = std::current_exception();
+      failed = true;
+    };
+    auto release = [&] {
+      slots.Push(0);
+      ReportProgress(++num_done, image_files.size());
+    };
+
+    std::vector<std::thread> workers;
+    /* Run 'num_workers' threads applying 'func' to the items of 'input', the
+     * last thread to finish closes 'output'. After a failure or cancellation
+     * the items are only drained so that no producer blocks. */
+    auto add_stage = [&](std::size_t num_workers, BoundedQueue<ItemPtr> *input,
+                         BoundedQueue<ItemPtr> *output, std::function<void(ImportItem &)> func) {
+      auto remaining = std::make_shared<std::atomic_size_t>(num_workers);
+      for (std::size_t t = 0; t < num_workers; ++t) {
+          workers.emplace_back([&, input, output, func, remaining] {
+            ItemPtr item;
+            while (input->Pop(&item)) {
+                if (!aborted()) {
+                    try {
+                        func(*item);
+                    } catch (...) {
+                        fail();
+                    }
+                }
+                if (output != nullptr && !aborted()) {
+                    output->Push(std::move(item));
+                } else {
+                    item.reset();
+                    release();
+                }
+            }
+            if (--*remaining == 0 && output != nullptr)
+                output->Close();
+          });
+      }
+    };
+
+    /* Decode */
+    auto decoders_left = std::make_shared<std::atomic_size_t>(num_threads);
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&, decoders_left] {
+          int slot;
+          while (slots.Pop(&slot)) {
+              std::size_t k = next_file++;
+              if (k >= image_files.size() || aborted()) {
+                  slots.Push(slot);
+                  break;
+              }
+              ItemPtr item(new ImportItem);
+              item->id = static_cast<int>(k);
+              item->fname = dir[image_files[k]].name;
+              item->afname = dir[image_files[k]].get_absolute_name();
+              try {
+                  item->image = load_any_image(item->afname, &item->exif);
+              } catch (...) {
+                  fail();
+              }
+              if (item->image == nullptr) {
+                  release();
+                  continue;
+              }
+              decoded.Push(std::move(item));
+          }
+          if (--*decoders_left == 0)
+              decoded.Close();
+        });
+    }
+
+    /* EXIF and view headers */
+    add_stage(1, &decoded, &with_exif, [](ImportItem &item) {
+      item.view = mve::View::create();
+      item.view->set_id(item.id);
+      item.view->set_name(remove_file_extension(item.fname));
+      add_exif_to_view(item.view, item.exif);
+    });
+
+    /* Thumbnail and downscale, JPEGs kept at full size are only referenced */
+    add_stage(num_threads, &with_exif, &scaled, [&options](ImportItem &item) {
+      mve::ByteImage::Ptr thumbnail = create_thumbnail(item.image);
+      if (thumbnail != nullptr)
+          item.view->set_image(thumbnail, THUMBNAIL_IMAGE_NAME);
+      int orig_width = item.image->width();
+      if (options.max_pixels > 0)
+          item.image = limit_image_size(item.image, options.max_pixels);
+      if (orig_width == item.image->width() && has_jpeg_extension(item.fname))
+          item.view->set_image_ref(item.afname, ORIGINAL_IMAGE_NAME);
+      else
+          item.view->set_image(item.image, ORIGINAL_IMAGE_NAME);
+      item.image.reset();
+    });
+
+    /* Write views */
+    add_stage(num_threads, &scaled, nullptr, [&](ImportItem &item) {
+      std::string mve_fname = make_image_name(item.id);
+      {
+          std::lock_guard<std::mutex> lock(mutex);
+          std::cout << "Importing image: " << item.fname
+                    << ", writing MVE view: " << mve_fname << "..." << std::endl;
+      }
+      item.view->save_view_as(util::fs::join_path(viewsPath, mve_fname));
+      ++num_imported;
+    });
+
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+    CheckCancelled();
+    std::cout << "Imported " << num_imported << " input images, took "
+              << timer.get_elapsed() << " ms." << std::endl;
+
+    SetScene(mve::Scene::create(scenePath));
+    m_cache.reset(new StageCache(scenePath));
+    // If there is a bundle file exist in the disk, delete it.
+    const std::string prebundle_path = util::fs::join_path(m_pScene->get_path(), "prebundle.sfm");
+    if (util::fs::file_exists(prebundle_path.c_str())) {
+        std::remove(prebundle_path.c_str());
+    }
+    m_scale = get_scale_from_max_pixel(m_pScene);
+    m_point_set.reset();
+}
+
+void Pipeline::SetScene(const mve::Scene::Ptr &scene) {
+    std::lock_guard<std::mutex> lock(m_scene_mutex);
+    m_pScene = scene;
+}
+
+void Pipeline::OpenScene(const std::string &scene_dir) {
+    util::system::print_build_timestamp("Open MVE Scene");
+
+    mve::Scene::Ptr scene = mve::Scene::create(util::fs::sanitize_path(scene_dir));
+    if (scene->get_views().empty())
+        throw std::runtime_error("Empty scene, please select a scene folder with .mve views.");
+
+    SetScene(scene);
+    m_cache.reset(new StageCache(scene->get_path()));
+    m_scale = get_scale_from_max_pixel(m_pScene);
+    m_point_set.reset();
+    /* The point set written last is mapped, not parsed. */
+    std::string point_set_path;
+    std::time_t point_set_time = 0;
+    util::fs::Directory dir(scene->get_path());
+    for (const auto &file : dir) {
+        struct stat st;
+        if (file.is_dir || util::string::right(file.name, 5) != ".mvpc"
+            || ::stat(file.get_absolute_name().c_str(), &st) != 0 || st.st_mtime < point_set_time)
+            continue;
+        point_set_path = file.get_absolute_name();
+        point_set_time = st.st_mtime;
+    }
+    if (!point_set_path.empty()) {
+        try {
+            m_point_set = PointCloud::Load(point_set_path);
+            std::cout << "Mapped " << m_point_set->GetSize() << " points of " << point_set_path << std::endl;
+        }
+        catch (std::exception &err) {
+            std::cerr << err.what() << std::endl;
+        }
+    }
+}
+
+std::vector<Pipeline::Thumbnail> Pipeline::CreateThumbnails() {
+    if (m_pScene == nullptr)
+        throw std::runtime_error("No scene loaded");
+    util::WallTimer timer;
+    mve::Scene::ViewList &views(m_pScene->get_views());
+    std::vector<Thumbnail> thumbnails(views.size());
+    std::atomic_size_t num_done(0);
+    std::atomic_int num_created(0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < views.size(); ++i) {
+        ReportProgress(num_done++, views.size());
+        if (IsCancelled())
+            continue;
+        mve::View::Ptr view = views[i];
+        if (view == nullptr)
+            continue;
+        thumbnails[i].view_id = view->get_id();
+        thumbnails[i].directory = view->get_directory();
+        mve::ByteImage::Ptr thumbnail;
+        if (view->has_image(THUMBNAIL_IMAGE_NAME)) {
+            thumbnail = view->get_byte_image(THUMBNAIL_IMAGE_NAME);
+        } else {
+            mve::ImageBase::Ptr original = view->get_image(ORIGINAL_IMAGE_NAME);
+            if (original != nullptr)
+                thumbnail = create_thumbnail(original);
+            if (thumbnail != nullptr) {
+                view->set_image(thumbnail, THUMBNAIL_IMAGE_NAME);
+                view->save_view();
+                ++num_created;
+            }
+        }
+        if (thumbnail != nullptr) {
+            // gray and gray-alpha thumbnails are replicated to rgb
+            bool const gray = thumbnail->channels() < 3;
+            thumbnails[i].width = thumbnail->width();
+            thumbnails[i].height = thumbnail->height();
+            thumbnails[i].rgb.resize(3 * thumbnail->get_pixel_amount());
+            for (int p = 0; p < thumbnail->get_pixel_amount(); ++p)
+                for (int c = 0; c < 3; ++c)
+                    thumbnails[i].rgb[3 * p + c] = thumbnail->at(p, gray ? 0 : c);
+        }
+        view->cache_cleanup();
+    }
+    CheckCancelled();
+    if (num_created > 0)
+        std::cout << "Created " << num_created << " thumbnails, took "
+                  << timer.get_elapsed() << " ms." << std::endl;
+    // ids of images that failed to import are left empty
+    thumbnails.erase(std::remove_if(thumbnails.begin(), thumbnails.end(),
+                                    [](const Thumbnail &t) { return t.view_id < 0; }),
+                     thumbnails.end());
+    return thumbnails;
+}
+
+mve::Bundle::Ptr Pipeline::StructureFromMotion(FeatureType feature_type) {
+    if (m_pScene == nullptr)
+        throw std::runtime_error("No scene loaded");
+    util::WallTimer total_timer;
+    // prebundle.sfm is for holding view and view matching info
+    const std::string prebundle_path = util::fs::join_path(m_pScene->get_path(), "prebundle.sfm");
+    sfm::bundler::ViewportList viewPorts;
+    sfm::bundler::PairwiseMatching pairwise_matching;
+    /* The matches of a pair only depend on the features and matcher, the
+     * pair selection on all views. A changed selection or view set only
+     * computes the features of new or changed views, and pairs of
+     * unchanged views keep their matches. */
+    ContentHash matching_hash;
+    matching_hash.AddValue(PREBUNDLE_CACHE_VERSION);
+    matching_hash.AddValue(static_cast<int>(feature_type));
+    matching_hash.AddValue(m_matching_opts.quantized_matching);
+    matching_hash.AddValue(m_matching_opts.pair_selection == PAIRS_EXHAUSTIVE);
+    ContentHash prebundle_hash = matching_hash;
+    prebundle_hash.AddValue(static_cast<int>(m_matching_opts.pair_selection));
+    if (m_matching_opts.pair_selection != PAIRS_EXHAUSTIVE)
+        prebundle_hash.AddValue(m_matching_opts.retrieval_neighbors).AddValue(m_matching_opts.gps_neighbors);
+    if (m_matching_opts.pair_selection == PAIRS_SEQUENTIAL)
+        prebundle_hash.AddValue(m_matching_opts.sequential_window).AddValue(m_matching_opts.loop_closure_interval);
+    std::map<int, std::uint64_t> view_hashes;
+    for (const auto &view : m_pScene->get_views()) {
+        if (view == nullptr)
+            continue;
+        std::uint64_t const view_hash = EmbeddingHash(view, ORIGINAL_IMAGE_NAME);
+        view_hashes[view->get_id()] = view_hash;
+        prebundle_hash.AddValue(view->get_id());
+        prebundle_hash.AddValue(view_hash);
+    }
+    const bool has_prebundle = util::fs::file_exists(prebundle_path.c_str());
+    if (!has_prebundle || !m_cache->IsValid("prebundle", prebundle_hash.Get())) {
+        std::unique_ptr<PreviousMatching> previous;
+        if (has_prebundle && m_cache->IsValid("prebundle/matching", matching_hash.Get())) {
+            previous.reset(new PreviousMatching);
+            sfm::bundler::ViewportList previous_viewports;
+            sfm::bundler::load_prebundle_from_file(prebundle_path, &previous_viewports, &previous->matching);
+            previous->unchanged.assign(m_pScene->get_views().size(), false);
+            for (const auto &view_hash : view_hashes) {
+                previous->unchanged[view_hash.first] = view_hash.first < static_cast<int>(previous_viewports.size())
+                    && m_cache->IsValid("prebundle/view/" + util::string::get(view_hash.first), view_hash.second);
+            }
+            previous->all_pairs = m_matching_opts.pair_selection == PAIRS_EXHAUSTIVE;
+        }
+
+        std::cout << "Start feature matching." << std::endl;
+        util::system::rand_seed(RAND_SEED_MATCHING);
+        if (!features_and_matching(m_pScene, &viewPorts, &pairwise_matching, feature_type, m_matching_opts,
+                                   nullptr, previous.get()))
+            throw std::runtime_error("No matching image pairs.");
+
+        std::cout << "Saving pre-bundle to file..." << std::endl;
+        sfm::bundler::save_prebundle_to_file(viewPorts, pairwise_matching, prebundle_path);
+        m_cache->Record("prebundle", prebundle_hash.Get());
+        m_cache->Record("prebundle/matching", matching_hash.Get());
+        for (const auto &view_hash : view_hashes)
+            m_cache->Record("prebundle/view/" + util::string::get(view_hash.first), view_hash.second);
+        m_cache->Save();
+    } else {
+        std::cout << "Loading pairwise matching from file..." << std::endl;
+        sfm::bundler::load_prebundle_from_file(prebundle_path, &viewPorts, &pairwise_matching);
+    }
+
+    /* Drop descriptors and embeddings to save memory. */
+    m_pScene->cache_cleanup();
+    for (auto &viewPort : viewPorts)
+        viewPort.features.clear_descriptors();
+
+    /* Check if there are some matching images. */
+    if (pairwise_matching.empty())
+        throw std::runtime_error("No matching image pairs.");
+
+    /* Load camera intrinsics. */
+    {
+        sfm::bundler::Intrinsics::Options intrinsics_opts;
+        if (m_pScene->get_views().back()->has_blob("exif")) {
+            //get camera intrinsics from exif
+            std::cout << "Initializing camera intrinsics from exif..." << std::endl;
+            intrinsics_opts.intrinsics_source = sfm::bundler::Intrinsics::FROM_EXIF;
+        } else {
+            // get camera intrinsics from views
+            // (if meta.ini has no intrinsics when loading the scene, then it get default value)
+            std::cout << "Initializing camera intrinsics from views..." << std::endl;
+            intrinsics_opts.intrinsics_source = sfm::bundler::Intrinsics::FROM_VIEWS;
+        }
+        sfm::bundler::Intrinsics intrinsics(intrinsics_opts);
+        intrinsics.compute(m_pScene, &viewPorts);
+    }
+
+    /** Incremental SfM*/
+    util::system::rand_seed(RAND_SEED_SFM);
+
+    sfm::bundler::TrackList tracks;
+    {
+        sfm::bundler::Tracks::Options tracks_opts;
+        tracks_opts.verbose_output = true;
+
+        sfm::bundler::Tracks bundler_tracks(tracks_opts);
+        std::cout << "Computing feature tracks..." << std::endl;
+        bundler_tracks.compute(pairwise_matching, &viewPorts, &tracks);
+        std::cout << "Create a total of " << tracks.size() << " tracks." << std::endl;
+    }
+
+    /** Remove color data and pairwise matching to save memory*/
+    for (auto &viewPort : viewPorts) {
+        viewPort.features.colors.clear();
+    }
+    pairwise_matching.clear();
+
+    /* Search for a good initial pair*/
+    //TODO: add a option for user to specify init pair manually
+    sfm::bundler::InitialPair::Result init_pair_result;
+    sfm::bundler::InitialPair::Options init_pair_opts;
+    // init_pair_opts.homography_opts.max_iterations = 1000;
+    // init_pair_opts.homography_opts.threshold = 0.005f;
+    init_pair_opts.homography_opts.verbose_output = false;
+    init_pair_opts.max_homography_inliers = 0.8f;
+    init_pair_opts.verbose_output = true;
+
+    sfm::bundler::InitialPair init_pair(init_pair_opts);
+    init_pair.initialize(viewPorts, tracks);
+    init_pair.compute_pair(&init_pair_result);
+
+    if (init_pair_result.view_1_id < 0 || init_pair_result.view_2_id < 0
+        || init_pair_result.view_1_id >= static_cast<int>(viewPorts.size())
+        || init_pair_result.view_2_id >= static_cast<int>(viewPorts.size())) {
+        throw std::runtime_error("Error finding initial pair, "
+                                 "try manually specifying an initial pair.");
+    }
+    std::cout << "Using views " << init_pair_result.view_1_id
+              << " and " << init_pair_result.view_2_id
+              << " as initial pair." << std::endl;
+
+    /* Incrementally compute full bundle. */
+    sfm::bundler::Incremental::Options incremental_opts;
+    // incremental_opts.pose_p3p_opts.max_iterations = 1000;
+    // incremental_opts.pose_p3p_opts.threshold = 0.005f;
+    incremental_opts.pose_p3p_opts.verbose_output = false;
+    incremental_opts.track_error_threshold_factor = 10.0f;
+    incremental_opts.new_track_error_threshold = 0.01f;
+    incremental_opts.min_triangulation_angle = MATH_DEG2RAD(1.0);
+    incremental_opts.ba_fixed_intrinsics = false;
+    //incremental_opts.ba_shared_intrinsics = conf.shared_intrinsics;
+    incremental_opts.verbose_output = true;
+    incremental_opts.verbose_ba = false;
+
+    viewPorts[init_pair_result.view_1_id].pose = init_pair_result.view_1_pose;
+    viewPorts[init_pair_result.view_2_id].pose = init_pair_result.view_2_pose;
+
+    sfm::bundler::Incremental incremental(incremental_opts);
+    incremental.initialize(&viewPorts, &tracks);
+    incremental.triangulate_new_tracks(2);
+    incremental.invalidate_large_error_tracks();
+
+    std::cout << "Running full bundle adjustment..." << std::endl;
+    incremental.bundle_adjustment_full();
+
+    BatchRegistration batch_registration(incremental_opts, &viewPorts, &tracks);
+    int num_cameras_reconstructed = 2;
+    int full_ba_num_skipped = 0;
+    while (true) {
+        CheckCancelled();
+        ReportProgress(num_cameras_reconstructed, viewPorts.size());
+        std::vector<int> next_views;
+        incremental.find_next_views(&next_views);
+
+        /* No more views than the full bundle adjustment below may skip, so
+         * it runs as often as with one view per round. */
+        int const max_views = std::max(1, std::min(100, num_cameras_reconstructed / 10)
+            - full_ba_num_skipped + 1);
+        std::vector<int> new_views;
+        if (m_sfm_opts.batched_registration && max_views > 1) {
+            /* A few candidates more than views may pass, the next ones are
+             * tried if none of a batch passes. */
+            std::size_t const batch = std::min(std::max(1, m_sfm_opts.batch_candidates),
+                                               max_views + SFM_BATCH_SLACK);
+            for (std::size_t first = 0; first < next_views.size() && new_views.empty(); first += batch) {
+                std::vector<int> const candidates(next_views.begin() + first,
+                                                  next_views.begin() + std::min(next_views.size(), first + batch));
+                std::cout << "Trying " << candidates.size() << " next views for up to " << max_views
+                          << " (" << num_cameras_reconstructed << " of " << viewPorts.size() << ")...\n";
+                new_views = batch_registration.Register(candidates, max_views);
+            }
+        } else {
+            for (int next_view : next_views) {
+                std::cout << "Add next view ID " << next_view
+                          << "(" << num_cameras_reconstructed + 1 << " of " << viewPorts.size() << ")...\n";
+                if (incremental.reconstruct_next_view(next_view)) {
+                    new_views.push_back(next_view);
+                    break;
+                }
+            }
+        }
+        std::flush(std::cout);
+        if (new_views.empty()) {
+            if (full_ba_num_skipped == 0) {
+                std::cout << "No valid next view\n";
+                std::cout << "SfM reconstruction finished" << std::endl;
+                break;
+            } else {
+                incremental.triangulate_new_tracks(3);
+                std::cout << "Running full bundle adjustment..." << std::endl;
+                incremental.bundle_adjustment_full();
+                incremental.invalidate_large_error_tracks();
+                full_ba_num_skipped = 0;
+                continue;
+            }
+        }
+        /* Run single-camera bundle adjustment, of all new cameras at once. */
+        int const num_new_views = static_cast<int>(new_views.size());
+        if (num_new_views == 1) {
+            std::cout << "Running single camera bundle adjustment..." << std::endl;
+            incremental.bundle_adjustment_single_cam(new_views.front());
+        } else {
+            std::cout << "Running camera bundle adjustment of " << num_new_views << " views..." << std::endl;
+            batch_registration.BundleAdjustCameras(new_views);
+        }
+        num_cameras_reconstructed += num_new_views;
+
+        /* Run full bundle adjustment only after a couple of views. */
+        const int full_ba_skip_views = std::min(100, num_cameras_reconstructed / 10);
+        if (full_ba_num_skipped + num_new_views <= full_ba_skip_views) {
+            std::cout << "Skipping full bundle adjustment (skipping "
+                      << full_ba_skip_views << " views)." << std::endl;
+            full_ba_num_skipped += num_new_views;
+        } else {
+            incremental.triangulate_new_tracks(3);
+            incremental.try_restore_tracks_for_views();
+            std::cout << "Running full bundle adjustment..." << std::endl;
+            incremental.bundle_adjustment_full();
+            incremental.invalidate_large_error_tracks();
+            full_ba_num_skipped = 0;
+        }
+    }
+
+    std::cout << "SfM reconstruction took " << total_timer.get_elapsed()
+              << " ms." << std::endl;
+
+    std::cout << "Creating bundle data structure..." << std::endl;
+    mve::Bundle::Ptr bundle = incremental.create_bundle();
+    mve::save_mve_bundle(bundle, util::fs::join_path(m_pScene->get_path(), "synth_0.out"));
+
+    /* Apply bundle cameras to views. */
+    mve::Bundle::Cameras const &bundle_cams = bundle->get_cameras();
+    mve::Scene::ViewList const &views = m_pScene->get_views();
+    if (bundle_cams.size() != views.size())
+        throw std::runtime_error("Invalid number of cameras!");
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t i = 0; i < bundle_cams.size(); ++i) {
+        mve::View::Ptr view = views[i];
+        mve::CameraInfo const &cam = bundle_cams[i];
+        if (view == nullptr)
+            continue;
+        if (view->get_camera().flen == 0.0f && cam.flen == 0.0f)
+            continue;
+
+        view->set_camera(cam);
+
+        /* Undistort image. */
+        mve::ByteImage::Ptr original
+            = view->get_byte_image(ORIGINAL_IMAGE_NAME);
+        if (original == nullptr)
+            continue;
+        mve::ByteImage::Ptr undist
+            = mve::image::image_undistort_k2k4<uint8_t>
+                (original, cam.flen, cam.dist[0], cam.dist[1]);
+        view->set_image(undist, UNDISTORTED_IMAGE_NAME);
+
+#pragma omp critical
+        std::cout << "Saving view " << view->get_directory() << std::endl;
+        view->save_view();
+        view->cache_cleanup();
+    }
+    return bundle;
+}
+
+void Pipeline::DepthReconShading(bool thermal) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string input_name;
+    std::string dm_name;
+    std::string sgmName;
+    std::string pointset_name;
+    smvs::SGMStereo::Options opt;
+    int scale = 0;
+    bool noOptimize = false;
+    if (!thermal) {
+        scale = m_scale;
+        if (m_scale != 0)
+            input_name = "undist-L" + util::string::get(m_scale);
+        else
+            input_name = UNDISTORTED_IMAGE_NAME;
+        dm_name = "smvs-visual-B" + util::string::get(m_scale);
+        sgmName = "smvs-visual-SGM";
+        pointset_name = "smvs-visual-point-set";
+    } else {
+        input_name = THERMAL_IMAGE_NAME;
+        dm_name = "smvs-thermal-B" + util::string::get(m_scale);
+        sgmName = "smvs-thermal-SGM";
+        pointset_name = "smvs-thermal-point-set";
+        noOptimize = true;
+    }
+    ReconstructSMVS(opt, scale, noOptimize, input_name, dm_name, sgmName);
+    m_point_set = GeneratePointSet(pointset_name, input_name, dm_name, true);
+}
+
+/** Peak memory of an SMVS task on a 'width' x 'height' input: the shading
+ * StereoView of the reference view, the SGM cost volumes and their
+ * aggregation at half size for 'num_sgm' concurrent pairs, and the
+ * optimizer's per pixel state. The neighbor views are shared through the
+ * StereoViewCache and counted in its part of the budget. */
+static std::size_t EstimateSMVSBytes(int width, int height, int channels,
+                                     const smvs::SGMStereo::Options &opt, std::size_t num_sgm) {
+    std::size_t const pixels = static_cast<std::size_t>(width) * height;
+    std::size_t const view = StereoViewCache::EstimateBytes(width, height, channels);
+    std::size_t const shading = pixels * 4 * sizeof(float);
+    std::size_t const sgm = (pixels / 4) * static_cast<std::size_t>(opt.num_steps) * 2 * sizeof(std::uint16_t);
+    std::size_t const optimizer = pixels * 16 * sizeof(float);
+    return view + shading + sgm * num_sgm + optimizer;
+}
+
+/** Peak memory of a DMRecon task: byte images of the reference view and up
+ * to 'num_views' neighbors with their pyramids, and the float depth,
+ * normal, confidence and depth derivative maps. */
+static std::size_t EstimateMVSBytes(int width, int height, int channels, std::size_t num_views) {
+    std::size_t const pixels = static_cast<std::size_t>(width) * height;
+    std::size_t const images = (num_views + 1) * pixels * channels * 4 / 3;
+    return images + pixels * 7 * sizeof(float);
+}
+
+/** Wait for all 'tasks', then rethrow the first exception of any. The
+ * tasks reference locals of the caller, so none may still be queued or
+ * running when the caller unwinds. */
+static void WaitForAll(std::vector<std::future<void>> &tasks) {
+    std::exception_ptr error;
+    for (auto &&task : tasks) {
+        try {
+            task.get();
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+static void PrintBudgetStats(const MemoryBudget &budget) {
+    MemoryBudget::Stats const stats = budget.GetStats();
+    std::cout << "Memory budget " << (budget.GetBudget() >> 20) << " MB: " << stats.admitted
+              << " tasks admitted, " << stats.queued << " waited " << stats.wait_seconds
+              << "s in total, " << stats.oversized << " ran alone, peak " << stats.peak_tasks
+              << " tasks using " << (stats.peak_bytes >> 20) << " MB." << std::endl;
+}
+
+/** Order in which the views are reconstructed, each next view is the one
+ * sharing the most views with the 'window' views before it. Tasks start in
+ * this order, so the neighbors they load are still in the StereoViewCache. */
+static std::vector<std::size_t> NeighborLocalOrder(const std::vector<int> &view_ids,
+                                                   const std::vector<mve::Scene::ViewList> &neighbors,
+                                                   std::size_t window) {
+    std::size_t const n = view_ids.size();
+    std::vector<std::vector<int>> used(n);
+    for (std::size_t v = 0; v < n; ++v) {
+        used[v].push_back(view_ids[v]);
+        for (const auto &neighbor : neighbors[v])
+            used[v].push_back(neighbor->get_id());
+    }
+
+    std::vector<std::size_t> order;
+    std::vector<bool> scheduled(n, false);
+    std::map<int, int> recent;
+    for (std::size_t k = 0; k < n; ++k) {
+        std::size_t best = n;
+        int best_shared = -1;
+        for (std::size_t v = 0; v < n; ++v) {
+            if (scheduled[v])
+                continue;
+            int shared = 0;
+            for (int id : used[v])
+                shared += recent.count(id) != 0;
+            if (shared > best_shared)
+                best = v, best_shared = shared;
+        }
+        scheduled[best] = true;
+        order.push_back(best);
+        for (int id : used[best])
+            recent[id]++;
+        if (order.size() > window) {
+            for (int id : used[order[order.size() - window - 1]])
+                if (--recent[id] == 0)
+                    recent.erase(id);
+        }
+    }
+    return order;
+}
+
+void Pipeline::ReconstructSMVS(const smvs::SGMStereo::Options &opt,
+                               int scale, bool noOptimize,
+                               const std::string &input_name,
+                               const std::string &dm_name,
+                               const std::string &sgmName) {
+    util::WallTimer total_timer;
+    mve::Scene::ViewList &views(m_pScene->get_views());
+
+    /* Add views to reconstruction list */
+    std::vector<int> reconstruction_list;
+    for (std::size_t i = 0; i < views.size(); ++i) {
+        if (views[i] == nullptr) {
+            std::cout << "View ID " << i << " invalid, skipping view."
+                      << std::endl;
+            continue;
+        }
+        if (!views[i]->has_image(UNDISTORTED_IMAGE_NAME)) {
+            std::cout << "View ID " << i << " missing image embedding, "
+                      << "skipping view." << std::endl;
+            continue;
+        }
+        if (!views[i]->has_image(input_name) && scale == 0) {
+            std::cout << "View ID " << i << " missing input image, "
+                      << "skipping view." << std::endl;
+            continue;
+
+        }
+        reconstruction_list.push_back(i);
+    }
+    /* Create reconstruction threads */
+    ThreadPool thread_pool(std::max<std::size_t>(std::thread::hardware_concurrency(), 1));
+    /* View selection */
+    smvs::ViewSelection::Options view_select_opts;
+    view_select_opts.num_neighbors = 6;
+    view_select_opts.embedding = UNDISTORTED_IMAGE_NAME;
+    smvs::ViewSelection view_selection(view_select_opts, views, m_pScene->get_bundle());
+    std::vector<mve::Scene::ViewList> view_neighbors(reconstruction_list.size());
+    std::vector<std::future<void>> selection_tasks;
+    for (std::size_t v = 0; v < reconstruction_list.size(); ++v) {
+        int const i = reconstruction_list[v];
+        selection_tasks.emplace_back(thread_pool.add_task(
+            [i, v, &view_selection, &view_neighbors] {
+              view_neighbors[v] = view_selection.get_neighbors_for_view(i);
+            }));
+    }
+    if (!selection_tasks.empty()) {
+        std::cout << "Running view selection for "
+                  << selection_tasks.size() << " views... " << std::flush;
+        util::WallTimer timer;
+        WaitForAll(selection_tasks);
+        std::cout << " done, took " << timer.get_elapsed_sec()
+                  << "s." << std::endl;
+    }
+
+    std::vector<int> skipped;
+    std::vector<int> final_reconstruction_list;
+    std::vector<mve::Scene::ViewList> final_view_neighbors;
+    for (std::size_t v = 0; v < reconstruction_list.size(); ++v)
+        if (view_neighbors[v].size() < view_select_opts.num_neighbors)
+            skipped.push_back(reconstruction_list[v]);
+        else {
+            final_reconstruction_list.push_back(reconstruction_list[v]);
+            final_view_neighbors.push_back(view_neighbors[v]);
+        }
+    if (!skipped.empty()) {
+        std::cout << "Skipping " << skipped.size() << " views with "
+                  << "insufficient number of neighbors." << std::endl;
+        std::cout << "Skipped IDs: ";
+        for (std::size_t s = 0; s < skipped.size(); ++s) {
+            std::cout << skipped[s] << " ";
+            if (s > 0 && s % 12 == 0)
+                std::cout << std::endl << "     ";
+        }
+        std::cout << std::endl;
+    }
+    reconstruction_list = final_reconstruction_list;
+    view_neighbors = final_view_neighbors;
+
+    /* Pairs the SGM depth is fused from and how many run at once. */
+    std::size_t sgm_pairs = view_select_opts.num_neighbors;
+    if (m_sgm_opts.num_pairs > 0)
+        sgm_pairs = std::min(sgm_pairs, m_sgm_opts.num_pairs);
+    std::size_t sgm_threads = sgm_pairs;
+    if (m_sgm_opts.num_threads > 0)
+        sgm_threads = std::min(sgm_threads, static_cast<std::size_t>(m_sgm_opts.num_threads));
+
+    bool useShading = true;
+    smvs::DepthOptimizer::Options do_opts;
+    do_opts.regularization = 0.01;
+    do_opts.num_iterations = 5;
+    do_opts.min_scale = 2;
+    do_opts.output_name = dm_name;
+    do_opts.sgm_name = sgmName;
+    do_opts.use_sgm = true;
+    do_opts.use_shading = useShading;
+
+    /* Skip views whose depth was computed from the same inputs, the others
+     * drop their old SGM depth as it is only checked by size below. */
+    std::map<int, std::uint64_t> input_hashes;
+    auto input_hash = [&](const mve::View::Ptr &view) {
+      auto it = input_hashes.find(view->get_id());
+      if (it == input_hashes.end())
+          it = input_hashes.emplace(view->get_id(), InputHash(view, input_name, scale)).first;
+      return it->second;
+    };
+    const std::string &output_name = noOptimize ? sgmName : dm_name;
+    std::vector<std::uint64_t> view_hashes;
+    final_reconstruction_list.clear();
+    final_view_neighbors.clear();
+    for (std::size_t v = 0; v < reconstruction_list.size(); ++v) {
+        mve::View::Ptr view = views[reconstruction_list[v]];
+        ContentHash hash;
+        hash.AddValue(SGM_CACHE_VERSION).AddValue(scale).AddValue(noOptimize).Add(sgmName);
+        hash.AddValue(sgm_pairs).AddValue(static_cast<int>(m_sgm_opts.fusion));
+        hash.AddValue(do_opts.regularization).AddValue(do_opts.num_iterations)
+            .AddValue(do_opts.min_scale).AddValue(do_opts.use_sgm).AddValue(do_opts.use_shading);
+        AddCameraHash(&hash, view->get_camera());
+        hash.AddValue(input_hash(view));
+        for (std::size_t n = 0; n < view_select_opts.num_neighbors
+            && n < view_neighbors[v].size(); ++n) {
+            hash.AddValue(view_neighbors[v][n]->get_id());
+            AddCameraHash(&hash, view_neighbors[v][n]->get_camera());
+            hash.AddValue(input_hash(view_neighbors[v][n]));
+        }
+        const std::string key = "smvs/" + dm_name + "/" + util::string::get(view->get_id());
+        if (view->has_image(output_name) && m_cache->IsValid(key, hash.Get()))
+            continue;
+        view->remove_image(sgmName);
+        view->remove_image(dm_name);
+        final_reconstruction_list.push_back(reconstruction_list[v]);
+        final_view_neighbors.push_back(view_neighbors[v]);
+        view_hashes.push_back(hash.Get());
+    }
+    if (final_reconstruction_list.size() < reconstruction_list.size())
+        std::cout << reconstruction_list.size() - final_reconstruction_list.size()
+                  << " views are up to date, skipping them." << std::endl;
+    reconstruction_list = final_reconstruction_list;
+    view_neighbors = final_view_neighbors;
+
+    /* Create input embedding and resize */
+    std::set<int> check_embedding_list;
+    for (std::size_t v = 0; v < reconstruction_list.size(); ++v) {
+        check_embedding_list.insert(reconstruction_list[v]);
+        for (auto &neighbor : view_neighbors[v])
+            check_embedding_list.insert(neighbor->get_id());
+    }
+
+    Util::resizeViews(views, check_embedding_list, input_name, scale);
+
+    std::size_t const num_threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    std::vector<std::size_t> const order = NeighborLocalOrder(reconstruction_list, view_neighbors, num_threads);
+    final_reconstruction_list.clear();
+    final_view_neighbors.clear();
+    std::vector<std::uint64_t> final_view_hashes;
+    for (std::size_t v : order) {
+        final_reconstruction_list.push_back(reconstruction_list[v]);
+        final_view_neighbors.push_back(view_neighbors[v]);
+        final_view_hashes.push_back(view_hashes[v]);
+    }
+    reconstruction_list.swap(final_reconstruction_list);
+    view_neighbors.swap(final_view_neighbors);
+    view_hashes.swap(final_view_hashes);
+    std::size_t const budget = m_memory_budget != 0 ? m_memory_budget : MemoryBudget::DefaultBudget();
+    std::size_t const cache_budget = budget / STEREO_VIEW_CACHE_SHARE;
+    StereoViewCache stereo_view_cache(input_name, cache_budget);
+    MemoryBudget memory_budget(budget - cache_budget);
+
+    std::vector<std::future<void>> results;
+    std::mutex counter_mutex;
+    std::size_t started = 0;
+    std::size_t finished = 0;
+    util::WallTimer timer;
+
+    for (std::size_t v = 0; v < reconstruction_list.size(); ++v) {
+        int const i = reconstruction_list[v];
+        results.emplace_back(thread_pool.add_task(
+            [v, i, &views, &counter_mutex, &opt, &input_name, &dm_name, &sgmName,
+                &started, &finished, &reconstruction_list, &view_neighbors, &view_select_opts, &useShading,
+                &noOptimize, &do_opts, &view_hashes, &stereo_view_cache, &memory_budget, &sgm_threads,
+                this] {
+              const std::string key = "smvs/" + dm_name + "/" + util::string::get(i);
+              if (IsCancelled())
+                  return;
+              mve::View::ImageProxy const *proxy = views[i]->get_image_proxy(input_name);
+              MemoryBudget::Admission admission(memory_budget,
+                                                EstimateSMVSBytes(proxy->width, proxy->height, proxy->channels,
+                                                                  opt, sgm_threads));
+              if (IsCancelled())
+                  return;
+              smvs::StereoView::Ptr main_view = smvs::StereoView::create(views[i], input_name, useShading);
+              mve::Scene::ViewList neighbors = view_neighbors[v];
+
+              std::vector<smvs::StereoView::Ptr> stereo_views;
+
+              std::unique_lock<std::mutex> lock(counter_mutex);
+              std::cout << "\rStarting "
+                        << ++started << "/" << reconstruction_list.size()
+                        << " ID: " << i
+                        << " Neighbors: ";
+              for (std::size_t n = 0; n < view_select_opts.num_neighbors
+                  && n < neighbors.size(); ++n)
+                  std::cout << neighbors[n]->get_id() << " ";
+              std::cout << std::endl;
+              lock.unlock();
+
+              for (std::size_t n = 0; n < view_select_opts.num_neighbors
+                  && n < neighbors.size(); ++n) {
+                  stereo_views.push_back(stereo_view_cache.Get(neighbors[n]));
+              }
+
+              int sgm_width = views[i]->get_image_proxy(input_name)->width;
+              int sgm_height = views[i]->get_image_proxy(input_name)->height;
+              sgm_width = (sgm_width + 1) / 2;
+              sgm_height = (sgm_height + 1) / 2;
+              if (!views[i]->has_image(sgmName)
+                  || views[i]->get_image_proxy(sgmName)->width !=
+                      sgm_width
+                  || views[i]->get_image_proxy(sgmName)->height !=
+                      sgm_height)
+                  Util::reconstructSGMDepthForView(opt, sgmName, main_view, stereo_views,
+                                                   m_pScene->get_bundle(), m_sgm_opts);
+
+              if (noOptimize) {
+                  m_cache->Record(key, view_hashes[v]);
+                  std::lock_guard<std::mutex> lock2(counter_mutex);
+                  ReportProgress(++finished, reconstruction_list.size());
+                  return;
+              }
+
+              smvs::DepthOptimizer optimizer(main_view, stereo_views,
+                                                m_pScene->get_bundle(), do_opts);
+              optimizer.optimize();
+              m_cache->Record(key, view_hashes[v]);
+
+              std::unique_lock<std::mutex> lock2(counter_mutex);
+              std::cout << "\rFinished "
+                        << ++finished << "/" << reconstruction_list.size()
+                        << " ID: " << i
+                        << std::endl;
+              ReportProgress(finished, reconstruction_list.size());
+              lock2.unlock();
+            }));
+    }
+    /* Wait for reconstruction to finish */
+    WaitForAll(results);
+    StereoViewCache::Stats const cache_stats = stereo_view_cache.GetStats();
+    std::cout << "Reconstruction took "
+              << total_timer.get_elapsed() << "ms." << std::endl;
+    PrintBudgetStats(memory_budget);
+    std::cout << "Neighbor views loaded " << cache_stats.misses << " times for "
+              << cache_stats.hits + cache_stats.misses << " uses, " << cache_stats.evictions
+              << " evicted, peak " << (cache_stats.peak_bytes >> 20) << " MB." << std::endl;
+    std::cout << "Saving views back to disc..." << std::endl;
+    m_pScene->save_views();
+    m_cache->Save();
+    CheckCancelled();
+}
+
+void Pipeline::MeshReconstruction(bool shading) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string input_name;
+    std::string output_name;
+    std::string dm_name = "smvs-visual-B" + util::string::get(m_scale);
+    if (!shading) {
+        input_name = "merged-mvs";
+        output_name = "thermal-mvs";
+        m_point_set = GeneratePointSet(output_name, input_name, dm_name, false);
+    } else {
+        input_name = "merged-smvs";
+        output_name = "thermal-shading";
+        m_point_set = GeneratePointSet(output_name, input_name, dm_name, true);
+    }
+}
+
+/** The calibration file named in the options, or the one of the scene. */
+static math::Matrix4f LoadSceneCalibration(const mve::Scene::Ptr &scene, const std::string &path) {
+    if (!path.empty())
+        return Thermal::LoadCalibration(path);
+    return Thermal::LoadCalibration(util::fs::join_path(scene->get_path(), THERMAL_CALIBRATION_FILE));
+}
+
+void Pipeline::CalibrateThermal(const std::string &thermal_dir, const std::string &visual_dir,
+                                const Thermal::GridOptions &grid) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string const visual_name = m_scale != 0 ? "undist-L" + util::string::get(m_scale)
+                                                 : std::string(UNDISTORTED_IMAGE_NAME);
+    mve::View::ImageProxy const *input = nullptr;
+    for (const auto &view : m_pScene->get_views())
+        if (view != nullptr && (input = view->get_image_proxy(visual_name)) != nullptr)
+            break;
+    if (input == nullptr)
+        throw std::runtime_error("No view has a \"" + visual_name + "\" image, "
+                                 "run the structure from motion first.");
+    int const input_width = input->width;
+    int const input_height = input->height;
+
+    /* The scripts pair the images by their order, which is the order of the
+     * shared file names. */
+    std::vector<std::string> names;
+    util::fs::Directory dir(thermal_dir);
+    std::sort(dir.begin(), dir.end());
+    for (auto const &file : dir) {
+        if (!file.is_dir && util::fs::file_exists(util::fs::join_path(visual_dir, file.name).c_str()))
+            names.push_back(file.name);
+    }
+    if (names.empty())
+        throw std::runtime_error("No calibration images in both " + thermal_dir + " and " + visual_dir);
+
+    util::WallTimer timer;
+    std::size_t const num_images = names.size();
+    std::vector<std::vector<math::Vec2d>> thermal_points(num_images), visual_points(num_images);
+    std::vector<std::vector<math::Vec3d>> thermal_board(num_images), visual_board(num_images);
+    int thermal_size[2] = {0, 0}, visual_size[2] = {0, 0};
+    Thermal::GridOptions thermal_grid = grid;
+    thermal_grid.dark_dots = !grid.dark_dots;
+
+    ThreadPool thread_pool(std::max<std::size_t>(std::thread::hardware_concurrency(), 1));
+    std::vector<std::future<void>> tasks;
+    std::atomic_size_t num_done(0);
+    std::mutex mutex;
+    for (std::size_t job = 0; job < 2 * num_images; ++job) {
+        tasks.emplace_back(thread_pool.add_task([&, job] {
+          if (IsCancelled())
+              return;
+          bool const thermal = job < num_images;
+          std::size_t const i = job % num_images;
+          std::string const path = util::fs::join_path(thermal ? thermal_dir : visual_dir, names[i]);
+          mve::ByteImage::Ptr image = mve::image::load_file(path);
+          std::vector<math::Vec2d> centers;
+          std::vector<math::Vec3d> board;
+          bool const found = Thermal::DetectCircleGrid(image, thermal ? thermal_grid : grid, &centers, &board);
+          {
+              std::lock_guard<std::mutex> lock(mutex);
+              int *size = thermal ? thermal_size : visual_size;
+              if (size[0] != 0 && (size[0] != image->width() || size[1] != image->height()))
+                  throw std::runtime_error("Calibration images differ in size: " + path);
+              size[0] = image->width();
+              size[1] = image->height();
+              if (!found)
+                  std::cout << "No circle grid found in " << path << std::endl;
+          }
+          if (found) {
+              (thermal ? thermal_points : visual_points)[i].swap(centers);
+              (thermal ? thermal_board : visual_board)[i].swap(board);
+          }
+          ReportProgress(++num_done, 2 * num_images);
+        }));
+    }
+    WaitForAll(tasks);
+    CheckCancelled();
+
+    Thermal::CameraCalibration const thermal = Thermal::CalibrateCamera(thermal_points, thermal_board,
+                                                                        thermal_size[0], thermal_size[1]);
+    Thermal::CameraCalibration const visual = Thermal::CalibrateCamera(visual_points, visual_board,
+                                                                       visual_size[0], visual_size[1]);
+    for (auto const *calib : {&thermal, &visual}) {
+        std::cout << (calib == &thermal ? "Thermal" : "Visual") << " camera: focal length "
+                  << calib->fx << " " << calib->fy << ", principal point " << calib->cx << " "
+                  << calib->cy << ", distortion " << calib->k1 << " " << calib->k2
+                  << ", reprojection error " << calib->rms << " px" << std::endl;
+    }
+
+    math::Matrix4d const W = Thermal::ThermalVisualTransform(visual, thermal, input_width, input_height);
+    std::string const path = util::fs::join_path(m_pScene->get_path(), THERMAL_CALIBRATION_FILE);
+    Thermal::SaveCalibration(path, W);
+    std::cout << "Saved the thermal calibration of " << num_images << " image pairs to " << path
+              << ", took " << timer.get_elapsed() << " ms." << std::endl;
+}
+
+float Pipeline::EstimateThermalScale(const std::string &calibration_path,
+                                     const ScaleEstimator::Options &options) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string const visual_name = m_scale != 0 ? "undist-L" + util::string::get(m_scale)
+                                                 : std::string(UNDISTORTED_IMAGE_NAME);
+    std::string const dm_name = "smvs-visual-B" + util::string::get(m_scale);
+    std::string const thermal_dm_name = "smvs-thermal-SGM";
+    ScaleEstimator estimator(options, LoadSceneCalibration(m_pScene, calibration_path));
+
+    std::vector<mve::View::Ptr> scale_views;
+    for (const auto &view : m_pScene->get_views()) {
+        if (view != nullptr && view->has_image(visual_name) && view->has_image(THERMAL_IMAGE_NAME)
+            && view->has_image(dm_name) && view->has_image(thermal_dm_name))
+            scale_views.push_back(view);
+    }
+    if (scale_views.empty())
+        throw std::runtime_error("No view has visual and thermal depth maps, "
+                                 "run both shading reconstructions first.");
+
+    util::WallTimer timer;
+    std::vector<ScaleEstimator::ViewScale> scales(scale_views.size());
+    std::vector<char> valid(scale_views.size(), 0);
+    ThreadPool thread_pool(std::max<std::size_t>(std::thread::hardware_concurrency(), 1));
+    std::vector<std::future<void>> tasks;
+    std::atomic_size_t num_done(0);
+    std::mutex mutex;
+    for (std::size_t v = 0; v < scale_views.size(); ++v) {
+        tasks.emplace_back(thread_pool.add_task([&, v] {
+          if (IsCancelled())
+              return;
+          mve::View::Ptr const &view = scale_views[v];
+          mve::View::ImageProxy const *visual = view->get_image_proxy(visual_name);
+          mve::View::ImageProxy const *thermal = view->get_image_proxy(THERMAL_IMAGE_NAME);
+          mve::FloatImage::Ptr depth = view->get_float_image(dm_name);
+          mve::FloatImage::Ptr thermal_depth = view->get_float_image(thermal_dm_name);
+          if (depth != nullptr && thermal_depth != nullptr) {
+              scales[v] = estimator.EstimateView(view->get_id(), depth, visual->width, visual->height,
+                                                 thermal_depth, thermal->width, thermal->height);
+              valid[v] = 1;
+              std::lock_guard<std::mutex> lock(mutex);
+              std::cout << "View ID " << view->get_id() << ": scale " << scales[v].scale
+                        << ", score " << scales[v].score << std::endl;
+          }
+          view->cache_cleanup();
+          ReportProgress(++num_done, scale_views.size());
+        }));
+    }
+    WaitForAll(tasks);
+    CheckCancelled();
+
+    std::vector<ScaleEstimator::ViewScale> valid_scales;
+    for (std::size_t v = 0; v < scales.size(); ++v)
+        if (valid[v])
+            valid_scales.push_back(scales[v]);
+    if (valid_scales.empty())
+        throw std::runtime_error("No depth maps could be loaded for scale estimation.");
+    float const scale = estimator.Consensus(valid_scales);
+    std::cout << "Estimated depth scale " << scale << " from " << valid_scales.size()
+              << " views, took " << timer.get_elapsed() << " ms." << std::endl;
+    return scale;
+}
+
+void Pipeline::ReprojectThermal(bool shading, const ReprojectionOptions &options) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string visual_name = m_scale != 0 ? "undist-L" + util::string::get(m_scale)
+                                           : std::string(UNDISTORTED_IMAGE_NAME);
+    std::string dm_name;
+    std::string output_name;
+    if (shading) {
+        dm_name = "smvs-visual-B" + util::string::get(m_scale);
+        output_name = "merged-smvs";
+    } else {
+        dm_name = "depth-visual-L" + util::string::get(m_scale);
+        output_name = "merged-mvs";
+    }
+    math::Matrix4f const W = LoadSceneCalibration(m_pScene, options.calibration_path);
+
+    ContentHash stage_hash;
+    stage_hash.Add(W.begin(), 16 * sizeof(float));
+    stage_hash.AddValue(options.depth_scale).AddValue(options.thermal_weight);
+
+    util::WallTimer timer;
+    mve::Scene::ViewList &views(m_pScene->get_views());
+    std::size_t num_threads = options.num_threads > 0
+                              ? static_cast<std::size_t>(options.num_threads)
+                              : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    std::vector<mve::View::Ptr> merge_views;
+    for (const auto &view : views) {
+        if (view != nullptr && view->has_image(THERMAL_IMAGE_NAME)
+            && view->has_image(visual_name) && view->has_image(dm_name))
+            merge_views.push_back(view);
+    }
+
+    ThreadPool thread_pool(num_threads);
+    std::vector<std::future<void>> tasks;
+    std::atomic_size_t num_done(0);
+    std::atomic_int num_merged(0);
+    for (const auto &view : merge_views) {
+        tasks.emplace_back(thread_pool.add_task([&, view] {
+          if (IsCancelled())
+              return;
+          ContentHash hash = stage_hash;
+          hash.AddValue(EmbeddingHash(view, visual_name));
+          hash.AddValue(EmbeddingHash(view, THERMAL_IMAGE_NAME));
+          hash.AddValue(EmbeddingHash(view, dm_name));
+          const std::string key = "merged/" + output_name + "/" + util::string::get(view->get_id());
+          if (!view->has_image(output_name) || !m_cache->IsValid(key, hash.Get())) {
+              mve::ByteImage::Ptr visual = view->get_byte_image(visual_name);
+              mve::ByteImage::Ptr thermal = view->get_byte_image(THERMAL_IMAGE_NAME);
+              mve::FloatImage::Ptr depth = view->get_float_image(dm_name);
+              if (visual != nullptr && thermal != nullptr && depth != nullptr) {
+                  mve::ByteImage::Ptr mapped = Thermal::ReprojectImage(thermal, depth, W, options.depth_scale,
+                                                                       visual->width(), visual->height());
+                  view->set_image(Thermal::BlendImages(visual, mapped, options.thermal_weight), output_name);
+                  view->save_view();
+                  m_cache->Record(key, hash.Get());
+                  ++num_merged;
+              }
+          }
+          view->cache_cleanup();
+          ReportProgress(++num_done, merge_views.size());
+        }));
+    }
+    WaitForAll(tasks);
+    m_cache->Save();
+    CheckCancelled();
+    std::cout << "Reprojected thermal images of " << num_merged << " views into \""
+              << output_name << "\", took " << timer.get_elapsed() << " ms." << std::endl;
+}
+
+std::uint64_t Pipeline::InputHash(const mve::View::Ptr &view,
+                                  const std::string &input_name, int scale) {
+    if (scale == 0)
+        return EmbeddingHash(view, input_name);
+
+    /* Downscaled inputs are only created if missing, so drop them once the
+     * undistorted image they come from changes. */
+    std::uint64_t hash = EmbeddingHash(view, UNDISTORTED_IMAGE_NAME);
+    const std::string key = "input/" + input_name + "/" + util::string::get(view->get_id());
+    if (view->has_image(input_name) && !m_cache->IsValid(key, hash))
+        view->remove_image(input_name);
+    m_cache->Record(key, hash);
+    return hash;
+}
+
+PointCloud::Ptr Pipeline::GeneratePointSet(const std::string &output_name,
+                                           const std::string &input_name,
+                                           const std::string &dm_name,
+                                           bool smvs) {
+    ContentHash hash;
+    hash.AddValue(smvs).AddValue(m_scale);
+    for (const auto &view : m_pScene->get_views()) {
+        if (view == nullptr)
+            continue;
+        hash.AddValue(view->get_id());
+        AddCameraHash(&hash, view->get_camera());
+        hash.AddValue(EmbeddingHash(view, dm_name));
+        hash.AddValue(EmbeddingHash(view, input_name));
+    }
+    const std::string key = "pointset/" + output_name;
+    const std::string path = Util::PointSetPath(m_pScene, output_name);
+    if (util::fs::file_exists(path.c_str()) && !m_cache->IsValid(key, hash.Get())) {
+        std::cout << "Point set inputs changed, removing " << path << std::endl;
+        m_point_set.reset();
+        std::remove(path.c_str());
+    }
+
+    PointCloud::Ptr point_set;
+    if (smvs)
+        point_set = Util::GenerateMeshSMVS(m_pScene, input_name, dm_name, output_name, false, m_point_set_opts);
+    else
+        point_set = Util::GenerateMesh(m_pScene, input_name, dm_name, m_scale, output_name, m_point_set_opts);
+    m_cache->Record(key, hash.Get());
+    m_cache->Save();
+    return point_set;
+}
+
+mve::TriangleMesh::Ptr Pipeline::SurfaceReconstruction() {
+    if (m_pScene == nullptr)
+        throw std::runtime_error("No scene loaded");
+
+    std::string mesh_name = util::fs::join_path(m_pScene->get_path(), "surface.ply");
+    if (m_point_set == nullptr)
+        throw std::runtime_error("No point set loaded");
+    ContentHash hash;
+    hash.AddValue(PointSetHash(*m_point_set)).AddValue(m_surface_opts.partitioned);
+    if (m_surface_opts.partitioned) {
+        hash.AddValue(m_surface_opts.partition.max_block_samples);
+        hash.AddValue(m_surface_opts.partition.overlap);
+    }
+    const std::string key = "surface";
+    if (util::fs::file_exists(mesh_name.c_str()) && !m_cache->IsValid(key, hash.Get())) {
+        std::cout << "Surface inputs changed, removing " << mesh_name << std::endl;
+        std::remove(mesh_name.c_str());
+    }
+
+    mve::TriangleMesh::Ptr mesh;
+    if (!util::fs::file_exists(mesh_name.c_str())) {
+        util::WallTimer total_timer;
+        /* The columns are read in place, mapped point sets are never copied. */
+        if (m_surface_opts.partitioned)
+            mesh = ExtractPartitionedSurface(*m_point_set);
+        else
+            mesh = ExtractSurface(*m_point_set);
+        CheckCancelled();
+
+        /* Check if anything has been extracted. */
+        if (mesh->get_vertices().empty())
+            throw std::runtime_error("Isosurface does not contain any vertices.");
+
+        /* Check for color and delete if not existing. */
+        mve::TriangleMesh::ColorList& colors = mesh->get_vertex_colors();
+        if (!colors.empty() && colors[0].minimum() < 0.0f)
+        {
+            std::cout << "Removing dummy mesh coloring..." << std::endl;
+            colors.clear();
+        }
+
+        /* Surfaces between voxels with zero confidence are ghosts, low
+         * confidence geometry and small isolated components go with them. */
+        {
+            MeshCleanup::Options options;
+            std::cout << "Removing low-confidence geometry (threshold "
+                      << options.confidence_threshold << ") and isolated components below "
+                      << options.component_threshold << " vertices..." << std::endl;
+            util::WallTimer timer;
+            MeshCleanup::Stats const stats = MeshCleanup::Apply(*mesh, options);
+            std::cout << "  Deleted " << stats.low_confidence << " low-confidence vertices and "
+                      << stats.isolated << " vertices in isolated regions, took "
+                      << timer.get_elapsed() << "ms." << std::endl;
+        }
+        CheckCancelled();
+
+        {
+            std::cout << "Removing degenerated faces..." << std::endl;
+            std::size_t num_collapsed = fssr::clean_mc_mesh(mesh);
+            std::cout << "  Collapsed " << num_collapsed << " edges." << std::endl;
+        }
+        /* Write output mesh. */
+        mve::geom::SavePLYOptions ply_opts;
+        ply_opts.write_vertex_colors = true;
+        ply_opts.write_vertex_confidences = true;
+        ply_opts.write_vertex_values = true;
+        std::cout << "Mesh output file: " << "surface.ply" << std::endl;
+        mve::geom::save_ply_mesh(mesh, mesh_name, ply_opts);
+        m_cache->Record(key, hash.Get());
+        m_cache->Save();
+        std::cout << "Mesh reconstruction took " << total_timer.get_elapsed_sec() << "seconds."<< std::endl;
+    } else {
+        mesh = mve::geom::load_ply_mesh(mesh_name);
+    }
+    return mesh;
+}
+
+mve::TriangleMesh::Ptr Pipeline::ExtractSurface(const PointCloud &points) {
+    fssr::IsoOctree octree;
+    const math::Vec3f *verts = points.GetPositions();
+    const math::Vec3f *vnormals = points.GetNormals();
+    const math::Vec3f *vcolors = points.GetColors();
+    const float *vvalues = points.GetScales();
+    const float *vconfs = points.GetConfidences();
+
+    /* Add samples to the list. */
+    for (std::size_t i = 0; i < points.GetSize(); i += 1)
+    {
+        fssr::Sample sample;
+        // not sampling black area
+        if (!SurfacePartition::IsSample(vcolors[i])) {
+            continue;
+        }
+        sample.pos = verts[i];
+        sample.normal = vnormals[i];
+        sample.scale = vvalues[i];
+        sample.confidence = vconfs[i];
+        sample.color = vcolors[i];
+
+        octree.insert_sample(sample);
+    }
+
+    /* Fail if no samples have been inserted. */
+    if (octree.get_num_samples() == 0)
+        throw std::runtime_error("Octree does not contain any samples.");
+
+    CheckCancelled();
+    ReportProgress(1, 4);
+
+    /* Compute voxels. */
+    octree.limit_octree_level();
+    octree.print_stats(std::cout);
+    octree.compute_voxels();
+    octree.clear_samples();
+    CheckCancelled();
+    ReportProgress(2, 4);
+
+    /* Extract isosurface. */
+    mve::TriangleMesh::Ptr mesh;
+    {
+        std::cout << "Extracting isosurface..." << std::endl;
+        util::WallTimer timer;
+        fssr::IsoSurface iso_surface(&octree, fssr::INTERPOLATION_CUBIC);
+        mesh = iso_surface.extract_mesh();
+        std::cout << "  Done. Surface extraction took "
+                  << timer.get_elapsed() << "ms." << std::endl;
+    }
+    octree.clear();
+    ReportProgress(3, 4);
+    return mesh;
+}
+
+mve::TriangleMesh::Ptr Pipeline::ExtractPartitionedSurface(const PointCloud &points) {
+    util::WallTimer timer;
+    SurfacePartition const partition(points, m_surface_opts.partition);
+    std::size_t const num_blocks = partition.GetNumBlocks();
+    std::size_t num_block_samples = 0, max_block_samples = 0;
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        num_block_samples += partition.GetBlock(b).samples.size();
+        max_block_samples = std::max(max_block_samples, partition.GetBlock(b).samples.size());
+    }
+    std::cout << "Partitioned the point set into " << num_blocks << " blocks of up to "
+              << max_block_samples << " samples, " << num_block_samples
+              << " block samples in total and " << partition.GetNumAnchors() << " anchors in every block."
+              << std::endl;
+
+    std::vector<mve::TriangleMesh::Ptr> meshes(num_blocks);
+    std::atomic_size_t num_done(0);
+    std::exception_ptr error;
+    MemoryBudget memory_budget(m_memory_budget);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        if (IsCancelled())
+            continue;
+        try {
+            MemoryBudget::Admission admission(memory_budget,
+                                              SurfacePartition::EstimateBytes(partition.GetBlock(b).samples.size()));
+            if (IsCancelled())
+                continue;
+            meshes[b] = partition.MeshBlock(b);
+        }
+        catch (...) {
+#pragma omp critical
+            if (error == nullptr)
+                error = std::current_exception();
+        }
+        ReportProgress(++num_done, num_blocks + 1);
+    }
+    if (error != nullptr)
+        std::rethrow_exception(error);
+    CheckCancelled();
+    PrintBudgetStats(memory_budget);
+
+    mve::TriangleMesh::Ptr mesh = partition.Stitch(meshes);
+    std::cout << "Meshing and stitching the blocks took "
+              << timer.get_elapsed() << "ms." << std::endl;
+    ReportProgress(num_blocks + 1, num_blocks + 1);
+    return mesh;
+}
+
+void Pipeline::DepthReconMVS(bool thermal) {
+    if (m_pScene == nullptr || m_pScene->get_views().empty())
+        throw std::runtime_error("No scene loaded");
+
+    std::string input_name;
+    std::string dm_name;
+    std::string ply_name;
+    if (!thermal) {
+        if (m_scale != 0)
+            input_name = "undist-L" + std::to_string(m_scale);
+        else
+            input_name = "undistorted";
+        dm_name = "depth-visual-L"
+            + util::string::get(m_scale);
+        ply_name = "point-set-visual.ply";
+    } else {
+        input_name = THERMAL_IMAGE_NAME;
+        dm_name = "depth-thermal-L"
+            + util::string::get(m_scale);
+        ply_name = "point-set-thermal.ply";
+    }
+    util::WallTimer timer;
+    mve::Scene::ViewList &views(m_pScene->get_views());
+    /* DMRecon picks the neighbors from the bundle, so it is hashed as a whole
+     * together with the reference view's input. */
+    ContentHash bundle_hash;
+    bundle_hash.AddFile(util::fs::join_path(m_pScene->get_path(), "synth_0.out"));
+    bundle_hash.Add(input_name).Add(dm_name).AddValue(m_scale);
+    std::atomic_size_t num_done(0);
+    MemoryBudget memory_budget(m_memory_budget);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (std::size_t id = 0; id < views.size(); ++id) {
+        ReportProgress(num_done++, views.size());
+        if (IsCancelled())
+            continue;
+        if (views[id] == nullptr || !views[id]->is_camera_valid())
+            continue;
+
+        ContentHash view_hash = bundle_hash;
+        view_hash.AddValue(InputHash(views[id], input_name, m_scale));
+        const std::string key = "mvs/" + dm_name + "/" + util::string::get(id);
+        if (views[id]->has_image(dm_name)) {
+            if (m_cache->IsValid(key, view_hash.Get()))
+                continue;
+            views[id]->remove_image(dm_name);
+        }
+
+        if (!views[id]->has_image(input_name)) {
+            if (!views[id]->has_image(UNDISTORTED_IMAGE_NAME)) {
+                continue;
+            } else if (m_scale != 0) {
+                Util::resizeView(views[id], input_name, m_scale);
+            }
+        }
+
+        /* Setup MVS. */
+        mvs::Settings settings;
+        settings.refViewNr = id;
+        settings.imageEmbedding = input_name;
+        settings.dmName = dm_name;
+
+        mve::View::ImageProxy const *proxy = views[id]->get_image_proxy(input_name);
+        if (proxy == nullptr)
+            continue;
+        MemoryBudget::Admission admission(memory_budget,
+                                          EstimateMVSBytes(proxy->width, proxy->height, proxy->channels,
+                                                           settings.globalVSMax));
+        if (IsCancelled())
+            continue;
+        try {
+            mvs::DMRecon recon(m_pScene, settings);
+            recon.start();
+            m_cache->Record(key, view_hash.Get());
+        }
+        catch (std::exception &err) {
+            std::cerr << err.what() << std::endl;
+        }
+    }
+    std::cout << "Reconstruction took "
+              << timer.get_elapsed() << "ms." << std::endl;
+    PrintBudgetStats(memory_budget);
+    std::cout << "Saving views back to disc..." << std::endl;
+    m_pScene->save_views();
+    m_cache->Save();
+    CheckCancelled();
+
+    m_point_set = GeneratePointSet(ply_name, input_name, dm_name, false);
+}
@@ -0,0 +1,305 @@
+#include "PointCloud.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(WITH_LZ4)
+#include <lz4.h>
+#endif
+
+/** The header and the arrays are written in host order, which is little
+ * endian on all targets. */
+static const char POINT_CLOUD_MAGIC[8] = {'M', 'V', 'P', 'C', 'L', 'O', 'U', 'D'};
+static const std::uint32_t POINT_CLOUD_VERSION = 1;
+
+enum ColumnCodec {
+    CODEC_RAW = 0,
+    /** Chunk sizes as uint64 followed by the LZ4 blocks of the chunks */
+    CODEC_LZ4 = 1
+};
+
+static std::size_t AlignColumn(std::size_t offset) {
+    return (offset + PointCloud::COLUMN_ALIGNMENT - 1) / PointCloud::COLUMN_ALIGNMENT * PointCloud::COLUMN_ALIGNMENT;
+}
+
+/** Read only view of a file, private pages are copied on write. */
+class PointCloud::Mapping {
+public:
+    explicit Mapping(const std::string &path) : m_data(nullptr), m_size(0) {
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Cannot open " + path);
+        LARGE_INTEGER size;
+        m_map = nullptr;
+        if (GetFileSizeEx(m_file, &size) && size.QuadPart > 0)
+            m_map = CreateFileMappingA(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (m_map != nullptr)
+            m_data = static_cast<unsigned char *>(MapViewOfFile(m_map, FILE_MAP_COPY, 0, 0, 0));
+        if (m_data == nullptr) {
+            if (m_map != nullptr)
+                CloseHandle(m_map);
+            CloseHandle(m_file);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        m_size = static_cast<std::size_t>(size.QuadPart);
+#else
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + path);
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Cannot map " + path);
+        m_data = static_cast<unsigned char *>(data);
+        m_size = static_cast<std::size_t>(st.st_size);
+#endif
+    }
+
+    ~Mapping() {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_map);
+        CloseHandle(m_file);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
+
+    unsigned char *Data() const { return m_data; }
+
+    std::size_t Size() const { return m_size; }
+private:
+    unsigned char *m_data;
+    std::size_t m_size;
+#if defined(_WIN32)
+    HANDLE m_file;
+    HANDLE m_map;
+#endif
+};
+
+PointCloud::PointCloud() : m_size(0), m_columns() {
+}
+
+PointCloud::~PointCloud() = default;
+
+std::size_t PointCloud::ElementBytes(Column column) {
+    switch (column) {
+    case COLUMN_POSITION:
+    case COLUMN_NORMAL:
+    case COLUMN_COLOR:return 3 * sizeof(float);
+    case COLUMN_SCALE:
+    case COLUMN_CONFIDENCE:return sizeof(float);
+    default:throw std::invalid_argument("Unknown point cloud column");
+    }
+}
+
+PointCloud::FileHeader PointCloud::RawHeader(std::size_t num_points) {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, POINT_CLOUD_MAGIC, sizeof(header.magic));
+    header.version = POINT_CLOUD_VERSION;
+    header.num_columns = NUM_COLUMNS;
+    header.num_points = num_points;
+    std::size_t offset = AlignColumn(sizeof(FileHeader));
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        header.columns[c].offset = offset;
+        header.columns[c].bytes = num_points * ElementBytes(static_cast<Column>(c));
+        header.columns[c].codec = CODEC_RAW;
+        offset = AlignColumn(offset + header.columns[c].bytes);
+    }
+    return header;
+}
+
+PointCloud::Ptr PointCloud::Create(std::size_t num_points) {
+    Ptr cloud(new PointCloud());
+    cloud->m_size = num_points;
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        cloud->m_owned[c].reset(new unsigned char[num_points * ElementBytes(static_cast<Column>(c))]);
+        cloud->m_columns[c] = cloud->m_owned[c].get();
+    }
+    return cloud;
+}
+
+PointCloud::Ptr PointCloud::FromMesh(const mve::TriangleMesh &mesh) {
+    mve::TriangleMesh::VertexList const &verts(mesh.get_vertices());
+    mve::TriangleMesh::NormalList const &normals(mesh.get_vertex_normals());
+    mve::TriangleMesh::ColorList const &colors(mesh.get_vertex_colors());
+    mve::TriangleMesh::ValueList const &values(mesh.get_vertex_values());
+    mve::TriangleMesh::ConfidenceList const &confs(mesh.get_vertex_confidences());
+    Ptr cloud = Create(verts.size());
+    std::copy(verts.begin(), verts.end(), cloud->GetPositions());
+    if (normals.size() == verts.size())
+        std::copy(normals.begin(), normals.end(), cloud->GetNormals());
+    else
+        std::fill(cloud->GetNormals(), cloud->GetNormals() + verts.size(), math::Vec3f(0.0f));
+    for (std::size_t i = 0; i < verts.size(); ++i)
+        cloud->GetColors()[i] = colors.size() == verts.size() ? math::Vec3f(*colors[i]) : math::Vec3f(-1.0f);
+    if (values.size() == verts.size())
+        std::copy(values.begin(), values.end(), cloud->GetScales());
+    else
+        std::fill(cloud->GetScales(), cloud->GetScales() + verts.size(), 1.0f);
+    if (confs.size() == verts.size())
+        std::copy(confs.begin(), confs.end(), cloud->GetConfidences());
+    else
+        std::fill(cloud->GetConfidences(), cloud->GetConfidences() + verts.size(), 1.0f);
+    return cloud;
+}
+
+mve::TriangleMesh::Ptr PointCloud::ToMesh() const {
+    mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+    mesh->get_vertices().assign(GetPositions(), GetPositions() + m_size);
+    mesh->get_vertex_normals().assign(GetNormals(), GetNormals() + m_size);
+    mve::TriangleMesh::ColorList &colors(mesh->get_vertex_colors());
+    colors.resize(m_size);
+    for (std::size_t i = 0; i < m_size; ++i)
+        colors[i] = math::Vec4f(GetColors()[i], GetColors()[i][0] < 0.0f ? -1.0f : 1.0f);
+    mesh->get_vertex_values().assign(GetScales(), GetScales() + m_size);
+    mesh->get_vertex_confidences().assign(GetConfidences(), GetConfidences() + m_size);
+    return mesh;
+}
+
+void PointCloud::Save(const std::string &path, const SaveOptions &options) const {
+    FileHeader header = RawHeader(m_size);
+    std::vector<unsigned char> coded[NUM_COLUMNS];
+    if (options.compress) {
+#if defined(WITH_LZ4)
+        std::size_t const chunk_points = std::max<std::size_t>(1, options.chunk_points);
+        std::size_t const num_chunks = (m_size + chunk_points - 1) / chunk_points;
+        std::size_t offset = AlignColumn(sizeof(FileHeader));
+        for (int c = 0; c < NUM_COLUMNS; ++c) {
+            std::size_t const element = ElementBytes(static_cast<Column>(c));
+            std::vector<std::vector<char>> chunks(num_chunks);
+#pragma omp parallel for schedule(dynamic)
+            for (std::size_t k = 0; k < num_chunks; ++k) {
+                std::size_t const points = std::min(chunk_points, m_size - k * chunk_points);
+                int const raw_bytes = static_cast<int>(points * element);
+                chunks[k].resize(LZ4_compressBound(raw_bytes));
+                int const bytes = LZ4_compress_default(
+                    reinterpret_cast<const char *>(m_columns[c] + k * chunk_points * element),
+                    chunks[k].data(), raw_bytes, static_cast<int>(chunks[k].size()));
+                chunks[k].resize(static_cast<std::size_t>(std::max(bytes, 0)));
+            }
+            std::vector<std::uint64_t> sizes(num_chunks);
+            for (std::size_t k = 0; k < num_chunks; ++k) {
+                if (chunks[k].empty())
+                    throw std::runtime_error("LZ4 compression failed");
+                sizes[k] = chunks[k].size();
+            }
+            coded[c].resize(num_chunks * sizeof(std::uint64_t));
+            std::memcpy(coded[c].data(), sizes.data(), coded[c].size());
+            for (const auto &chunk : chunks)
+                coded[c].insert(coded[c].end(), chunk.begin(), chunk.end());
+
+            header.columns[c].offset = offset;
+            header.columns[c].bytes = coded[c].size();
+            header.columns[c].codec = CODEC_LZ4;
+            header.columns[c].chunk_points = static_cast<std::uint32_t>(chunk_points);
+            offset = AlignColumn(offset + coded[c].size());
+        }
+#else
+        throw std::runtime_error("Point cloud compression needs a build with LZ4");
+#endif
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    std::size_t position = sizeof(header);
+    static const char padding[COLUMN_ALIGNMENT] = {};
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        out.write(padding, static_cast<std::streamsize>(header.columns[c].offset - position));
+        if (header.columns[c].codec == CODEC_RAW)
+            out.write(reinterpret_cast<const char *>(m_columns[c]), static_cast<std::streamsize>(header.columns[c].bytes));
+        else
+            out.write(reinterpret_cast<const char *>(coded[c].data()), static_cast<std::streamsize>(coded[c].size()));
+        position = header.columns[c].offset + header.columns[c].bytes;
+    }
+    if (!out)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+PointCloud::Ptr PointCloud::Load(const std::string &path) {
+    Ptr cloud(new PointCloud());
+    cloud->m_mapping.reset(new Mapping(path));
+    unsigned char *const data = cloud->m_mapping->Data();
+    std::size_t const size = cloud->m_mapping->Size();
+
+    FileHeader header;
+    if (size < sizeof(header))
+        throw std::runtime_error(path + " is no point cloud");
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, POINT_CLOUD_MAGIC, sizeof(header.magic)) != 0
+        || header.version != POINT_CLOUD_VERSION || header.num_columns != NUM_COLUMNS)
+        throw std::runtime_error(path + " is no point cloud of this version");
+    cloud->m_size = static_cast<std::size_t>(header.num_points);
+
+    bool mapped = false;
+    for (int c = 0; c < NUM_COLUMNS; ++c) {
+        ColumnHeader const &column = header.columns[c];
+        std::size_t const element = ElementBytes(static_cast<Column>(c));
+        std::size_t const raw_bytes = cloud->m_size * element;
+        if (column.offset % COLUMN_ALIGNMENT != 0 || column.offset > size || column.bytes > size - column.offset)
+            throw std::runtime_error(path + " is truncated");
+        if (column.codec == CODEC_RAW) {
+            if (column.bytes != raw_bytes)
+                throw std::runtime_error(path + " has a column of the wrong size");
+            cloud->m_columns[c] = data + column.offset;
+            mapped = true;
+            continue;
+        }
+        if (column.codec != CODEC_LZ4)
+            throw std::runtime_error(path + " has an unknown column codec");
+#if defined(WITH_LZ4)
+        std::size_t const chunk_points = std::max<std::size_t>(1, column.chunk_points);
+        std::size_t const num_chunks = (cloud->m_size + chunk_points - 1) / chunk_points;
+        if (num_chunks * sizeof(std::uint64_t) > column.bytes)
+            throw std::runtime_error(path + " is truncated");
+        std::vector<std::uint64_t> sizes(num_chunks);
+        std::memcpy(sizes.data(), data + column.offset, num_chunks * sizeof(std::uint64_t));
+        std::vector<std::size_t> starts(num_chunks + 1, num_chunks * sizeof(std::uint64_t));
+        for (std::size_t k = 0; k < num_chunks; ++k)
+            starts[k + 1] = starts[k] + static_cast<std::size_t>(sizes[k]);
+        if (starts.back() > column.bytes)
+            throw std::runtime_error(path + " is truncated");
+
+        cloud->m_owned[c].reset(new unsigned char[raw_bytes]);
+        cloud->m_columns[c] = cloud->m_owned[c].get();
+        const char *const src = reinterpret_cast<const char *>(data + column.offset);
+        char *const dst = reinterpret_cast<char *>(cloud->m_columns[c]);
+        std::atomic_bool failed(false);
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t k = 0; k < num_chunks; ++k) {
+            std::size_t const points = std::min(chunk_points, cloud->m_size - k * chunk_points);
+            int const bytes = LZ4_decompress_safe(src + starts[k], dst + k * chunk_points * element,
+                                                  static_cast<int>(sizes[k]), static_cast<int>(points * element));
+            if (bytes != static_cast<int>(points * element))
+                failed = true;
+        }
+        if (failed)
+            throw std::runtime_error(path + " has a corrupt compressed column");
+#else
+        throw std::runtime_error(path + " is LZ4 compressed, but the build has no LZ4");
+#endif
+    }
+    // nothing points into the file after decoding every column
+    if (!mapped)
+        cloud->m_mapping.reset();
+    return cloud;
+}
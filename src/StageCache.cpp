@@ -0,0 +1,89 @@
+#include "StageCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "util/file_system.h"
+
+#define STAGE_CACHE_FILE "stage-cache.txt"
+
+static const std::uint64_t HASH_PRIME = 1099511628211ull;
+
+ContentHash &ContentHash::Add(const void *data, std::size_t size) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    // FNV-1a over 8 byte words, the byte tail is hashed one by one
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        m_hash = (m_hash ^ word) * HASH_PRIME;
+    }
+    for (; i < size; ++i)
+        m_hash = (m_hash ^ bytes[i]) * HASH_PRIME;
+    return *this;
+}
+
+ContentHash &ContentHash::Add(const std::string &str) {
+    AddValue<std::uint64_t>(str.size());
+    return Add(str.data(), str.size());
+}
+
+bool ContentHash::AddFile(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.good())
+        return false;
+    std::vector<char> buffer(1 << 20);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        Add(buffer.data(), static_cast<std::size_t>(in.gcount()));
+    }
+    return true;
+}
+
+StageCache::StageCache(const std::string &scene_path)
+    : m_path(util::fs::join_path(scene_path, STAGE_CACHE_FILE)) {
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::uint64_t hash;
+        std::string key;
+        if (ss >> std::hex >> hash >> key)
+            m_entries[key] = hash;
+    }
+}
+
+bool StageCache::IsValid(const std::string &key, std::uint64_t hash) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    return it != m_entries.end() && it->second == hash;
+}
+
+void StageCache::Record(const std::string &key, std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[key] = hash;
+}
+
+void StageCache::Invalidate(const std::string &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(key);
+}
+
+void StageCache::Save() const {
+    std::string tmp_path = m_path + ".tmp";
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ofstream out(tmp_path);
+        for (auto const &entry : m_entries)
+            out << std::hex << std::setw(16) << std::setfill('0') << entry.second
+                << " " << entry.first << "\n";
+        if (!out.good())
+            throw std::runtime_error("Error writing stage cache " + tmp_path);
+    }
+    if (std::rename(tmp_path.c_str(), m_path.c_str()) != 0)
+        throw std::runtime_error("Error replacing stage cache " + m_path);
+}
@@ -0,0 +1,87 @@
+#include "StereoViewCache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+StereoViewCache::StereoViewCache(const std::string &image_name, std::size_t budget_bytes)
+    : m_image_name(image_name), m_budget(budget_bytes), m_bytes(0) {
+}
+
+smvs::StereoView::Ptr StereoViewCache::Get(const mve::View::Ptr &view) {
+    int const id = view->get_id();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        m_stats.hits++;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        std::shared_future<smvs::StereoView::Ptr> future = it->second.view;
+        lock.unlock();
+        return future.get();
+    }
+
+    /* Publish the entry before creating the view, so that other tasks wait
+     * for this one instead of loading the same view. */
+    m_stats.misses++;
+    std::promise<smvs::StereoView::Ptr> promise;
+    m_lru.push_front(id);
+    Entry &entry = m_entries[id];
+    entry.view = promise.get_future().share();
+    entry.bytes = EstimateBytes(view, m_image_name);
+    entry.lru = m_lru.begin();
+    m_bytes += entry.bytes;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_bytes);
+    std::shared_future<smvs::StereoView::Ptr> future = entry.view;
+    lock.unlock();
+
+    try {
+        promise.set_value(smvs::StereoView::create(view, m_image_name));
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        lock.lock();
+        auto failed = m_entries.find(id);
+        m_bytes -= failed->second.bytes;
+        m_lru.erase(failed->second.lru);
+        m_entries.erase(failed);
+        lock.unlock();
+        return future.get();
+    }
+
+    // this caller holds the new view, so it is not evicted right away
+    smvs::StereoView::Ptr result = future.get();
+    lock.lock();
+    Evict();
+    return result;
+}
+
+void StereoViewCache::Evict() {
+    auto it = m_lru.end();
+    while (m_bytes > m_budget && it != m_lru.begin()) {
+        --it;
+        auto entry = m_entries.find(*it);
+        std::shared_future<smvs::StereoView::Ptr> const &future = entry->second.view;
+        bool const ready = future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        // the cache itself holds one reference
+        if (!ready || future.get().use_count() > 1)
+            continue;
+        m_bytes -= entry->second.bytes;
+        m_entries.erase(entry);
+        it = m_lru.erase(it);
+        m_stats.evictions++;
+    }
+}
+
+StereoViewCache::Stats StereoViewCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::size_t StereoViewCache::EstimateBytes(const mve::View::Ptr &view, const std::string &image_name) {
+    mve::View::ImageProxy const *proxy = view->get_image_proxy(image_name);
+    if (proxy == nullptr)
+        return 0;
+    return EstimateBytes(proxy->width, proxy->height, proxy->channels);
+}
+
+std::size_t StereoViewCache::EstimateBytes(int width, int height, int channels) {
+    return static_cast<std::size_t>(width) * height * (channels + 2) * sizeof(float);
+}
@@ -0,0 +1,356 @@
+#include "SurfacePartition.hpp"
+#include "fssr/iso_octree.h"
+#include "fssr/iso_surface.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+/** Depth of the partition octree, bounds the number of blocks */
+constexpr int MAX_PARTITION_DEPTH = 8;
+
+/** Peak memory of FSSR per sample: the sample, its share of the octree
+ * nodes and the voxels at their corners. A rough upper bound. */
+constexpr std::size_t FSSR_BYTES_PER_SAMPLE = 1024;
+
+/** Weld tolerance relative to the smallest sample scale */
+constexpr float WELD_TOLERANCE = 1e-3f;
+
+namespace {
+
+struct Node {
+    math::Vec3f min;
+    float size;
+    std::size_t count;
+    /** First of the eight children, 0 for leaves */
+    std::size_t children;
+};
+
+int Octant(const Node &node, const math::Vec3f &pos) {
+    float const half = node.size / 2.f;
+    int octant = 0;
+    for (int k = 0; k < 3; ++k)
+        if (pos[k] >= node.min[k] + half)
+            octant |= 1 << k;
+    return octant;
+}
+
+bool InCore(const SurfacePartition::Block &block, const math::Vec3f &pos) {
+    for (int k = 0; k < 3; ++k)
+        if (pos[k] < block.min[k] || pos[k] >= block.min[k] + block.size)
+            return false;
+    return true;
+}
+
+/** Distance to the closest plane of the core boundary, a lower bound of the
+ * distance to the boundary itself. */
+float BoundaryDistance(const SurfacePartition::Block &block, const math::Vec3f &pos) {
+    float dist = std::numeric_limits<float>::max();
+    for (int k = 0; k < 3; ++k) {
+        dist = std::min(dist, std::abs(pos[k] - block.min[k]));
+        dist = std::min(dist, std::abs(pos[k] - block.min[k] - block.size));
+    }
+    return dist;
+}
+
+fssr::Sample MakeSample(const PointCloud &points, std::size_t i) {
+    fssr::Sample sample;
+    sample.pos = points.GetPositions()[i];
+    sample.normal = points.GetNormals()[i];
+    sample.scale = points.GetScales()[i];
+    sample.confidence = points.GetConfidences()[i];
+    sample.color = points.GetColors()[i];
+    return sample;
+}
+
+std::uint64_t CellKey(const std::int64_t *cell) {
+    return static_cast<std::uint64_t>(cell[0] * 73856093LL)
+           ^ static_cast<std::uint64_t>(cell[1] * 19349663LL)
+           ^ static_cast<std::uint64_t>(cell[2] * 83492791LL);
+}
+
+} // namespace
+
+SurfacePartition::SurfacePartition(const PointCloud &points, const Options &options)
+    : m_points(points), m_tolerance(0.f) {
+    std::size_t const n = points.GetSize();
+    if (n >= std::numeric_limits<std::uint32_t>::max())
+        throw std::invalid_argument("Point set too large to partition");
+    if (options.max_block_samples == 0 || options.overlap < 0.f)
+        throw std::invalid_argument("Invalid surface partition options");
+    const math::Vec3f *pos = points.GetPositions();
+    const math::Vec3f *colors = points.GetColors();
+    const float *scales = points.GetScales();
+
+    /* Bounding box of the samples. Only samples extending it or larger than
+     * all before them can grow the octree root, they are the candidates for
+     * the anchors. */
+    float const inf = std::numeric_limits<float>::infinity();
+    math::Vec3f lo(inf), hi(-inf);
+    float min_scale = inf, max_scale = -inf;
+    std::size_t num_samples = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!IsSample(colors[i]))
+            continue;
+        bool anchor = scales[i] >= max_scale;
+        for (int k = 0; k < 3; ++k) {
+            anchor = anchor || pos[i][k] <= lo[k] || pos[i][k] >= hi[k];
+            lo[k] = std::min(lo[k], pos[i][k]);
+            hi[k] = std::max(hi[k], pos[i][k]);
+        }
+        if (anchor)
+            m_anchors.push_back(static_cast<std::uint32_t>(i));
+        min_scale = std::min(min_scale, scales[i]);
+        max_scale = std::max(max_scale, scales[i]);
+        num_samples += 1;
+    }
+    if (num_samples == 0)
+        throw std::runtime_error("Point set does not contain any samples.");
+    m_tolerance = WELD_TOLERANCE * min_scale;
+
+    /* The candidates alone grow the root like all samples do. The anchors
+     * are those that actually create or grow it in an octree of only the
+     * candidates. Each growth at least doubles the root, so there are at
+     * most 1 + log2(root size / first sample scale) anchors however the
+     * point set is ordered. */
+    {
+        fssr::IsoOctree probe;
+        math::Vec3d center(0.0);
+        double root_size = 0.0;
+        std::vector<std::uint32_t> anchors;
+        for (std::uint32_t i : m_anchors) {
+            probe.insert_sample(MakeSample(points, i));
+            fssr::Octree::Iterator const root = probe.get_iterator_for_root();
+            if (root.node_size == root_size && root.node_center == center)
+                continue;
+            root_size = root.node_size;
+            center = root.node_center;
+            anchors.push_back(i);
+        }
+        m_anchors.swap(anchors);
+    }
+
+    /* Split the bounding cube until no leaf holds too many samples. */
+    float size = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    size = size * 1.001f + min_scale;
+    std::vector<Node> nodes(1, Node{lo, size, num_samples, 0});
+    std::vector<std::uint32_t> node_of(n, std::numeric_limits<std::uint32_t>::max());
+    for (std::size_t i = 0; i < n; ++i)
+        if (IsSample(colors[i]))
+            node_of[i] = 0;
+    for (int depth = 0; depth < MAX_PARTITION_DEPTH; ++depth) {
+        bool split = false;
+        for (std::size_t j = 0, num_nodes = nodes.size(); j < num_nodes; ++j) {
+            if (nodes[j].children != 0 || nodes[j].count <= options.max_block_samples)
+                continue;
+            nodes[j].children = nodes.size();
+            float const half = nodes[j].size / 2.f;
+            for (int octant = 0; octant < 8; ++octant) {
+                math::Vec3f min = nodes[j].min;
+                for (int k = 0; k < 3; ++k)
+                    if (octant & (1 << k))
+                        min[k] += half;
+                nodes.push_back(Node{min, half, 0, 0});
+            }
+            split = true;
+        }
+        if (!split)
+            break;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (node_of[i] == std::numeric_limits<std::uint32_t>::max())
+                continue;
+            Node const &node = nodes[node_of[i]];
+            if (node.children == 0)
+                continue;
+            std::size_t const child = node.children + Octant(node, pos[i]);
+            node_of[i] = static_cast<std::uint32_t>(child);
+            nodes[child].count += 1;
+        }
+    }
+    node_of = std::vector<std::uint32_t>();
+
+    /* Every leaf is a block, a sample goes to all blocks its margin touches. */
+    std::vector<std::size_t> block_of(nodes.size(), 0);
+    std::vector<Block> blocks;
+    for (std::size_t j = 0; j < nodes.size(); ++j) {
+        if (nodes[j].children != 0)
+            continue;
+        block_of[j] = blocks.size();
+        blocks.push_back(Block{nodes[j].min, nodes[j].size, std::vector<std::uint32_t>(), 0});
+    }
+    std::vector<std::size_t> stack;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!IsSample(colors[i]))
+            continue;
+        float const margin = options.overlap * scales[i];
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            Node const &node = nodes[stack.back()];
+            std::size_t const j = stack.back();
+            stack.pop_back();
+            bool overlaps = true;
+            for (int k = 0; k < 3; ++k)
+                overlaps = overlaps && pos[i][k] + margin >= node.min[k]
+                           && pos[i][k] - margin < node.min[k] + node.size;
+            if (!overlaps)
+                continue;
+            if (node.children != 0) {
+                for (int octant = 0; octant < 8; ++octant)
+                    stack.push_back(node.children + octant);
+                continue;
+            }
+            Block &block = blocks[block_of[j]];
+            block.samples.push_back(static_cast<std::uint32_t>(i));
+            if (InCore(block, pos[i]))
+                block.num_core += 1;
+        }
+    }
+    for (auto &block : blocks)
+        if (!block.samples.empty())
+            m_blocks.push_back(std::move(block));
+}
+
+mve::TriangleMesh::Ptr SurfacePartition::MeshBlock(std::size_t index) const {
+    Block const &block = m_blocks[index];
+
+    /* The samples of the block merged with the anchors, in point set order
+     * like the monolithic octree. */
+    fssr::IsoOctree octree;
+    std::size_t s = 0, a = 0;
+    while (s < block.samples.size() || a < m_anchors.size()) {
+        std::uint32_t i;
+        if (a == m_anchors.size() || (s < block.samples.size() && block.samples[s] <= m_anchors[a])) {
+            i = block.samples[s++];
+            if (a < m_anchors.size() && m_anchors[a] == i)
+                a += 1;
+        } else {
+            i = m_anchors[a++];
+        }
+        octree.insert_sample(MakeSample(m_points, i));
+    }
+
+    octree.limit_octree_level();
+    octree.compute_voxels();
+    octree.clear_samples();
+    mve::TriangleMesh::Ptr mesh;
+    {
+        fssr::IsoSurface iso_surface(&octree, fssr::INTERPOLATION_CUBIC);
+        mesh = iso_surface.extract_mesh();
+    }
+    octree.clear();
+
+    /* Crop to the faces with their centroid in the core. */
+    mve::TriangleMesh::VertexList const &verts = mesh->get_vertices();
+    mve::TriangleMesh::FaceList &faces = mesh->get_faces();
+    std::size_t kept = 0;
+    for (std::size_t f = 0; f + 2 < faces.size(); f += 3) {
+        math::Vec3f const centroid = (verts[faces[f]] + verts[faces[f + 1]] + verts[faces[f + 2]]) / 3.f;
+        if (!InCore(block, centroid))
+            continue;
+        std::copy(faces.begin() + f, faces.begin() + f + 3, faces.begin() + kept);
+        kept += 3;
+    }
+    faces.resize(kept);
+    mve::TriangleMesh::DeleteList unused(verts.size(), true);
+    for (auto index : faces)
+        unused[index] = false;
+    mesh->delete_vertices_fix_faces(unused);
+    return mesh;
+}
+
+mve::TriangleMesh::Ptr SurfacePartition::Stitch(const std::vector<mve::TriangleMesh::Ptr> &meshes) const {
+    if (meshes.size() != m_blocks.size())
+        throw std::invalid_argument("Expected one mesh per block");
+
+    /* Vertices closer to the core boundary than the longest edge may be
+     * shared with a face of the neighboring block. */
+    float band = 0.f;
+    for (const auto &mesh : meshes) {
+        if (mesh == nullptr)
+            continue;
+        mve::TriangleMesh::VertexList const &verts = mesh->get_vertices();
+        mve::TriangleMesh::FaceList const &faces = mesh->get_faces();
+        for (std::size_t f = 0; f + 2 < faces.size(); f += 3)
+            for (int e = 0; e < 3; ++e)
+                band = std::max(band, (verts[faces[f + e]] - verts[faces[f + (e + 1) % 3]]).square_norm());
+    }
+    band = std::sqrt(band) + m_tolerance;
+
+    mve::TriangleMesh::Ptr out = mve::TriangleMesh::create();
+    mve::TriangleMesh::VertexList &verts = out->get_vertices();
+    mve::TriangleMesh::ColorList &colors = out->get_vertex_colors();
+    mve::TriangleMesh::ConfidenceList &confs = out->get_vertex_confidences();
+    mve::TriangleMesh::ValueList &values = out->get_vertex_values();
+    mve::TriangleMesh::FaceList &faces = out->get_faces();
+
+    /* Seam vertices by their cell, the cells are twice the tolerance so a
+     * match lies in the cell or in the nearer neighbor along each axis. */
+    float const cell_size = 2.f * m_tolerance;
+    std::unordered_multimap<std::uint64_t, std::pair<std::size_t, std::size_t>> seams;
+    std::vector<std::size_t> remap;
+    for (std::size_t b = 0; b < meshes.size(); ++b) {
+        if (meshes[b] == nullptr)
+            continue;
+        mve::TriangleMesh const &mesh = *meshes[b];
+        mve::TriangleMesh::VertexList const &mverts = mesh.get_vertices();
+        remap.assign(mverts.size(), 0);
+        for (std::size_t v = 0; v < mverts.size(); ++v) {
+            math::Vec3f const &p = mverts[v];
+            bool const seam = BoundaryDistance(m_blocks[b], p) <= band;
+            std::int64_t cell[3];
+            int step[3];
+            for (int k = 0; k < 3; ++k) {
+                float const c = p[k] / cell_size;
+                cell[k] = static_cast<std::int64_t>(std::floor(c));
+                step[k] = c - std::floor(c) < 0.5f ? -1 : 1;
+            }
+
+            std::size_t match = verts.size();
+            for (int o = 0; seam && o < 8 && match == verts.size(); ++o) {
+                std::int64_t other[3];
+                for (int k = 0; k < 3; ++k)
+                    other[k] = cell[k] + ((o & (1 << k)) ? step[k] : 0);
+                auto range = seams.equal_range(CellKey(other));
+                for (auto it = range.first; it != range.second; ++it)
+                    if (it->second.second != b
+                        && (verts[it->second.first] - p).square_norm() <= m_tolerance * m_tolerance) {
+                        match = it->second.first;
+                        break;
+                    }
+            }
+            if (match != verts.size()) {
+                remap[v] = match;
+                continue;
+            }
+
+            remap[v] = verts.size();
+            if (seam)
+                seams.emplace(CellKey(cell), std::make_pair(verts.size(), b));
+            verts.push_back(p);
+            if (mesh.get_vertex_colors().size() == mverts.size())
+                colors.push_back(mesh.get_vertex_colors()[v]);
+            if (mesh.get_vertex_confidences().size() == mverts.size())
+                confs.push_back(mesh.get_vertex_confidences()[v]);
+            if (mesh.get_vertex_values().size() == mverts.size())
+                values.push_back(mesh.get_vertex_values()[v]);
+        }
+        for (auto index : mesh.get_faces())
+            faces.push_back(static_cast<unsigned int>(remap[index]));
+    }
+    if (colors.size() != verts.size())
+        colors.clear();
+    if (confs.size() != verts.size())
+        confs.clear();
+    if (values.size() != verts.size())
+        values.clear();
+    return out;
+}
+
+std::size_t SurfacePartition::EstimateBytes(std::size_t num_samples) {
+    return num_samples * FSSR_BYTES_PER_SAMPLE;
+}
+
+bool SurfacePartition::IsSample(const math::Vec3f &color) {
+    return color[0] >= 1e-4 || color[1] >= 1e-4 || color[2] >= 1e-4;
+}
@@ -0,0 +1,43 @@
+#include "ThumbnailList.hpp"
+#include "Image.hpp"
+#include <algorithm>
+#include <cstring>
+
+ThumbnailList::ThumbnailList(wxWindow *parent, wxWindowID id)
+    : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize,
+                 wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL) {
+    // virtual lists cannot autosize, leave room for the id and directory text
+    InsertColumn(0, _("Image"), wxLIST_FORMAT_LEFT, 3 * THUMBNAIL_SIZE);
+    AssignImageList(new wxImageList(THUMBNAIL_SIZE, THUMBNAIL_SIZE, false), wxIMAGE_LIST_SMALL);
+}
+
+void ThumbnailList::SetThumbnails(std::vector<Pipeline::Thumbnail> thumbnails) {
+    m_thumbnails = std::move(thumbnails);
+    GetImageList(wxIMAGE_LIST_SMALL)->RemoveAll();
+    m_imageIndex.assign(m_thumbnails.size(), THUMBNAIL_NOT_LOADED);
+    SetItemCount(m_thumbnails.size());
+    Refresh();
+}
+
+wxString ThumbnailList::OnGetItemText(long item, long /*column*/) const {
+    Pipeline::Thumbnail const &thumbnail = m_thumbnails[item];
+    return wxString::Format("ID :%d Dir:%s", thumbnail.view_id, thumbnail.directory);
+}
+
+int ThumbnailList::OnGetItemImage(long item) const {
+    int &index = m_imageIndex[item];
+    if (index != THUMBNAIL_NOT_LOADED)
+        return std::max(index, -1);
+
+    Pipeline::Thumbnail const &thumbnail = m_thumbnails[item];
+    if (thumbnail.rgb.empty()) {
+        index = THUMBNAIL_MISSING;
+        return -1;
+    }
+    wxImage icon(thumbnail.width, thumbnail.height);
+    std::memcpy(icon.GetData(), thumbnail.rgb.data(), thumbnail.rgb.size());
+    if (icon.GetWidth() != THUMBNAIL_SIZE || icon.GetHeight() != THUMBNAIL_SIZE)
+        icon.Rescale(THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    index = GetImageList(wxIMAGE_LIST_SMALL)->Add(icon);
+    return index;
+}
@@ -4,15 +4,23 @@
 #include "mve/image_tools.h"
 #include "util/file_system.h"
 #include "util/timer.h"
-#include "mve/mesh_info.h"
-#include "mve/mesh_io.h"
-#include "mve/mesh_io_ply.h"
+#include "mve/depthmap.h"
 #include "thread_pool.h"
 #include "stereo_view.h"
 #include "depth_optimizer.h"
 #include "mesh_generator.h"
 #include "view_selection.h"
 #include "sgm_stereo.h"
+#include "filter/Convolution.hpp"
+#include "filter/BoxFilter.hpp"
+#include "ChunkedPointSet.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <stdexcept>
 
 namespace Util {
 
@@ -28,96 +36,37 @@ void GaussFilter(const mve::FloatImage::ConstPtr &img,
                  mve::FloatImage::Ptr &out,
                  int filter_range,
                  float sigma) {
-    assert(img->channels() == 1);
-
-    out = mve::FloatImage::create(img->width() - filter_range * 2, img->height() - filter_range * 2, 1);
-
-    int k_size = filter_range * 2 + 1;
-    std::vector<double> gauss_template(k_size);
-    double sum = 0;
-    for (int a = 0; a < k_size; a++) {
-        int x = a - filter_range;
-        double m = std::exp((-1.0f * x * x) / (2.f * sigma * sigma));
-        gauss_template[a] = m;
-        sum += m;
-    }
-    std::transform(gauss_template.begin(),
-                   gauss_template.end(),
-                   gauss_template.begin(),
-                   [&sum](auto &c) { return c / sum; });
-#pragma omp parallel for schedule(dynamic, 1)
-    for (int y = filter_range; y < img->height() - filter_range; ++y) {
-#pragma omp parallel for schedule(dynamic, 1)
-        for (int x = filter_range; x < img->width() - filter_range; ++x) {
-            double res = 0;
-            for (int a = -filter_range; a <= filter_range; a++) {
-                res += gauss_template.at(a + filter_range) * img->at(x, y + a, 0);
-            }
-            out->at(x - filter_range, y - filter_range, 0) = res;
-        }
-    }
-#pragma omp parallel for schedule(dynamic, 1)
-    for (int y = filter_range; y < img->height() - filter_range; ++y) {
-#pragma omp parallel for schedule(dynamic, 1)
-        for (int x = filter_range; x < img->width() - filter_range; ++x) {
-            double res = 0;
-            for (int a = -filter_range; a <= filter_range; a++) {
-                res += gauss_template.at(a + filter_range) * out->at(x - filter_range + a, y - filter_range, 0);
-            }
-            out->at(x - filter_range, y - filter_range, 0) = res;
-        }
-    }
+    Filter::GaussFilter(img, out, filter_range, sigma);
 }
 
-mve::FloatImage::Ptr ComputeIntegralImg(const mve::FloatImage::ConstPtr &img) {
-    mve::FloatImage::Ptr integral_img = mve::FloatImage::create(img->width() + 1, img->height() + 1, 1);
-
-    for (int r = 0; r < img->height(); r++) {
-        float sum = 0;
-        for (int c = 0; c < img->width(); c++) {
-            sum += img->at(c, r, 0);
-            integral_img->at(c + 1, r + 1, 0) = integral_img->at(c + 1, r, 0) + sum;
-        }
-    }
-    return integral_img;
+mve::DoubleImage::Ptr ComputeIntegralImg(const mve::FloatImage::ConstPtr &img) {
+    return Filter::IntegralImage(img);
 }
 
 void MeanFilter(const mve::FloatImage::ConstPtr &img, mve::FloatImage::Ptr &out, int filter_range) {
-    out = mve::FloatImage::create(img->width() - 2 * filter_range, img->height() - 2 * filter_range, 1);
-    mve::FloatImage::Ptr integral_img = ComputeIntegralImg(img);
-    int k_size = 2 * filter_range + 1;
-    float normal = 1.f / (k_size * k_size);
-#pragma omp parallel for schedule(dynamic, 1)
-    for (int r = filter_range + 1; r < img->height() - filter_range + 1; r++) {
-#pragma omp parallel for schedule(dynamic, 1)
-        for (int c = filter_range + 1; c < img->width() - filter_range + 1; c++) {
-            float sum = integral_img->at(c + filter_range, r + filter_range, 0)
-                + integral_img->at(c - filter_range - 1, r - filter_range - 1, 0)
-                - integral_img->at(c + filter_range, r - filter_range - 1, 0)
-                - integral_img->at(c - filter_range - 1, r + filter_range, 0);
-            out->at(c - filter_range - 1, r - filter_range - 1, 0) = sum * normal;
-        }
-    }
+    Filter::BoxFilter(img, out, filter_range);
 }
 
-mve::TriangleMesh::Ptr GenerateMeshSMVS(mve::Scene::Ptr scene,
-                                        const std::string &input_name,
-                                        const std::string &dm_name,
-                                        const std::string &output_name,
-                                        bool triangle_mesh) {
-    mve::TriangleMesh::Ptr mesh;
-    /* Build mesh name */
-    std::string ply_path;
-    if (util::string::right(output_name, 4) == ".ply") {
-        std::cout << ".ply file already exists, skipping mesh generation." << std::endl;
-        ply_path = util::fs::join_path(scene->get_path(), output_name);
-    } else {
-        ply_path = util::fs::join_path(scene->get_path(), output_name + ".ply");
-    }
-    if (util::fs::file_exists(ply_path.c_str())) { // skip point set reconstruction if ply is found
-        std::cout << "The .ply file already exists, skipping mesh generation." << std::endl;
-        mesh = mve::geom::load_ply_mesh(ply_path);
+std::string PointSetPath(const mve::Scene::Ptr &scene, const std::string &output_name) {
+    std::string name = output_name;
+    if (util::string::right(name, 4) == ".ply")
+        name = util::string::left(name, name.size() - 4);
+    return util::fs::join_path(scene->get_path(), name + ".mvpc");
+}
+
+PointCloud::Ptr GenerateMeshSMVS(mve::Scene::Ptr scene,
+                                 const std::string &input_name,
+                                 const std::string &dm_name,
+                                 const std::string &output_name,
+                                 bool triangle_mesh,
+                                 const PointSetOptions &options) {
+    PointCloud::Ptr point_set;
+    const std::string path = PointSetPath(scene, output_name);
+    if (util::fs::file_exists(path.c_str())) { // skip point set reconstruction if the file is found
+        std::cout << "The point set already exists, skipping mesh generation." << std::endl;
+        point_set = PointCloud::Load(path);
     } else {
+        mve::TriangleMesh::Ptr mesh;
         std::cout << "Generating Mesh";
 
         util::WallTimer timer;
@@ -141,42 +90,71 @@ mve::TriangleMesh::Ptr GenerateMeshSMVS(mve::Scene::Ptr scene,
             mesh->recalc_normals();
 
         /* Save mesh */
-        mve::geom::SavePLYOptions opts;
-        opts.write_vertex_normals = true;
-        opts.write_vertex_values = true;
-        opts.write_vertex_confidences = true;
-        std::cout << "Writing final point set to "<< ply_path << std::endl;
-        mve::geom::save_ply_mesh(mesh, ply_path, opts);
+        point_set = PointCloud::FromMesh(*mesh);
+        mesh.reset();
+        PointCloud::SaveOptions save_opts;
+        save_opts.compress = options.compress;
+        std::cout << "Writing final point set to "<< path << std::endl;
+        point_set->Save(path, save_opts);
     }
-    return mesh;
+    return point_set;
 }
 
-mve::TriangleMesh::Ptr GenerateMesh(mve::Scene::Ptr scene,
-                                    const std::string &input_name,
-                                    const std::string &dm_name,
-                                    int scale,
-                                    const std::string &output_name) {
-    /* Build mesh name */
-    std::string ply_path;
-    if (util::string::right(output_name, 4) == ".ply") {
-        ply_path = util::fs::join_path(scene->get_path(), output_name);
-    } else {
-        ply_path = util::fs::join_path(scene->get_path(), output_name + ".ply");
+/** Mean distance of every vertex of a triangulated depth map to its
+ * neighbors, times 'scale'. The faces of a depth map only connect adjacent
+ * pixels, so the distinct neighbors of a vertex fit into a fixed array and
+ * no mve::MeshInfo adjacency is built. */
+static std::vector<float> DepthmapVertexScales(const mve::TriangleMesh &mesh, int scale) {
+    mve::TriangleMesh::VertexList const &verts(mesh.get_vertices());
+    mve::TriangleMesh::FaceList const &faces(mesh.get_faces());
+    std::vector<std::array<unsigned int, 8>> neighbors(verts.size());
+    std::vector<std::uint8_t> num_neighbors(verts.size(), 0);
+    std::vector<float> distances(verts.size(), 0.0f);
+    std::vector<float> counts(verts.size(), 0.0f);
+    auto add_neighbor = [&](unsigned int v, unsigned int n) {
+      std::uint8_t &num = num_neighbors[v];
+      for (std::uint8_t k = 0; k < num; ++k)
+          if (neighbors[v][k] == n)
+              return;
+      if (num < neighbors[v].size())
+          neighbors[v][num++] = n;
+      distances[v] += (verts[v] - verts[n]).norm();
+      counts[v] += 1.0f;
+    };
+    for (std::size_t f = 0; f + 2 < faces.size(); f += 3) {
+        for (int k = 0; k < 3; ++k) {
+            add_neighbor(faces[f + k], faces[f + (k + 1) % 3]);
+            add_neighbor(faces[f + (k + 1) % 3], faces[f + k]);
+        }
     }
-    mve::TriangleMesh::Ptr point_set;
-    if (util::fs::file_exists(ply_path.c_str())) { // skip point set reconstruction if ply is found
-        std::cout << "The .ply file already exists, skipping mesh generation." << std::endl;
-        point_set = mve::geom::load_ply_mesh(ply_path);
+    for (std::size_t v = 0; v < verts.size(); ++v)
+        if (counts[v] > 0.0f)
+            distances[v] = distances[v] / counts[v] * static_cast<float>(scale);
+    return distances;
+}
+
+PointCloud::Ptr GenerateMesh(mve::Scene::Ptr scene,
+                             const std::string &input_name,
+                             const std::string &dm_name,
+                             int scale,
+                             const std::string &output_name,
+                             const PointSetOptions &options) {
+    const std::string path = PointSetPath(scene, output_name);
+    PointCloud::Ptr point_set;
+    if (util::fs::file_exists(path.c_str())) { // skip point set reconstruction if the file is found
+        std::cout << "The point set already exists, skipping mesh generation." << std::endl;
+        point_set = PointCloud::Load(path);
     } else {
+        util::WallTimer timer;
         mve::Scene::ViewList &views(scene->get_views());
-        /* Prepare output mesh. */
-        point_set = mve::TriangleMesh::create();
-        mve::TriangleMesh::VertexList &verts(point_set->get_vertices());
-        mve::TriangleMesh::NormalList &vnorm(point_set->get_vertex_normals());
-        mve::TriangleMesh::ColorList &vcolor(point_set->get_vertex_colors());
-        mve::TriangleMesh::ValueList &vvalues(point_set->get_vertex_values());
-        mve::TriangleMesh::ConfidenceList &vconfs(point_set->get_vertex_confidences());
-
+        /* The views are triangulated in parallel into their own point sets,
+         * or straight into chunks on disk when streaming. */
+        std::vector<mve::TriangleMesh::Ptr> view_points(views.size());
+        std::vector<std::vector<float>> view_scales(views.size());
+        std::unique_ptr<ChunkedPointSet> chunks;
+        if (options.streaming)
+            chunks.reset(new ChunkedPointSet(path + ".chunks"));
+        std::exception_ptr error;
 
 #pragma omp parallel for schedule(dynamic)
         for (std::size_t i = 0; i < views.size(); ++i) {
@@ -214,45 +192,75 @@ mve::TriangleMesh::Ptr GenerateMesh(mve::Scene::Ptr scene,
             mve::Image<unsigned int> vertex_ids;
             mesh = mve::geom::depthmap_triangulate(dm, ci, cam, mve::geom::DD_FACTOR_DEFAULT, &vertex_ids);
 
-            mve::TriangleMesh::VertexList const &mverts(mesh->get_vertices());
-            mve::TriangleMesh::NormalList const &mnorms(mesh->get_vertex_normals());
-            mve::TriangleMesh::ColorList const &mvcol(mesh->get_vertex_colors());
-            mve::TriangleMesh::ConfidenceList &mconfs(mesh->get_vertex_confidences());
-
             //mesh->ensure_normals();
 
             mve::geom::depthmap_mesh_confidences(mesh, 4);
 
-            std::vector<float> mvscale;
-            mvscale.resize(mverts.size(), 0.0f);
-            mve::MeshInfo mesh_info(mesh);
-            for (std::size_t j = 0; j < mesh_info.size(); ++j) {
-                mve::MeshInfo::VertexInfo const &vinf = mesh_info[j];
-                for (unsigned long long vert : vinf.verts)
-                    mvscale[j] += (mverts[j] - mverts[vert]).norm();
-                mvscale[j] /= static_cast<float>(vinf.verts.size());
-                mvscale[j] *= scale;
-            }
+            std::vector<float> mvscale = DepthmapVertexScales(*mesh, scale);
+            mve::TriangleMesh::FaceList().swap(mesh->get_faces());
 
+            if (chunks != nullptr) {
+                try {
+                    chunks->WriteChunk(i, *mesh, mvscale);
+                }
+                catch (...) {
 #pragma omp critical
-            {
-                verts.insert(verts.end(), mverts.begin(), mverts.end());
-                vcolor.insert(vcolor.end(), mvcol.begin(), mvcol.end());
-                vnorm.insert(vnorm.end(), mnorms.begin(), mnorms.end());
-                vvalues.insert(vvalues.end(), mvscale.begin(), mvscale.end());
-                vconfs.insert(vconfs.end(), mconfs.begin(), mconfs.end());
+                    if (!error)
+                        error = std::current_exception();
+                }
+            } else {
+                view_points[i] = mesh;
+                view_scales[i].swap(mvscale);
             }
             dm.reset();
             ci.reset();
             view->cache_cleanup();
         }
+        if (error)
+            std::rethrow_exception(error);
+
+        if (chunks != nullptr) {
+            std::cout << "Writing final point set to " << path << std::endl;
+            chunks->Write(path);
+            std::cout << "Merged " << chunks->GetNumPoints() << " points in "
+                      << timer.get_elapsed_sec() << "s" << std::endl;
+            return PointCloud::Load(path);
+        }
+
+        /* Every view goes to the sum of the points before it, so the views
+         * are copied in parallel without a lock. */
+        std::vector<std::size_t> offsets(views.size() + 1, 0);
+        for (std::size_t i = 0; i < views.size(); ++i)
+            offsets[i + 1] = offsets[i] + (view_points[i] != nullptr ? view_points[i]->get_vertices().size() : 0);
+
+        point_set = PointCloud::Create(offsets.back());
+
+#pragma omp parallel for schedule(dynamic)
+        for (std::size_t i = 0; i < views.size(); ++i) {
+            if (view_points[i] == nullptr)
+                continue;
+            mve::TriangleMesh::VertexList const &mverts(view_points[i]->get_vertices());
+            mve::TriangleMesh::NormalList const &mnorms(view_points[i]->get_vertex_normals());
+            mve::TriangleMesh::ColorList const &mvcol(view_points[i]->get_vertex_colors());
+            mve::TriangleMesh::ConfidenceList const &mconfs(view_points[i]->get_vertex_confidences());
+            std::copy(mverts.begin(), mverts.end(), point_set->GetPositions() + offsets[i]);
+            std::copy(mnorms.begin(), mnorms.end(), point_set->GetNormals() + offsets[i]);
+            math::Vec3f *colors = point_set->GetColors() + offsets[i];
+            for (std::size_t j = 0; j < mvcol.size(); ++j)
+                colors[j] = math::Vec3f(*mvcol[j]);
+            std::copy(view_scales[i].begin(), view_scales[i].end(), point_set->GetScales() + offsets[i]);
+            std::copy(mconfs.begin(), mconfs.end(), point_set->GetConfidences() + offsets[i]);
+            view_points[i].reset();
+            std::vector<float>().swap(view_scales[i]);
+        }
+        std::cout << "Merged " << offsets.back() << " points in "
+                  << timer.get_elapsed_sec() << "s" << std::endl;
+
         /* Write mesh to disc. */
-        mve::geom::SavePLYOptions opts;
-        opts.write_vertex_normals = true;
-        opts.write_vertex_values = true;
-        opts.write_vertex_confidences = true;
-        std::cout << "Writing final point set to "<< ply_path << std::endl;
-        mve::geom::save_ply_mesh(point_set, ply_path, opts);
+        PointCloud::SaveOptions save_opts;
+        save_opts.compress = options.compress;
+        std::cout << "Writing final point set to "<< path << std::endl;
+        point_set->Save(path, save_opts);
     }
     return point_set;
 }
@@ -261,28 +269,39 @@ void reconstructSGMDepthForView(const smvs::SGMStereo::Options &opt,
                                 const std::string &outputName,
                                 smvs::StereoView::Ptr main_view,
                                 std::vector<smvs::StereoView::Ptr> neighbors,
-                                mve::Bundle::ConstPtr bundle) {
+                                mve::Bundle::ConstPtr bundle,
+                                const SGMPairOptions &pair_opts) {
+    if (neighbors.empty())
+        throw std::invalid_argument("SGM needs at least one neighbor");
     util::WallTimer sgm_timer;
-    mve::FloatImage::Ptr d1 = smvs::SGMStereo::reconstruct(opt, main_view,
-                                                           neighbors[0], bundle);
-    if (neighbors.size() > 1) {
-        mve::FloatImage::Ptr d2 = smvs::SGMStereo::reconstruct(opt,
-                                                               main_view, neighbors[1], bundle);
-        for (int p = 0; p < d1->get_pixel_amount(); ++p) {
-            if (d2->at(p) == 0.0f)
-                continue;
-            if (d1->at(p) == 0.0f) {
-                d1->at(p) = d2->at(p);
-                continue;
-            }
-            d1->at(p) = (d1->at(p) + d2->at(p)) * 0.5f;
-        }
-    }
-
-    std::cout << "SGM took: " << sgm_timer.get_elapsed_sec()
+    std::size_t num_pairs = neighbors.size();
+    if (pair_opts.num_pairs > 0)
+        num_pairs = std::min(num_pairs, pair_opts.num_pairs);
+    num_pairs = std::min(num_pairs, static_cast<std::size_t>(Filter::MAX_FUSED_DEPTHS));
+    std::size_t num_threads = num_pairs;
+    if (pair_opts.num_threads > 0)
+        num_threads = std::min(num_threads, static_cast<std::size_t>(pair_opts.num_threads));
+
+    /* The calling thread takes pairs too, the others run on helpers. */
+    std::vector<mve::FloatImage::ConstPtr> depths(num_pairs);
+    std::atomic_size_t next_pair(0);
+    auto worker = [&] {
+      for (std::size_t n = next_pair++; n < num_pairs; n = next_pair++)
+          depths[n] = smvs::SGMStereo::reconstruct(opt, main_view, neighbors[n], bundle);
+    };
+    std::vector<std::future<void>> helpers;
+    for (std::size_t t = 1; t < num_threads; ++t)
+        helpers.emplace_back(std::async(std::launch::async, worker));
+    worker();
+    for (auto &&helper : helpers)
+        helper.get();
+
+    mve::FloatImage::Ptr depth = Filter::FuseDepths(depths, pair_opts.fusion);
+
+    std::cout << "SGM of " << num_pairs << " pairs took: " << sgm_timer.get_elapsed_sec()
               << "sec" << std::endl;
 
-    main_view->write_depth_to_view(d1, outputName);
+    main_view->write_depth_to_view(depth, outputName);
 }
 
 void resizeViews(mve::Scene::ViewList &views,
@@ -0,0 +1,48 @@
+#include "feature/BinaryMatcher.hpp"
+#include <limits>
+
+BinaryMatcher::BinaryMatcher(const Options &opts) : m_opts(opts) {
+
+}
+
+void BinaryMatcher::Match(const Brief::Descriptors &set_1,
+                          const Brief::Descriptors &set_2,
+                          std::vector<int> *matches_1_2) const {
+    matches_1_2->assign(set_1.size(), -1);
+    if (set_2.size() < 2)
+        return;
+
+    /* One sweep collects the two nearest neighbors of every 'set_1'
+     * descriptor and the nearest neighbor of every 'set_2' descriptor. */
+    std::vector<int> best_2_1(set_2.size(), -1);
+    std::vector<int> best_2_1_dist(set_2.size(), std::numeric_limits<int>::max());
+    for (std::size_t i = 0; i < set_1.size(); ++i) {
+        int best = -1;
+        int best_dist = std::numeric_limits<int>::max();
+        int second_dist = std::numeric_limits<int>::max();
+        for (std::size_t j = 0; j < set_2.size(); ++j) {
+            int dist = Brief::Distance(set_1[i], set_2[j]);
+            if (dist < best_dist) {
+                second_dist = best_dist;
+                best_dist = dist;
+                best = static_cast<int>(j);
+            } else if (dist < second_dist) {
+                second_dist = dist;
+            }
+            if (dist < best_2_1_dist[j]) {
+                best_2_1_dist[j] = dist;
+                best_2_1[j] = static_cast<int>(i);
+            }
+        }
+        if (best_dist > m_opts.max_distance
+            || static_cast<float>(best_dist) >= m_opts.lowe_ratio * second_dist)
+            continue;
+        matches_1_2->at(i) = best;
+    }
+
+    for (std::size_t i = 0; i < set_1.size(); ++i) {
+        int j = matches_1_2->at(i);
+        if (j >= 0 && best_2_1[j] != static_cast<int>(i))
+            matches_1_2->at(i) = -1;
+    }
+}
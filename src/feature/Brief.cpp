@@ -0,0 +1,32 @@
+#include "feature/Brief.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+Brief::Brief() {
+    /* Test locations drawn from an isotropic gaussian around the keypoint,
+     * the fixed seed keeps descriptors comparable between runs. */
+    std::mt19937 engine(0);
+    std::normal_distribution<float> dist(0.f, PATCH_RADIUS * 2 / 5.f);
+    auto sample = [&]() {
+      float v = std::round(dist(engine));
+      return static_cast<int>(std::max<float>(-PATCH_RADIUS, std::min<float>(PATCH_RADIUS, v)));
+    };
+    m_tests.resize(256);
+    for (auto &test : m_tests) {
+        test.x1 = sample();
+        test.y1 = sample();
+        test.x2 = sample();
+        test.y2 = sample();
+    }
+}
+
+Brief::Descriptor Brief::Compute(const mve::ByteImage &smoothed, int x, int y) const {
+    Descriptor descriptor{};
+    for (std::size_t i = 0; i < m_tests.size(); ++i) {
+        const Test &t = m_tests[i];
+        if (smoothed.at(x + t.x1, y + t.y1, 0) < smoothed.at(x + t.x2, y + t.y2, 0))
+            descriptor[i / 64] |= std::uint64_t(1) << (i % 64);
+    }
+    return descriptor;
+}
@@ -1,5 +1,10 @@
 #include "feature/Harris.hpp"
-#include "Util.hpp"
+#include "filter/Convolution.hpp"
+#include "filter/Kernel.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <stdexcept>
 
 Harris::Harris(float k, int filter_range, float sigma)
     : m_k(k), m_filter_range(filter_range), m_sigma(sigma) {
@@ -18,145 +23,238 @@ void Harris::SetImage(const mve::ByteImage::ConstPtr &img) {
 }
 
 void Harris::Process() {
-    m_derivatives = ComputeDerivatives();
-    if (m_sigma > 1e-7) {
-        ApplyGaussToDerivatives(1);
-    } else {
-        ApplyMeanToDerivatives();
-    }
     ComputeHarrisResponses();
 }
 
-Harris::Derivatives Harris::ComputeDerivatives() {
-    mve::FloatImage::Ptr sobel_vertical = mve::FloatImage::create(m_orig->width(), m_orig->height() - 2, 1);
-    for (int y = 1; y < sobel_vertical->height() - 1; ++y) {
-        for (int x = 0; x < sobel_vertical->width(); ++x) {
-            float a1 = m_orig->at(x, y - 1, 0);
-            float a2 = m_orig->at(x, y, 0);
-            float a3 = m_orig->at(x, y + 1, 0);
-            sobel_vertical->at(x, y - 1, 0) = a1 + a2 + a2 + a3;
-        }
-    }
-    mve::FloatImage::Ptr sobel_horizontal = mve::FloatImage::create(m_orig->width() - 2, m_orig->height(), 1);
-    for (int y = 0; y < sobel_horizontal->height(); ++y) {
-        for (int x = 1; x < sobel_horizontal->width() - 1; ++x) {
-            float a1 = m_orig->at(x - 1, y, 0);
-            float a2 = m_orig->at(x, y, 0);
-            float a3 = m_orig->at(x + 1, y, 0);
-            sobel_horizontal->at(x - 1, y, 0) = a1 + a2 + a2 + a3;
-        }
-    }
-    // Apply Sobel filter to compute 1st derivatives
-    mve::FloatImage::Ptr Ix = mve::FloatImage::create(m_orig->width() - 2, m_orig->height() - 2, 1);
-    mve::FloatImage::Ptr Iy = mve::FloatImage::create(m_orig->width() - 2, m_orig->height() - 2, 1);
-    mve::FloatImage::Ptr Ixy = mve::FloatImage::create(m_orig->width() - 2, m_orig->height() - 2, 1);
-
-    for (int y = 0; y < m_orig->height() - 2; y++) {
-        for (int x = 0; x < m_orig->width() - 2; x++) {
-            Ix->at(x, y, 0) = sobel_horizontal->at(x, y, 0) - sobel_horizontal->at(x, y + 2, 0);
-            Iy->at(x, y, 0) = -sobel_vertical->at(x, y, 0) + sobel_vertical->at(x + 2, y, 0);
-            Ixy->at(x, y, 0) = Ix->at(x, y, 0) * Iy->at(x, y, 0);
+namespace {
+
+/* Output tile, sized so the tensor products of a tile stay in L2. */
+constexpr int TILE_WIDTH = 256;
+constexpr int TILE_HEIGHT = 64;
+
+struct TileBuffers {
+    std::vector<float> xx, yy, xy; // tensor products of the tile plus its apron
+    std::vector<float> col;        // column pass of one row, 3 channels
+    std::vector<float> row;        // row pass of one row, 3 channels
+};
+
+template<typename Taps>
+void HarrisTile(Taps taps, const mve::FloatImage &orig, const float *kernel, float k,
+                int tx, int ty, int tw, int th, TileBuffers &buf, mve::FloatImage &responses) {
+    int const radius = taps.size() / 2;
+    int const gw = tw + 2 * radius;
+    int const gh = th + 2 * radius;
+    int const width = orig.width();
+    const float *img = orig.get_data_pointer();
+
+    /* Sobel gradients and their products, response (x, y) is centered at
+     * gradient (x + radius, y + radius) which sits at image (x + radius + 1, y + radius + 1) */
+    for (int j = 0; j < gh; ++j) {
+        const float *mid = img + static_cast<std::size_t>(ty + j + 1) * width + tx + 1;
+        const float *up = mid - width;
+        const float *dn = mid + width;
+        float *xx = buf.xx.data() + j * gw;
+        float *yy = buf.yy.data() + j * gw;
+        float *xy = buf.xy.data() + j * gw;
+        for (int i = 0; i < gw; ++i) {
+            float dx = (up[i + 1] + 2 * mid[i + 1] + dn[i + 1]) - (up[i - 1] + 2 * mid[i - 1] + dn[i - 1]);
+            float dy = (up[i - 1] + 2 * up[i] + up[i + 1]) - (dn[i - 1] + 2 * dn[i] + dn[i + 1]);
+            xx[i] = dx * dx;
+            yy[i] = dy * dy;
+            xy[i] = dx * dy;
         }
     }
-    Derivatives d;
-    d.Ix = Ix;
-    d.Iy = Iy;
-    d.Ixy = Ixy;
-    return d;
-}
 
-void Harris::ApplyGaussToDerivatives(float sigma) {
-    if (m_filter_range == 0)
-        return;
+    float *col_xx = buf.col.data();
+    float *col_yy = col_xx + gw;
+    float *col_xy = col_yy + gw;
+    float *row_xx = buf.row.data();
+    float *row_yy = row_xx + tw;
+    float *row_xy = row_yy + tw;
+    for (int j = 0; j < th; ++j) {
+        Filter::Convolve1D(taps, buf.xx.data() + j * gw, gw, gw, kernel, col_xx);
+        Filter::Convolve1D(taps, buf.yy.data() + j * gw, gw, gw, kernel, col_yy);
+        Filter::Convolve1D(taps, buf.xy.data() + j * gw, gw, gw, kernel, col_xy);
+        Filter::Convolve1D(taps, col_xx, 1, tw, kernel, row_xx);
+        Filter::Convolve1D(taps, col_yy, 1, tw, kernel, row_yy);
+        Filter::Convolve1D(taps, col_xy, 1, tw, kernel, row_xy);
 
-    Util::GaussFilter(m_derivatives.Ix, m_derivatives.Ix, m_filter_range, sigma);
-    Util::GaussFilter(m_derivatives.Iy, m_derivatives.Iy, m_filter_range, sigma);
-    Util::GaussFilter(m_derivatives.Ixy, m_derivatives.Ixy, m_filter_range, sigma);
+        float *out = responses.get_data_pointer()
+            + static_cast<std::size_t>(ty + j) * responses.width() + tx;
+        for (int i = 0; i < tw; ++i) {
+            float det = row_xx[i] * row_yy[i] - row_xy[i] * row_xy[i];
+            float trace = row_xx[i] + row_yy[i];
+            out[i] = det - k * trace * trace;
+        }
+    }
 }
 
-void Harris::ApplyMeanToDerivatives() {
-    if (m_filter_range == 0)
-        return;
+} // namespace
 
-    Util::MeanFilter(m_derivatives.Ix, m_derivatives.Ix, m_filter_range);
-    Util::MeanFilter(m_derivatives.Ix, m_derivatives.Iy, m_filter_range);
-    Util::MeanFilter(m_derivatives.Ixy, m_derivatives.Ixy, m_filter_range);
+std::vector<float> Harris::WindowKernel() const {
+    if (m_sigma > 1e-7)
+        return Filter::GaussKernel(m_filter_range, m_sigma);
+    int k_size = 2 * m_filter_range + 1;
+    return std::vector<float>(k_size, 1.f / k_size);
 }
 
 void Harris::ComputeHarrisResponses() {
-    m_harris_responses = mve::FloatImage::create(m_derivatives.Ix->width(), m_derivatives.Iy->height(), 1);
-    for (int r = 0; r < m_derivatives.Iy->height(); r++) {
-        for (int c = 0; c < m_derivatives.Iy->width(); c++) {
-            float a11, a12, a21, a22;
+    if (m_orig == nullptr)
+        throw std::runtime_error("No image set");
 
-            a11 = m_derivatives.Ix->at(c, r, 0) * m_derivatives.Ix->at(c, r, 0);
-            a22 = m_derivatives.Iy->at(c, r, 0) * m_derivatives.Iy->at(c, r, 0);
-            a21 = m_derivatives.Ix->at(c, r, 0) * m_derivatives.Iy->at(c, r, 0);
-            a12 = m_derivatives.Ix->at(c, r, 0) * m_derivatives.Iy->at(c, r, 0);
+    int const width = m_orig->width() - 2 - 2 * m_filter_range;
+    int const height = m_orig->height() - 2 - 2 * m_filter_range;
+    if (width <= 0 || height <= 0)
+        throw std::invalid_argument("Image smaller than filter window");
 
-            float det = a11 * a22 - a12 * a21;
-            float trace = a11 + a22;
+    m_harris_responses = mve::FloatImage::create(width, height, 1);
+    std::vector<float> kernel = WindowKernel();
 
-            m_harris_responses->at(c, r, 0) = std::abs(det - m_k * trace * trace);
+    int const tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+    int const tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    int const apron = 2 * m_filter_range;
+#pragma omp parallel
+    {
+        TileBuffers buf;
+        buf.xx.resize((TILE_WIDTH + apron) * (TILE_HEIGHT + apron));
+        buf.yy.resize(buf.xx.size());
+        buf.xy.resize(buf.xx.size());
+        buf.col.resize(3 * (TILE_WIDTH + apron));
+        buf.row.resize(3 * TILE_WIDTH);
+#pragma omp for schedule(dynamic)
+        for (int t = 0; t < tiles_x * tiles_y; ++t) {
+            int tx = (t % tiles_x) * TILE_WIDTH;
+            int ty = (t / tiles_x) * TILE_HEIGHT;
+            int tw = std::min(TILE_WIDTH, width - tx);
+            int th = std::min(TILE_HEIGHT, height - ty);
+            Filter::DispatchTaps(static_cast<int>(kernel.size()), [&](auto taps_tag) {
+                HarrisTile(taps_tag, *m_orig, kernel.data(), m_k, tx, ty, tw, th, buf, *m_harris_responses);
+            });
         }
     }
 }
 
-Harris::KeyPoints Harris::GetMaximaPoints(float percentage, int suppression_radius) {
-    mve::FloatImage::Ptr
-        maxima_suppression_img = mve::FloatImage::create(m_harris_responses->width(), m_harris_responses->height(), 1);
+Harris::KeyPoints Harris::FindLocalMaxima() const {
+    int const width = m_harris_responses->width();
+    int const height = m_harris_responses->height();
+    const float *resp = m_harris_responses->get_data_pointer();
 
-    KeyPoints points;
-    for (int r = 0; r < m_harris_responses->height(); ++r) {
-        for (int c = 0; c < m_harris_responses->width(); ++c) {
-            points.emplace_back(c, r, m_harris_responses->at(c, r, 0));
+    KeyPoints candidates;
+#pragma omp parallel
+    {
+        KeyPoints local;
+#pragma omp for schedule(static) nowait
+        for (int y = 1; y < height - 1; ++y) {
+            const float *up = resp + static_cast<std::size_t>(y - 1) * width;
+            const float *mid = up + width;
+            const float *dn = mid + width;
+            for (int x = 1; x < width - 1; ++x) {
+                float v = mid[x];
+                // strict against earlier neighbors so plateaus yield a single point
+                if (v <= 0 || v <= up[x - 1] || v <= up[x] || v <= up[x + 1] || v <= mid[x - 1])
+                    continue;
+                if (v < mid[x + 1] || v < dn[x - 1] || v < dn[x] || v < dn[x + 1])
+                    continue;
+                local.emplace_back(x, y, v);
+            }
         }
+#pragma omp critical
+        candidates.insert(candidates.end(), local.begin(), local.end());
     }
+    return candidates;
+}
+
+Harris::KeyPoints Harris::GetMaximaPoints(float percentage, int suppression_radius) {
+    std::size_t top_points_cnt = m_harris_responses->get_pixel_amount() * percentage;
+    KeyPoints points = FindLocalMaxima();
+
+    auto weaker = [](const KeyPoint &pt1, const KeyPoint &pt2) {
+      return pt1.corner_response < pt2.corner_response;
+    };
+    std::make_heap(points.begin(), points.end(), weaker);
 
-    std::sort(points.begin(),
-              points.end(),
-              [](const KeyPoint &pt1, const KeyPoint &pt2) {
-                return pt1.corner_response > pt2.corner_response;
-              });
+    /* Accepted points are more than 'suppression_radius' apart, so a grid
+     * with that cell size holds at most one of them per cell and a new point
+     * only needs to check the 3x3 surrounding cells. */
+    int const cell_size = std::max(suppression_radius, 1);
+    std::unordered_map<std::int64_t, std::size_t> accepted_cells;
+    auto cell_key = [](int cx, int cy) {
+      return (static_cast<std::int64_t>(cy) << 32) | static_cast<std::uint32_t>(cx);
+    };
 
-    std::size_t top_points_cnt = points.size() * percentage;
     KeyPoints maxima_points;
-    std::size_t i = 0;
-    while (maxima_points.size() < top_points_cnt) {
-        if (i == points.size()) {
-            break;
-        }
+    auto heap_end = points.end();
+    while (maxima_points.size() < top_points_cnt && heap_end != points.begin()) {
+        std::pop_heap(points.begin(), heap_end, weaker);
+        --heap_end;
+        KeyPoint pt = *heap_end;
 
-        int sup_rows = maxima_suppression_img->height();
-        int sup_cols = maxima_suppression_img->width();
-
-        // Check if point marked in maximaSuppression matrix
-        if (maxima_suppression_img->at(points[i].x, points[i].y, 0) == 0) {
-            for (int r = -suppression_radius; r <= suppression_radius; r++) {
-                for (int c = -suppression_radius; c <= suppression_radius; c++) {
-                    int sx = points[i].x + c;
-                    int sy = points[i].y + r;
-
-                    // bound checking
-                    if (sx >= sup_cols)
-                        sx = sup_cols - 1;
-                    if (sx < 0)
-                        sx = 0;
-                    if (sy >= sup_rows)
-                        sy = sup_rows - 1;
-                    if (sy < 0)
-                        sy = 0;
-
-                    maxima_suppression_img->at(sx, sy, 0) = 1;
-                }
+        int const cx = pt.x / cell_size;
+        int const cy = pt.y / cell_size;
+        bool suppressed = false;
+        for (int dy = -1; dy <= 1 && !suppressed; ++dy) {
+            for (int dx = -1; dx <= 1 && !suppressed; ++dx) {
+                auto iter = accepted_cells.find(cell_key(cx + dx, cy + dy));
+                if (iter == accepted_cells.end())
+                    continue;
+                const KeyPoint &other = maxima_points[iter->second];
+                suppressed = std::abs(other.x - pt.x) <= suppression_radius
+                    && std::abs(other.y - pt.y) <= suppression_radius;
             }
-
-            // Convert back to original image coordinate system
-            points[i].x += 1 + m_filter_range;
-            points[i].y += 1 + m_filter_range;
-            maxima_points.push_back(points[i]);
         }
-        i++;
+        if (suppressed)
+            continue;
+
+        accepted_cells[cell_key(cx, cy)] = maxima_points.size();
+        maxima_points.push_back(pt);
+    }
+
+    // Convert back to original image coordinate system
+    for (auto &pt : maxima_points) {
+        pt.x += 1 + m_filter_range;
+        pt.y += 1 + m_filter_range;
     }
     return maxima_points;
 }
+
+Harris::KeyPoints Harris::GetGridMaximaPoints(std::size_t num_points, int cell_size) {
+    cell_size = std::max(cell_size, 1);
+    int const cells_x = (m_harris_responses->width() + cell_size - 1) / cell_size;
+    int const cells_y = (m_harris_responses->height() + cell_size - 1) / cell_size;
+    std::size_t const quota = (num_points + cells_x * cells_y - 1) / (cells_x * cells_y);
+
+    KeyPoints points = FindLocalMaxima();
+    auto cell_of = [cell_size, cells_x](const KeyPoint &pt) {
+      return (pt.y / cell_size) * cells_x + pt.x / cell_size;
+    };
+    auto stronger = [](const KeyPoint &pt1, const KeyPoint &pt2) {
+      return pt1.corner_response > pt2.corner_response;
+    };
+    std::sort(points.begin(), points.end(), [&cell_of](const KeyPoint &pt1, const KeyPoint &pt2) {
+      return cell_of(pt1) < cell_of(pt2);
+    });
+
+    /* Keep the 'quota' strongest points of every bucket. */
+    KeyPoints selected;
+    for (auto begin = points.begin(); begin != points.end();) {
+        int const cell = cell_of(*begin);
+        auto end = std::find_if(begin, points.end(), [&](const KeyPoint &pt) { return cell_of(pt) != cell; });
+        auto keep = begin + std::min<std::size_t>(quota, end - begin);
+        std::nth_element(begin, keep, end, stronger);
+        selected.insert(selected.end(), begin, keep);
+        begin = end;
+    }
+
+    if (selected.size() > num_points) {
+        std::nth_element(selected.begin(), selected.begin() + num_points, selected.end(), stronger);
+        selected.erase(selected.begin() + num_points, selected.end());
+    }
+    std::sort(selected.begin(), selected.end(), stronger);
+
+    // Convert back to original image coordinate system
+    for (auto &pt : selected) {
+        pt.x += 1 + m_filter_range;
+        pt.y += 1 + m_filter_range;
+    }
+    return selected;
+}
@@ -0,0 +1,60 @@
+#include "feature/HarrisPyramid.hpp"
+#include "feature/Harris.hpp"
+#include "mve/image_tools.h"
+#include <stdexcept>
+
+HarrisPyramid::HarrisPyramid(const Options &opts) : m_opts(opts) {
+
+}
+
+void HarrisPyramid::SetImage(const mve::ByteImage::ConstPtr &img) {
+    if (img->channels() != 1 && img->channels() != 3)
+        throw std::invalid_argument("Gray or color image expected");
+
+    m_orig = img;
+    if (img->channels() == 3)
+        m_orig = mve::image::desaturate<uint8_t>(img, mve::image::DESATURATE_AVERAGE);
+}
+
+void HarrisPyramid::Process() {
+    m_features.clear();
+    m_descriptors.clear();
+
+    /* Octaves stop once the descriptor patch no longer fits comfortably. */
+    int const min_size = 4 * (Brief::PATCH_RADIUS + 1);
+    std::vector<mve::ByteImage::ConstPtr> levels(1, m_orig);
+    double total_area = m_orig->get_pixel_amount();
+    while (static_cast<int>(levels.size()) < m_opts.num_octaves
+        && levels.back()->width() / 2 >= min_size && levels.back()->height() / 2 >= min_size) {
+        levels.push_back(mve::image::rescale_half_size_gaussian<uint8_t>(levels.back()));
+        total_area += levels.back()->get_pixel_amount();
+    }
+
+    for (std::size_t o = 0; o < levels.size(); ++o) {
+        const mve::ByteImage::ConstPtr &level = levels[o];
+        std::size_t budget = m_opts.max_features * (level->get_pixel_amount() / total_area);
+        if (budget == 0)
+            continue;
+
+        Harris harris(m_opts.k, m_opts.filter_range, m_opts.sigma);
+        harris.SetImage(level);
+        harris.Process();
+        Harris::KeyPoints points = harris.GetGridMaximaPoints(budget, m_opts.cell_size);
+
+        mve::ByteImage::Ptr smoothed = mve::image::blur_gaussian<uint8_t>(level, m_opts.descriptor_sigma);
+        float const scale = static_cast<float>(1 << o);
+        int const border = Brief::PATCH_RADIUS;
+        for (const auto &pt : points) {
+            if (pt.x < border || pt.y < border
+                || pt.x >= level->width() - border || pt.y >= level->height() - border)
+                continue;
+            Feature feature;
+            feature.x = (pt.x + 0.5f) * scale - 0.5f;
+            feature.y = (pt.y + 0.5f) * scale - 0.5f;
+            feature.octave = static_cast<int>(o);
+            feature.corner_response = pt.corner_response;
+            m_features.push_back(feature);
+            m_descriptors.push_back(m_brief.Compute(*smoothed, pt.x, pt.y));
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#include "feature/QuantizedMatcher.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/** Rows of 'set_2' kept in cache while a block of 'set_1' runs over them,
+ * a multiple of 4 */
+constexpr std::size_t TILE_ROWS = 128;
+/** Rows of 'set_1' run over each tile in turn */
+constexpr std::size_t QUERY_BLOCK = 64;
+
+namespace {
+
+/** Dot products of 'query' with the four rows from 'rows' on. */
+inline void Dot4(const std::int8_t *query, const std::int8_t *rows, int stride, std::int32_t *dots) {
+#if defined(__AVX2__)
+    __m256i const ones = _mm256_set1_epi16(1);
+    __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                      _mm256_setzero_si256(), _mm256_setzero_si256()};
+    for (int d = 0; d < stride; d += 32) {
+        __m256i const q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query + d));
+        /* vpmaddubsw needs one unsigned operand, the sign of 'q' moves to
+         * the row. Values within [-127, 127] keep the pair sums from
+         * saturating. */
+        __m256i const q_abs = _mm256_sign_epi8(q, q);
+        for (int r = 0; r < 4; ++r) {
+            __m256i const row = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows + r * stride + d));
+            __m256i const pairs = _mm256_maddubs_epi16(q_abs, _mm256_sign_epi8(row, q));
+            acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(pairs, ones));
+        }
+    }
+    __m256i const sums = _mm256_hadd_epi32(_mm256_hadd_epi32(acc[0], acc[1]),
+                                           _mm256_hadd_epi32(acc[2], acc[3]));
+    __m128i const total = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dots), total);
+#else
+    for (int r = 0; r < 4; ++r) {
+        std::int32_t dot = 0;
+        for (int d = 0; d < stride; ++d)
+            dot += query[d] * rows[r * stride + d];
+        dots[r] = dot;
+    }
+#endif
+}
+
+} // namespace
+
+QuantizedMatcher::QuantizedMatcher(const Options &opts) : m_opts(opts) {
+
+}
+
+QuantizedMatcher::Descriptors QuantizedMatcher::Quantize(const std::vector<float> &rows, int dim) {
+    if (dim <= 0)
+        throw std::invalid_argument("Invalid descriptor dimension");
+    std::size_t const num = rows.size() / dim;
+    Descriptors out;
+    out.stride = (dim + 31) / 32 * 32;
+    out.values.assign((num + 3) / 4 * 4 * out.stride, 0);
+    out.steps.resize(num);
+    out.square_norms.resize(num);
+    for (std::size_t i = 0; i < num; ++i) {
+        const float *row = &rows[i * dim];
+        float max_abs = 0.f;
+        float square_norm = 0.f;
+        for (int d = 0; d < dim; ++d) {
+            max_abs = std::max(max_abs, std::abs(row[d]));
+            square_norm += row[d] * row[d];
+        }
+        float const step = max_abs > 0.f ? max_abs / 127.f : 1.f;
+        for (int d = 0; d < dim; ++d)
+            out.values[i * out.stride + d] = static_cast<std::int8_t>(std::lround(row[d] / step));
+        out.steps[i] = step;
+        out.square_norms[i] = square_norm;
+    }
+    return out;
+}
+
+void QuantizedMatcher::Match(const Descriptors &set_1,
+                             const Descriptors &set_2,
+                             std::vector<int> *matches_1_2) const {
+    matches_1_2->assign(set_1.size(), -1);
+    if (set_1.size() == 0 || set_2.size() < 2)
+        return;
+    if (set_1.stride != set_2.stride)
+        throw std::invalid_argument("Descriptors of different dimensions");
+
+    /* One sweep collects the two nearest neighbors of every 'set_1'
+     * descriptor and the nearest neighbor of every 'set_2' descriptor, by
+     * squared distance. */
+    std::size_t const num_1 = set_1.size();
+    std::size_t const num_2 = set_2.size();
+    int const stride = set_1.stride;
+    float const max_dist = std::numeric_limits<float>::max();
+    std::vector<int> best(num_1, -1);
+    std::vector<float> best_dist(num_1, max_dist);
+    std::vector<float> second_dist(num_1, max_dist);
+    std::vector<int> best_2_1(num_2, -1);
+    std::vector<float> best_2_1_dist(num_2, max_dist);
+    for (std::size_t block = 0; block < num_1; block += QUERY_BLOCK) {
+        std::size_t const block_end = std::min(num_1, block + QUERY_BLOCK);
+        for (std::size_t tile = 0; tile < num_2; tile += TILE_ROWS) {
+            std::size_t const tile_end = std::min(num_2, tile + TILE_ROWS);
+            for (std::size_t i = block; i < block_end; ++i) {
+                const std::int8_t *query = &set_1.values[i * stride];
+                float const scale = 2.f * set_1.steps[i];
+                for (std::size_t j = tile; j < tile_end; j += 4) {
+                    std::int32_t dots[4];
+                    Dot4(query, &set_2.values[j * stride], stride, dots);
+                    for (std::size_t r = 0; r < 4 && j + r < tile_end; ++r) {
+                        float const dist = std::max(0.f, set_1.square_norms[i] + set_2.square_norms[j + r]
+                            - scale * set_2.steps[j + r] * static_cast<float>(dots[r]));
+                        if (dist < best_dist[i]) {
+                            second_dist[i] = best_dist[i];
+                            best_dist[i] = dist;
+                            best[i] = static_cast<int>(j + r);
+                        } else if (dist < second_dist[i]) {
+                            second_dist[i] = dist;
+                        }
+                        if (dist < best_2_1_dist[j + r]) {
+                            best_2_1_dist[j + r] = dist;
+                            best_2_1[j + r] = static_cast<int>(i);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    float const square_ratio = m_opts.lowe_ratio * m_opts.lowe_ratio;
+    for (std::size_t i = 0; i < num_1; ++i) {
+        if (best_dist[i] < square_ratio * second_dist[i] && best_2_1[best[i]] == static_cast<int>(i))
+            matches_1_2->at(i) = best[i];
+    }
+}
@@ -0,0 +1,207 @@
+#include "feature/VocabTree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+/** Seed of the k-means++ initialization, trees are reproducible */
+constexpr unsigned KMEANS_SEED = 0;
+
+namespace {
+
+float SquaredDistance(const float *a, const float *b, int dim) {
+    float dist = 0.f;
+    for (int d = 0; d < dim; ++d) {
+        float const diff = a[d] - b[d];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+/** Index of the center in 'centers' closest to 'point'. */
+int Nearest(const float *point, const float *centers, int num_centers, int dim) {
+    int best = 0;
+    float best_dist = std::numeric_limits<float>::max();
+    for (int c = 0; c < num_centers; ++c) {
+        float const dist = SquaredDistance(point, centers + c * dim, dim);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = c;
+        }
+    }
+    return best;
+}
+
+/** k-means++ seeded Lloyd iterations over the 'indices' rows of 'samples'.
+ * Returns the centers, 'labels' gets the cluster of every index. */
+std::vector<float> KMeans(const std::vector<float> &samples, const std::vector<std::size_t> &indices,
+                          int k, int dim, int iterations, std::vector<int> *labels) {
+    std::size_t const n = indices.size();
+    std::mt19937 rng(KMEANS_SEED + static_cast<unsigned>(n));
+    std::vector<float> centers(static_cast<std::size_t>(k) * dim);
+    auto row = [&](std::size_t i) { return samples.data() + indices[i] * dim; };
+
+    std::vector<float> min_dist(n, std::numeric_limits<float>::max());
+    std::size_t pick = std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+    for (int c = 0; c < k; ++c) {
+        std::copy(row(pick), row(pick) + dim, centers.begin() + c * dim);
+        double total = 0.0;
+        for (std::size_t i = 0; i < n; ++i) {
+            min_dist[i] = std::min(min_dist[i], SquaredDistance(row(i), &centers[c * dim], dim));
+            total += min_dist[i];
+        }
+        double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+        for (pick = 0; pick + 1 < n && target >= min_dist[pick]; ++pick)
+            target -= min_dist[pick];
+    }
+
+    labels->assign(n, -1);
+    std::vector<double> sums(centers.size());
+    std::vector<std::size_t> counts(k);
+    for (int it = 0; it < iterations; ++it) {
+        std::size_t changed = 0;
+#pragma omp parallel for reduction(+:changed)
+        for (std::size_t i = 0; i < n; ++i) {
+            int const label = Nearest(row(i), centers.data(), k, dim);
+            changed += label != (*labels)[i];
+            (*labels)[i] = label;
+        }
+        if (changed == 0)
+            break;
+
+        /* Empty clusters keep their center. */
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (std::size_t i = 0; i < n; ++i) {
+            int const label = (*labels)[i];
+            counts[label] += 1;
+            for (int d = 0; d < dim; ++d)
+                sums[label * dim + d] += row(i)[d];
+        }
+        for (int c = 0; c < k; ++c)
+            if (counts[c] > 0)
+                for (int d = 0; d < dim; ++d)
+                    centers[c * dim + d] = static_cast<float>(sums[c * dim + d] / counts[c]);
+    }
+    return centers;
+}
+
+} // namespace
+
+VocabTree::VocabTree(const Options &opts, int dim) : m_opts(opts), m_dim(dim), m_num_words(0) {
+    if (dim <= 0 || opts.branching < 2 || opts.depth < 1)
+        throw std::invalid_argument("Invalid vocabulary tree options");
+}
+
+void VocabTree::Train(const Descriptors &samples) {
+    std::size_t const n = samples.size() / m_dim;
+    if (n == 0)
+        throw std::invalid_argument("No descriptors to train the vocabulary tree");
+    m_nodes.assign(1, Node{0, 0, 0});
+    m_centers.assign(m_dim, 0.f);
+    m_num_words = 0;
+    m_images.clear();
+    m_inverted.clear();
+    std::vector<std::size_t> indices(n);
+    std::iota(indices.begin(), indices.end(), 0);
+    Split(0, samples, indices, 0);
+}
+
+void VocabTree::Split(std::size_t node, const Descriptors &samples,
+                      std::vector<std::size_t> &indices, int level) {
+    if (level == m_opts.depth || indices.size() <= static_cast<std::size_t>(m_opts.branching)) {
+        m_nodes[node].word = static_cast<std::uint32_t>(m_num_words++);
+        return;
+    }
+
+    std::vector<int> labels;
+    std::vector<float> const centers = KMeans(samples, indices, m_opts.branching, m_dim,
+                                              m_opts.kmeans_iterations, &labels);
+    std::size_t const first_child = m_nodes.size();
+    m_nodes[node].first_child = first_child;
+    m_nodes[node].num_children = m_opts.branching;
+    for (int c = 0; c < m_opts.branching; ++c)
+        m_nodes.push_back(Node{0, 0, 0});
+    m_centers.insert(m_centers.end(), centers.begin(), centers.end());
+
+    for (int c = 0; c < m_opts.branching; ++c) {
+        std::vector<std::size_t> cluster;
+        for (std::size_t i = 0; i < indices.size(); ++i)
+            if (labels[i] == c)
+                cluster.push_back(indices[i]);
+        Split(first_child + c, samples, cluster, level + 1);
+    }
+}
+
+std::uint32_t VocabTree::Word(const float *descriptor) const {
+    std::size_t node = 0;
+    while (m_nodes[node].num_children > 0) {
+        std::size_t const first = m_nodes[node].first_child;
+        node = first + Nearest(descriptor, &m_centers[first * m_dim], m_nodes[node].num_children, m_dim);
+    }
+    return m_nodes[node].word;
+}
+
+VocabTree::BagOfWords VocabTree::Quantize(const Descriptors &descriptors) const {
+    if (m_num_words == 0)
+        throw std::logic_error("Vocabulary tree is not trained");
+    std::vector<std::uint32_t> words(descriptors.size() / m_dim);
+    for (std::size_t i = 0; i < words.size(); ++i)
+        words[i] = Word(&descriptors[i * m_dim]);
+    std::sort(words.begin(), words.end());
+
+    BagOfWords bag;
+    for (std::uint32_t word : words) {
+        if (!bag.empty() && bag.back().first == word)
+            bag.back().second += 1.f;
+        else
+            bag.emplace_back(word, 1.f);
+    }
+    return bag;
+}
+
+void VocabTree::Index(std::vector<BagOfWords> images) {
+    m_images = std::move(images);
+    std::vector<std::size_t> frequency(m_num_words, 0);
+    for (const auto &bag : m_images)
+        for (const auto &entry : bag)
+            frequency[entry.first] += 1;
+
+    /* Words seen in every image get no weight. */
+    m_inverted.assign(m_num_words, {});
+    double const num_images = static_cast<double>(m_images.size());
+    for (std::size_t i = 0; i < m_images.size(); ++i) {
+        float sum = 0.f;
+        for (auto &entry : m_images[i]) {
+            entry.second *= static_cast<float>(std::log(num_images / frequency[entry.first]));
+            sum += entry.second;
+        }
+        for (auto &entry : m_images[i]) {
+            if (sum > 0.f)
+                entry.second /= sum;
+            if (entry.second > 0.f)
+                m_inverted[entry.first].emplace_back(static_cast<std::uint32_t>(i), entry.second);
+        }
+    }
+}
+
+std::vector<std::pair<std::size_t, float>> VocabTree::Query(std::size_t image, std::size_t k) const {
+    std::vector<float> scores(m_images.size(), 0.f);
+    for (const auto &entry : m_images.at(image))
+        for (const auto &posting : m_inverted[entry.first])
+            scores[posting.first] += std::min(entry.second, posting.second);
+
+    std::vector<std::pair<std::size_t, float>> ranked;
+    for (std::size_t i = 0; i < scores.size(); ++i)
+        if (i != image && scores[i] > 0.f)
+            ranked.emplace_back(i, scores[i]);
+    k = std::min(k, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(),
+                      [](const std::pair<std::size_t, float> &a, const std::pair<std::size_t, float> &b) {
+                        return a.second > b.second || (a.second == b.second && a.first < b.first);
+                      });
+    ranked.resize(k);
+    return ranked;
+}
@@ -0,0 +1,128 @@
+#include "filter/BoxFilter.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace Filter {
+
+namespace {
+
+/* Rows per parallel block, the column sums restart at each block which
+ * also bounds the drift of the running sums. */
+constexpr int BLOCK_ROWS = 64;
+
+template<typename Acc>
+void BoxFilterRows(const float *src, int in_width, int out_width, int out_height,
+                   int k_size, float *dst) {
+    Acc const normal = Acc(1) / (k_size * k_size);
+    int const num_blocks = (out_height + BLOCK_ROWS - 1) / BLOCK_ROWS;
+#pragma omp parallel
+    {
+        std::vector<Acc> col_sum(in_width);
+#pragma omp for schedule(dynamic)
+        for (int b = 0; b < num_blocks; ++b) {
+            int const y0 = b * BLOCK_ROWS;
+            int const y1 = std::min(y0 + BLOCK_ROWS, out_height);
+            std::fill(col_sum.begin(), col_sum.end(), Acc(0));
+            for (int j = 0; j < k_size; ++j) {
+                const float *row = src + static_cast<std::size_t>(y0 + j) * in_width;
+                for (int x = 0; x < in_width; ++x)
+                    col_sum[x] += row[x];
+            }
+            for (int y = y0; y < y1; ++y) {
+                if (y > y0) {
+                    const float *add = src + static_cast<std::size_t>(y + k_size - 1) * in_width;
+                    const float *sub = src + static_cast<std::size_t>(y - 1) * in_width;
+                    for (int x = 0; x < in_width; ++x)
+                        col_sum[x] += Acc(add[x]) - Acc(sub[x]);
+                }
+                float *out = dst + static_cast<std::size_t>(y) * out_width;
+                Acc sum = 0;
+                for (int x = 0; x < k_size; ++x)
+                    sum += col_sum[x];
+                out[0] = static_cast<float>(sum * normal);
+                for (int x = 1; x < out_width; ++x) {
+                    sum += col_sum[x + k_size - 1] - col_sum[x - 1];
+                    out[x] = static_cast<float>(sum * normal);
+                }
+            }
+        }
+    }
+}
+
+template<typename T, typename Acc>
+typename mve::Image<Acc>::Ptr IntegralImage(const mve::Image<T> &img) {
+    if (img.channels() != 1)
+        throw std::invalid_argument("Single channel image expected");
+    int const width = img.width();
+    int const height = img.height();
+    typename mve::Image<Acc>::Ptr integral = mve::Image<Acc>::create(width + 1, height + 1, 1);
+    Acc *data = integral->get_data_pointer();
+    std::fill(data, data + width + 1, Acc(0));
+
+    /* Prefix sums along rows are independent... */
+#pragma omp parallel for schedule(static)
+    for (int r = 0; r < height; ++r) {
+        const T *in = img.get_data_pointer() + static_cast<std::size_t>(r) * width;
+        Acc *row = data + static_cast<std::size_t>(r + 1) * (width + 1);
+        Acc sum = 0;
+        row[0] = 0;
+        for (int c = 0; c < width; ++c) {
+            sum += in[c];
+            row[c + 1] = sum;
+        }
+    }
+
+    /* ...and so are the ones down each strip of columns. */
+    int const strip = 256;
+    int const num_strips = (width + 1 + strip - 1) / strip;
+#pragma omp parallel for schedule(static)
+    for (int s = 0; s < num_strips; ++s) {
+        int const c0 = s * strip;
+        int const c1 = std::min(c0 + strip, width + 1);
+        for (int r = 2; r <= height; ++r) {
+            const Acc *prev = data + static_cast<std::size_t>(r - 1) * (width + 1);
+            Acc *row = data + static_cast<std::size_t>(r) * (width + 1);
+            for (int c = c0; c < c1; ++c)
+                row[c] += prev[c];
+        }
+    }
+    return integral;
+}
+
+} // namespace
+
+void BoxFilter(const mve::FloatImage::ConstPtr &img,
+               mve::FloatImage::Ptr &out,
+               int filter_range,
+               BoxAccumulator accumulator) {
+    if (img->channels() != 1)
+        throw std::invalid_argument("Single channel image expected");
+
+    // hold the source, 'out' may alias it and is replaced below
+    mve::FloatImage::ConstPtr src = img;
+    int const k_size = 2 * filter_range + 1;
+    int const out_width = src->width() - 2 * filter_range;
+    int const out_height = src->height() - 2 * filter_range;
+    if (filter_range < 0 || out_width <= 0 || out_height <= 0)
+        throw std::invalid_argument("Image smaller than filter window");
+
+    mve::FloatImage::Ptr result = mve::FloatImage::create(out_width, out_height, 1);
+    if (accumulator == BOX_ACCUMULATE_DOUBLE)
+        BoxFilterRows<double>(src->get_data_pointer(), src->width(), out_width, out_height,
+                              k_size, result->get_data_pointer());
+    else
+        BoxFilterRows<float>(src->get_data_pointer(), src->width(), out_width, out_height,
+                             k_size, result->get_data_pointer());
+    out = result;
+}
+
+mve::DoubleImage::Ptr IntegralImage(const mve::FloatImage::ConstPtr &img) {
+    return IntegralImage<float, double>(*img);
+}
+
+mve::Image<std::int64_t>::Ptr IntegralImage(const mve::ByteImage::ConstPtr &img) {
+    return IntegralImage<uint8_t, std::int64_t>(*img);
+}
+
+} // namespace Filter
@@ -0,0 +1,75 @@
+#include "filter/Convolution.hpp"
+#include "filter/Kernel.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace Filter {
+
+namespace {
+
+/* Each thread keeps one row of scratch: the column pass of output row y lands
+ * there and the row pass reads it back, so no full size intermediate exists. */
+template<typename Taps>
+void SeparableFilter(Taps taps, const float *src, int in_width, int out_width, int out_height,
+                     const float *kernel, float *dst) {
+#pragma omp parallel
+    {
+        std::vector<float> scratch(in_width);
+#pragma omp for schedule(static)
+        for (int y = 0; y < out_height; ++y) {
+            Convolve1D(taps, src + static_cast<std::size_t>(y) * in_width, in_width, in_width,
+                       kernel, scratch.data());
+            Convolve1D(taps, scratch.data(), 1, out_width,
+                       kernel, dst + static_cast<std::size_t>(y) * out_width);
+        }
+    }
+}
+
+} // namespace
+
+std::vector<float> GaussKernel(int radius, float sigma) {
+    std::vector<float> kernel(2 * radius + 1);
+    double sum = 0;
+    for (int a = -radius; a <= radius; ++a) {
+        double m = std::exp(-1.0 * a * a / (2.0 * sigma * sigma));
+        kernel[a + radius] = m;
+        sum += m;
+    }
+    for (auto &c : kernel)
+        c = static_cast<float>(c / sum);
+    return kernel;
+}
+
+void SeparableFilter(const mve::FloatImage::ConstPtr &img,
+                     mve::FloatImage::Ptr &out,
+                     const std::vector<float> &kernel) {
+    if (img->channels() != 1)
+        throw std::invalid_argument("Single channel image expected");
+    if (kernel.size() % 2 == 0)
+        throw std::invalid_argument("Odd kernel size expected");
+
+    // hold the source, 'out' may alias it and is replaced below
+    mve::FloatImage::ConstPtr src = img;
+    int taps = static_cast<int>(kernel.size());
+    int out_width = src->width() - taps + 1;
+    int out_height = src->height() - taps + 1;
+    if (out_width <= 0 || out_height <= 0)
+        throw std::invalid_argument("Image smaller than filter kernel");
+
+    mve::FloatImage::Ptr result = mve::FloatImage::create(out_width, out_height, 1);
+    const float *in = src->get_data_pointer();
+    float *dst = result->get_data_pointer();
+    DispatchTaps(taps, [&](auto taps_tag) {
+        SeparableFilter(taps_tag, in, src->width(), out_width, out_height, kernel.data(), dst);
+    });
+    out = result;
+}
+
+void GaussFilter(const mve::FloatImage::ConstPtr &img,
+                 mve::FloatImage::Ptr &out,
+                 int filter_range,
+                 float sigma) {
+    SeparableFilter(img, out, GaussKernel(filter_range, sigma));
+}
+
+} // namespace Filter
@@ -0,0 +1,141 @@
+#include "filter/DepthFusion.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace Filter {
+
+namespace {
+
+/** Scalar fusion of pixel 'p', also the reference of the vector kernels. */
+float FusePixel(const float *const *src, int num, std::size_t p, DepthFusion fusion, float agreement) {
+    float values[MAX_FUSED_DEPTHS];
+    int count = 0;
+    for (int i = 0; i < num; ++i)
+        if (src[i][p] > 0.f)
+            values[count++] = src[i][p];
+    if (count == 0)
+        return 0.f;
+
+    if (fusion == DEPTH_FUSION_MEDIAN) {
+        std::sort(values, values + count);
+        if (count % 2 == 1)
+            return values[count / 2];
+        return 0.5f * (values[count / 2 - 1] + values[count / 2]);
+    }
+
+    float sum = 0.f, weight_sum = 0.f;
+    for (int i = 0; i < count; ++i) {
+        float support = 0.f;
+        for (int j = 0; j < count; ++j)
+            support += std::abs(values[i] - values[j]) <= agreement * values[i] ? 1.f : 0.f;
+        float const weight = support * support;
+        sum += weight * values[i];
+        weight_sum += weight;
+    }
+    return sum / weight_sum;
+}
+
+#if defined(__AVX__)
+/** Median of 8 pixels. Missing depths become +inf and sort to the end of
+ * an odd-even transposition network, then every lane picks its middle from
+ * its own count of valid depths. */
+__m256 MedianAVX(const __m256 *d, int num) {
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 s[MAX_FUSED_DEPTHS];
+    __m256 count = zero;
+    for (int i = 0; i < num; ++i) {
+        __m256 const valid = _mm256_cmp_ps(d[i], zero, _CMP_GT_OQ);
+        s[i] = _mm256_blendv_ps(inf, d[i], valid);
+        count = _mm256_add_ps(count, _mm256_and_ps(valid, _mm256_set1_ps(1.f)));
+    }
+    for (int pass = 0; pass < num; ++pass)
+        for (int i = pass % 2; i + 1 < num; i += 2) {
+            __m256 const lo = _mm256_min_ps(s[i], s[i + 1]);
+            s[i + 1] = _mm256_max_ps(s[i], s[i + 1]);
+            s[i] = lo;
+        }
+
+    /* Middle indices (count - 1) / 2 and count / 2, equal for odd counts. */
+    __m256 const half = _mm256_set1_ps(0.5f);
+    __m256 const lower = _mm256_floor_ps(_mm256_mul_ps(_mm256_sub_ps(count, _mm256_set1_ps(1.f)), half));
+    __m256 const upper = _mm256_floor_ps(_mm256_mul_ps(count, half));
+    __m256 a = zero, b = zero;
+    for (int i = 0; i < num; ++i) {
+        __m256 const index = _mm256_set1_ps(static_cast<float>(i));
+        a = _mm256_blendv_ps(a, s[i], _mm256_cmp_ps(lower, index, _CMP_EQ_OQ));
+        b = _mm256_blendv_ps(b, s[i], _mm256_cmp_ps(upper, index, _CMP_EQ_OQ));
+    }
+    __m256 const median = _mm256_mul_ps(_mm256_add_ps(a, b), half);
+    return _mm256_and_ps(median, _mm256_cmp_ps(count, zero, _CMP_GT_OQ));
+}
+
+__m256 ConsensusAVX(const __m256 *d, int num, float agreement) {
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const one = _mm256_set1_ps(1.f);
+    __m256 const tolerance = _mm256_set1_ps(agreement);
+    __m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 valid[MAX_FUSED_DEPTHS];
+    for (int i = 0; i < num; ++i)
+        valid[i] = _mm256_cmp_ps(d[i], zero, _CMP_GT_OQ);
+
+    __m256 sum = zero, weight_sum = zero;
+    for (int i = 0; i < num; ++i) {
+        __m256 const limit = _mm256_mul_ps(tolerance, d[i]);
+        __m256 support = zero;
+        for (int j = 0; j < num; ++j) {
+            __m256 const diff = _mm256_and_ps(_mm256_sub_ps(d[i], d[j]), abs_mask);
+            __m256 const agree = _mm256_and_ps(_mm256_cmp_ps(diff, limit, _CMP_LE_OQ), valid[j]);
+            support = _mm256_add_ps(support, _mm256_and_ps(agree, one));
+        }
+        __m256 const weight = _mm256_and_ps(_mm256_mul_ps(support, support), valid[i]);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(weight, d[i]));
+        weight_sum = _mm256_add_ps(weight_sum, weight);
+    }
+    __m256 const any = _mm256_cmp_ps(weight_sum, zero, _CMP_GT_OQ);
+    return _mm256_and_ps(_mm256_div_ps(sum, _mm256_blendv_ps(one, weight_sum, any)), any);
+}
+#endif
+
+} // namespace
+
+mve::FloatImage::Ptr FuseDepths(const std::vector<mve::FloatImage::ConstPtr> &depths,
+                                DepthFusion fusion, float agreement) {
+    if (depths.empty())
+        throw std::invalid_argument("No depth maps to fuse");
+    if (depths.size() > static_cast<std::size_t>(MAX_FUSED_DEPTHS))
+        throw std::invalid_argument("Too many depth maps to fuse");
+    int const num = static_cast<int>(depths.size());
+    const float *src[MAX_FUSED_DEPTHS];
+    for (int i = 0; i < num; ++i) {
+        if (depths[i]->channels() != 1 || depths[i]->width() != depths[0]->width()
+            || depths[i]->height() != depths[0]->height())
+            throw std::invalid_argument("Depth maps differ in size");
+        src[i] = depths[i]->get_data_pointer();
+    }
+
+    mve::FloatImage::Ptr out = mve::FloatImage::create(depths[0]->width(), depths[0]->height(), 1);
+    float *dst = out->get_data_pointer();
+    std::size_t const n = out->get_pixel_amount();
+    std::size_t p = 0;
+#if defined(__AVX__)
+    __m256 d[MAX_FUSED_DEPTHS];
+    for (; p + 8 <= n; p += 8) {
+        for (int i = 0; i < num; ++i)
+            d[i] = _mm256_loadu_ps(src[i] + p);
+        __m256 const fused = fusion == DEPTH_FUSION_MEDIAN ? MedianAVX(d, num) : ConsensusAVX(d, num, agreement);
+        _mm256_storeu_ps(dst + p, fused);
+    }
+#endif
+    for (; p < n; ++p)
+        dst[p] = FusePixel(src, num, p, fusion, agreement);
+    return out;
+}
+
+} // namespace Filter
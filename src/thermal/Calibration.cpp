@@ -0,0 +1,696 @@
+#include "thermal/Calibration.hpp"
+#include "filter/BoxFilter.hpp"
+#include "math/defines.h"
+#include "math/matrix_svd.h"
+#include "mve/image_tools.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+
+namespace Thermal {
+
+namespace {
+
+struct Blob {
+    math::Vec2d center;
+    int area;
+};
+
+/** Connected dark regions of 'gray' that look like dots. A pixel is dark if
+ * it is 'threshold_offset' below the mean of its neighborhood, so the board
+ * may be lit unevenly. */
+std::vector<Blob> DetectBlobs(const mve::ByteImage::ConstPtr &gray, const GridOptions &opts) {
+    int const width = gray->width();
+    int const height = gray->height();
+    int const radius = std::max(4, std::min(width, height) / 16);
+    mve::Image<std::int64_t>::ConstPtr integral = Filter::IntegralImage(gray);
+    auto local_mean = [&](int x, int y) {
+      int const x0 = std::max(x - radius, 0), x1 = std::min(x + radius + 1, width);
+      int const y0 = std::max(y - radius, 0), y1 = std::min(y + radius + 1, height);
+      std::int64_t const sum = integral->at(x1, y1, 0) - integral->at(x0, y1, 0)
+                               - integral->at(x1, y0, 0) + integral->at(x0, y0, 0);
+      return static_cast<double>(sum) / ((x1 - x0) * (y1 - y0));
+    };
+
+    /* Darkness below the local mean, 0 for board pixels. */
+    std::vector<float> weight(static_cast<std::size_t>(width) * height, 0.f);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            double const d = local_mean(x, y) - gray->at(x, y, 0);
+            if (d > opts.threshold_offset)
+                weight[y * width + x] = static_cast<float>(d);
+        }
+
+    std::vector<Blob> blobs;
+    std::vector<int> stack;
+    for (int start = 0; start < width * height; ++start) {
+        if (weight[start] <= 0.f)
+            continue;
+        int area = 0;
+        int min_x = width, max_x = -1, min_y = height, max_y = -1;
+        double sw = 0, sx = 0, sy = 0;
+        stack.assign(1, start);
+        float const w0 = weight[start];
+        weight[start] = -w0;
+        while (!stack.empty()) {
+            int const p = stack.back();
+            stack.pop_back();
+            int const x = p % width, y = p / width;
+            double const w = -weight[p];
+            area++;
+            sw += w;
+            sx += w * x;
+            sy += w * y;
+            min_x = std::min(min_x, x), max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y), max_y = std::max(max_y, y);
+            int const neighbors[4] = {x > 0 ? p - 1 : -1, x + 1 < width ? p + 1 : -1,
+                                      y > 0 ? p - width : -1, y + 1 < height ? p + width : -1};
+            for (int q : neighbors)
+                if (q >= 0 && weight[q] > 0.f) {
+                    weight[q] = -weight[q];
+                    stack.push_back(q);
+                }
+        }
+
+        if (area < opts.min_area || area > opts.max_area)
+            continue;
+        if (min_x == 0 || min_y == 0 || max_x == width - 1 || max_y == height - 1)
+            continue;
+        int const bw = max_x - min_x + 1, bh = max_y - min_y + 1;
+        // a disc fills pi / 4 of its box, also under perspective
+        if (area < 0.5 * bw * bh || std::max(bw, bh) > 4 * std::min(bw, bh))
+            continue;
+        blobs.push_back({math::Vec2d(sx / sw, sy / sw), area});
+    }
+
+    /* Dots are of similar size, which drops most of the print on the board. */
+    if (!blobs.empty()) {
+        std::vector<int> areas;
+        for (Blob const &b : blobs)
+            areas.push_back(b.area);
+        std::nth_element(areas.begin(), areas.begin() + areas.size() / 2, areas.end());
+        int const median = areas[areas.size() / 2];
+        blobs.erase(std::remove_if(blobs.begin(), blobs.end(), [&](Blob const &b) {
+          return b.area * 4 < median || b.area > 4 * median;
+        }), blobs.end());
+    }
+    return blobs;
+}
+
+/** Label the blobs with lattice coordinates. Neighboring dots of an
+ * asymmetric grid are diagonal to each other, one row and half a step
+ * apart, so the nearest neighbors span a lattice with two directions. The
+ * dots are walked from the best connected one, classifying each neighbor
+ * step by direction only, which tolerates the perspective of the board. */
+bool OrderGrid(const std::vector<Blob> &blobs, const GridOptions &opts,
+               std::vector<math::Vec2d> *centers, std::vector<math::Vec3d> *board_points) {
+    int const count = opts.points_per_row * opts.rows;
+    int const n = static_cast<int>(blobs.size());
+    if (n < count)
+        return false;
+
+    std::vector<double> nearest(n, std::numeric_limits<double>::max());
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            if (i != j)
+                nearest[i] = std::min(nearest[i], (blobs[j].center - blobs[i].center).norm());
+    double const reach = 1.25;
+    auto is_neighbor = [&](int i, int j) {
+      return i != j && (blobs[j].center - blobs[i].center).norm() < reach * nearest[i];
+    };
+
+    /* Both lattice directions from the neighbor steps. Steps are undirected,
+     * so they are averaged as doubled angles and split at 45 degrees from
+     * the first one. */
+    math::Vec2d ref(0.0, 0.0), sum_a(0.0, 0.0), sum_b(0.0, 0.0);
+    int seed = -1, seed_degree = 0;
+    for (int i = 0; i < n; ++i) {
+        int degree = 0;
+        for (int j = 0; j < n; ++j) {
+            if (!is_neighbor(i, j))
+                continue;
+            degree++;
+            math::Vec2d const e = (blobs[j].center - blobs[i].center).normalized();
+            math::Vec2d const doubled(e[0] * e[0] - e[1] * e[1], 2.0 * e[0] * e[1]);
+            if (ref.square_norm() == 0.0)
+                ref = doubled;
+            (doubled.dot(ref) >= 0.0 ? sum_a : sum_b) += doubled;
+        }
+        if (degree > seed_degree)
+            seed = i, seed_degree = degree;
+    }
+    if (seed < 0 || sum_a.square_norm() == 0.0 || sum_b.square_norm() == 0.0)
+        return false;
+    double const angle_a = 0.5 * std::atan2(sum_a[1], sum_a[0]);
+    double const angle_b = 0.5 * std::atan2(sum_b[1], sum_b[0]);
+    math::Vec2d const dir_a(std::cos(angle_a), std::sin(angle_a));
+    math::Vec2d const dir_b(std::cos(angle_b), std::sin(angle_b));
+
+    double const min_cos = std::cos(MATH_DEG2RAD(30.0));
+    std::vector<int> ci(n, 0), cj(n, 0);
+    std::vector<bool> labeled(n, false);
+    std::deque<int> queue(1, seed);
+    labeled[seed] = true;
+    int num_labeled = 1;
+    while (!queue.empty()) {
+        int const p = queue.front();
+        queue.pop_front();
+        for (int q = 0; q < n; ++q) {
+            if (!is_neighbor(p, q))
+                continue;
+            math::Vec2d const e = (blobs[q].center - blobs[p].center).normalized();
+            double const ca = e.dot(dir_a), cb = e.dot(dir_b);
+            int i = ci[p], j = cj[p];
+            if (std::abs(ca) > min_cos)
+                i += ca > 0 ? 1 : -1;
+            else if (std::abs(cb) > min_cos)
+                j += cb > 0 ? 1 : -1;
+            else
+                continue;
+            if (labeled[q]) {
+                if (ci[q] != i || cj[q] != j)
+                    return false;
+                continue;
+            }
+            ci[q] = i, cj[q] = j;
+            labeled[q] = true;
+            num_labeled++;
+            queue.push_back(q);
+        }
+    }
+    if (num_labeled != count)
+        return false;
+
+    /* One step along a lattice direction changes the row by one and the
+     * position in the row by half a step. Which direction sum is the row
+     * depends on the signs of dir_a and dir_b, the extents tell. */
+    int const row_extent = opts.rows - 1;
+    int const half_step_extent = 2 * opts.points_per_row - 1;
+    std::vector<int> rows(n), halves(n);
+    math::Vec2d row_dir, half_dir;
+    bool found = false;
+    for (int sign : {-1, 1}) {
+        int min_r = INT_MAX, max_r = INT_MIN, min_s = INT_MAX, max_s = INT_MIN;
+        for (int k = 0; k < n; ++k) {
+            if (!labeled[k])
+                continue;
+            rows[k] = ci[k] + sign * cj[k];
+            halves[k] = ci[k] - sign * cj[k];
+            min_r = std::min(min_r, rows[k]), max_r = std::max(max_r, rows[k]);
+            min_s = std::min(min_s, halves[k]), max_s = std::max(max_s, halves[k]);
+        }
+        if (max_r - min_r == row_extent && max_s - min_s == half_step_extent) {
+            for (int k = 0; k < n; ++k)
+                rows[k] -= min_r, halves[k] -= min_s;
+            row_dir = dir_a + dir_b * sign;
+            half_dir = dir_a - dir_b * sign;
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        return false;
+
+    /* Rows run down the image, dots along a row keep the handedness of the
+     * image axes. */
+    bool const flip_rows = std::abs(row_dir[1]) >= std::abs(row_dir[0]) ? row_dir[1] < 0 : row_dir[0] < 0;
+    if (flip_rows)
+        row_dir = row_dir * -1.0;
+    bool const flip_halves = half_dir[0] * row_dir[1] - half_dir[1] * row_dir[0] < 0;
+
+    std::vector<int> grid(static_cast<std::size_t>(opts.rows) * (half_step_extent + 1), -1);
+    for (int k = 0; k < n; ++k) {
+        if (!labeled[k])
+            continue;
+        int const r = flip_rows ? row_extent - rows[k] : rows[k];
+        int const s = flip_halves ? half_step_extent - halves[k] : halves[k];
+        int &cell = grid[r * (half_step_extent + 1) + s];
+        if (cell >= 0)
+            return false;
+        cell = k;
+    }
+
+    centers->clear();
+    board_points->clear();
+    for (int r = 0; r < opts.rows; ++r) {
+        int in_row = 0;
+        for (int s = 0; s <= half_step_extent; ++s) {
+            int const k = grid[r * (half_step_extent + 1) + s];
+            if (k < 0)
+                continue;
+            in_row++;
+            centers->push_back(blobs[k].center);
+            board_points->push_back(math::Vec3d(0.5 * s * opts.h_step, r * opts.v_step, 0.0));
+        }
+        if (in_row != opts.points_per_row)
+            return false;
+    }
+    return true;
+}
+
+template<int N>
+math::Matrix<double, N, N> Identity() {
+    math::Matrix<double, N, N> m(0.0);
+    for (int i = 0; i < N; ++i)
+        m(i, i) = 1.0;
+    return m;
+}
+
+math::Matrix3d Skew(const math::Vec3d &v) {
+    math::Matrix3d m;
+    m(0, 0) = 0.0, m(0, 1) = -v[2], m(0, 2) = v[1];
+    m(1, 0) = v[2], m(1, 1) = 0.0, m(1, 2) = -v[0];
+    m(2, 0) = -v[1], m(2, 1) = v[0], m(2, 2) = 0.0;
+    return m;
+}
+
+/** Rodrigues formula, the rvec of cv2.calibrateCamera to a rotation. */
+math::Matrix3d RotationFromVector(const math::Vec3d &rvec) {
+    double const theta = rvec.norm();
+    math::Matrix3d const R = Identity<3>();
+    if (theta < 1e-12)
+        return R + Skew(rvec);
+    math::Matrix3d const K = Skew(rvec / theta);
+    return R + K * std::sin(theta) + K * K * (1.0 - std::cos(theta));
+}
+
+math::Vec3d VectorFromRotation(const math::Matrix3d &R) {
+    double const c = std::max(-1.0, std::min(1.0, 0.5 * (R(0, 0) + R(1, 1) + R(2, 2) - 1.0)));
+    double const theta = std::acos(c);
+    math::Vec3d const axis(R(2, 1) - R(1, 2), R(0, 2) - R(2, 0), R(1, 0) - R(0, 1));
+    if (theta < 1e-9)
+        return axis * 0.5;
+    if (MATH_PI - theta > 1e-6)
+        return axis * (theta / (2.0 * std::sin(theta)));
+    /* Near 180 degrees the axis is the dominant column of R + I. */
+    int k = 0;
+    for (int i = 1; i < 3; ++i)
+        if (R(i, i) > R(k, k))
+            k = i;
+    math::Vec3d v(R(0, k), R(1, k), R(2, k));
+    v[k] += 1.0;
+    return v.normalized() * theta;
+}
+
+/** Closest rotation in the Frobenius norm. */
+math::Matrix3d Orthonormalize(const math::Matrix3d &M) {
+    double U[9], S[3], V[9];
+    math::matrix_svd<double>(M.begin(), 3, 3, U, S, V);
+    math::Matrix3d R;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            R(i, j) = U[i * 3] * V[j * 3] + U[i * 3 + 1] * V[j * 3 + 1] + U[i * 3 + 2] * V[j * 3 + 2];
+    math::Vec3d const r0(R(0, 0), R(0, 1), R(0, 2));
+    math::Vec3d const r1(R(1, 0), R(1, 1), R(1, 2));
+    math::Vec3d const r2(R(2, 0), R(2, 1), R(2, 2));
+    if (r0.dot(r1.cross(r2)) < 0.0)
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                R(i, j) -= 2.0 * U[i * 3 + 2] * V[j * 3 + 2];
+    return R;
+}
+
+/** Similarity moving 'points' to their centroid and a mean distance of
+ * sqrt(2), as in Hartley's normalized DLT. */
+math::Matrix3d Normalization(const std::vector<math::Vec2d> &points) {
+    math::Vec2d mean(0.0, 0.0);
+    for (auto const &p : points)
+        mean += p;
+    mean /= static_cast<double>(points.size());
+    double dist = 0;
+    for (auto const &p : points)
+        dist += (p - mean).norm();
+    double const s = std::sqrt(2.0) * points.size() / std::max(dist, 1e-12);
+    math::Matrix3d T(0.0);
+    T(0, 0) = s, T(0, 2) = -s * mean[0];
+    T(1, 1) = s, T(1, 2) = -s * mean[1];
+    T(2, 2) = 1.0;
+    return T;
+}
+
+/** Homography from the board plane to the image. */
+math::Matrix3d Homography(const std::vector<math::Vec3d> &board, const std::vector<math::Vec2d> &image) {
+    std::size_t const n = board.size();
+    std::vector<math::Vec2d> plane(n);
+    for (std::size_t i = 0; i < n; ++i)
+        plane[i] = math::Vec2d(board[i][0], board[i][1]);
+    math::Matrix3d const Tp = Normalization(plane);
+    math::Matrix3d const Ti = Normalization(image);
+
+    std::vector<double> A(2 * n * 9, 0.0);
+    for (std::size_t i = 0; i < n; ++i) {
+        math::Vec3d const p = Tp * math::Vec3d(plane[i][0], plane[i][1], 1.0);
+        math::Vec3d const q = Ti * math::Vec3d(image[i][0], image[i][1], 1.0);
+        double *r0 = &A[(2 * i) * 9];
+        double *r1 = &A[(2 * i + 1) * 9];
+        for (int k = 0; k < 3; ++k) {
+            r0[3 + k] = -p[k];
+            r0[6 + k] = q[1] * p[k];
+            r1[k] = p[k];
+            r1[6 + k] = -q[0] * p[k];
+        }
+    }
+    std::vector<double> V(9 * 9);
+    math::matrix_svd<double>(A.data(), static_cast<int>(2 * n), 9, nullptr, nullptr, V.data());
+    math::Matrix3d Hn;
+    for (int k = 0; k < 9; ++k)
+        Hn[k] = V[k * 9 + 8];
+    math::Matrix3d Ti_inv(0.0);
+    Ti_inv(0, 0) = 1.0 / Ti(0, 0), Ti_inv(0, 2) = -Ti(0, 2) / Ti(0, 0);
+    Ti_inv(1, 1) = 1.0 / Ti(1, 1), Ti_inv(1, 2) = -Ti(1, 2) / Ti(1, 1);
+    Ti_inv(2, 2) = 1.0;
+    math::Matrix3d H = Ti_inv * Hn * Tp;
+    return H / H(2, 2);
+}
+
+/** Zhang's closed form intrinsics from the image of the absolute conic,
+ * with zero skew. Returns false if the board poses are degenerate. */
+bool InitIntrinsics(const std::vector<math::Matrix3d> &homographies, double *fx, double *fy,
+                    double *cx, double *cy) {
+    auto v = [](const math::Matrix3d &H, int i, int j) {
+      return std::array<double, 6>{H(0, i) * H(0, j),
+                                   H(0, i) * H(1, j) + H(1, i) * H(0, j),
+                                   H(1, i) * H(1, j),
+                                   H(2, i) * H(0, j) + H(0, i) * H(2, j),
+                                   H(2, i) * H(1, j) + H(1, i) * H(2, j),
+                                   H(2, i) * H(2, j)};
+    };
+    std::vector<double> A;
+    for (auto const &H : homographies) {
+        auto const v12 = v(H, 0, 1), v11 = v(H, 0, 0), v22 = v(H, 1, 1);
+        A.insert(A.end(), v12.begin(), v12.end());
+        for (int k = 0; k < 6; ++k)
+            A.push_back(v11[k] - v22[k]);
+    }
+    // zero skew, so two views suffice
+    double const skew[6] = {0, 1, 0, 0, 0, 0};
+    A.insert(A.end(), skew, skew + 6);
+    int const rows = static_cast<int>(A.size() / 6);
+    if (rows < 6)
+        A.resize(6 * 6, 0.0);
+
+    double V[36];
+    math::matrix_svd<double>(A.data(), std::max(rows, 6), 6, nullptr, nullptr, V);
+    double b[6];
+    for (int k = 0; k < 6; ++k)
+        b[k] = V[k * 6 + 5];
+    if (b[0] < 0)
+        for (double &x : b)
+            x = -x;
+    double const B11 = b[0], B12 = b[1], B22 = b[2], B13 = b[3], B23 = b[4], B33 = b[5];
+    double const d = B11 * B22 - B12 * B12;
+    if (B11 <= 0 || d <= 0)
+        return false;
+    double const v0 = (B12 * B13 - B11 * B23) / d;
+    double const lambda = B33 - (B13 * B13 + v0 * (B12 * B13 - B11 * B23)) / B11;
+    if (lambda <= 0)
+        return false;
+    *fx = std::sqrt(lambda / B11);
+    *fy = std::sqrt(lambda * B11 / d);
+    *cx = -B13 * *fx * *fx / lambda;
+    *cy = v0;
+    return std::isfinite(*fx) && std::isfinite(*fy);
+}
+
+/** Board pose from its homography and the intrinsics. */
+void InitPose(const math::Matrix3d &H, const math::Matrix3d &K_inv, math::Vec3d *rvec, math::Vec3d *t) {
+    math::Vec3d const h1 = K_inv * math::Vec3d(H(0, 0), H(1, 0), H(2, 0));
+    math::Vec3d const h2 = K_inv * math::Vec3d(H(0, 1), H(1, 1), H(2, 1));
+    math::Vec3d const h3 = K_inv * math::Vec3d(H(0, 2), H(1, 2), H(2, 2));
+    double lambda = 1.0 / h1.norm();
+    // the board lies in front of the camera
+    if (h3[2] < 0)
+        lambda = -lambda;
+    math::Vec3d const r1 = h1 * lambda, r2 = h2 * lambda, r3 = r1.cross(r2);
+    math::Matrix3d R;
+    for (int i = 0; i < 3; ++i)
+        R(i, 0) = r1[i], R(i, 1) = r2[i], R(i, 2) = r3[i];
+    *rvec = VectorFromRotation(Orthonormalize(R));
+    *t = h3 * lambda;
+}
+
+/* Parameters of the refinement, fx fy cx cy k1 k2 and rvec t per image. */
+constexpr int NUM_INTRINSICS = 6;
+constexpr int NUM_POSE = 6;
+
+/** Projection residuals of one image into 'res', two per point. */
+void Residuals(const double *intrinsics, const double *pose,
+               const std::vector<math::Vec3d> &board, const std::vector<math::Vec2d> &image,
+               double *res) {
+    math::Matrix3d const R = RotationFromVector(math::Vec3d(pose[0], pose[1], pose[2]));
+    math::Vec3d const t(pose[3], pose[4], pose[5]);
+    for (std::size_t i = 0; i < board.size(); ++i) {
+        math::Vec3d const X = R * board[i] + t;
+        double const x = X[0] / X[2], y = X[1] / X[2];
+        double const r2 = x * x + y * y;
+        double const d = 1.0 + intrinsics[4] * r2 + intrinsics[5] * r2 * r2;
+        res[2 * i] = intrinsics[0] * x * d + intrinsics[2] - image[i][0];
+        res[2 * i + 1] = intrinsics[1] * y * d + intrinsics[3] - image[i][1];
+    }
+}
+
+/** Solve the symmetric positive definite 'A' x = 'b' in place of 'b'. */
+bool CholeskySolve(std::vector<double> A, std::vector<double> *b, int n) {
+    for (int j = 0; j < n; ++j) {
+        double d = A[j * n + j];
+        for (int k = 0; k < j; ++k)
+            d -= A[j * n + k] * A[j * n + k];
+        if (d <= 0.0)
+            return false;
+        d = std::sqrt(d);
+        A[j * n + j] = d;
+        for (int i = j + 1; i < n; ++i) {
+            double s = A[i * n + j];
+            for (int k = 0; k < j; ++k)
+                s -= A[i * n + k] * A[j * n + k];
+            A[i * n + j] = s / d;
+        }
+    }
+    std::vector<double> &x = *b;
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k)
+            x[i] -= A[i * n + k] * x[k];
+        x[i] /= A[i * n + i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k)
+            x[i] -= A[k * n + i] * x[k];
+        x[i] /= A[i * n + i];
+    }
+    return true;
+}
+
+} // namespace
+
+bool DetectCircleGrid(const mve::ByteImage::ConstPtr &image, const GridOptions &opts,
+                      std::vector<math::Vec2d> *centers,
+                      std::vector<math::Vec3d> *board_points) {
+    mve::ByteImage::Ptr gray = image->channels() == 1
+                               ? image->duplicate()
+                               : mve::image::desaturate<uint8_t>(image, mve::image::DESATURATE_LUMINANCE);
+    if (!opts.dark_dots)
+        for (int i = 0; i < gray->get_value_amount(); ++i)
+            gray->at(i) = 255 - gray->at(i);
+    gray = mve::image::blur_gaussian<uint8_t>(gray, 1.f);
+    return OrderGrid(DetectBlobs(gray, opts), opts, centers, board_points);
+}
+
+CameraCalibration CalibrateCamera(const std::vector<std::vector<math::Vec2d>> &image_points,
+                                  const std::vector<std::vector<math::Vec3d>> &board_points,
+                                  int width, int height) {
+    if (image_points.size() != board_points.size())
+        throw std::invalid_argument("Image and board points differ in count");
+    std::vector<int> used;
+    std::vector<math::Matrix3d> homographies;
+    for (std::size_t i = 0; i < image_points.size(); ++i) {
+        if (image_points[i].empty())
+            continue;
+        if (image_points[i].size() != board_points[i].size() || image_points[i].size() < 4)
+            throw std::invalid_argument("Each image needs four or more board points");
+        used.push_back(static_cast<int>(i));
+        homographies.push_back(Homography(board_points[i], image_points[i]));
+    }
+    int const num_images = static_cast<int>(used.size());
+    if (num_images < 2)
+        throw std::runtime_error("Calibration needs a grid in two or more images");
+
+    std::vector<double> params(NUM_INTRINSICS + NUM_POSE * num_images, 0.0);
+    double *intrinsics = params.data();
+    if (!InitIntrinsics(homographies, &intrinsics[0], &intrinsics[1], &intrinsics[2], &intrinsics[3])) {
+        // the default of cv2.initCameraMatrix2D for degenerate poses
+        intrinsics[0] = intrinsics[1] = std::max(width, height);
+        intrinsics[2] = 0.5 * width;
+        intrinsics[3] = 0.5 * height;
+    }
+    math::Matrix3d K_inv(0.0);
+    K_inv(0, 0) = 1.0 / intrinsics[0], K_inv(0, 2) = -intrinsics[2] / intrinsics[0];
+    K_inv(1, 1) = 1.0 / intrinsics[1], K_inv(1, 2) = -intrinsics[3] / intrinsics[1];
+    K_inv(2, 2) = 1.0;
+    for (int k = 0; k < num_images; ++k) {
+        math::Vec3d rvec, t;
+        InitPose(homographies[k], K_inv, &rvec, &t);
+        double *pose = &params[NUM_INTRINSICS + NUM_POSE * k];
+        std::copy(rvec.begin(), rvec.end(), pose);
+        std::copy(t.begin(), t.end(), pose + 3);
+    }
+
+    /* Levenberg-Marquardt over all parameters. A pose only moves the
+     * residuals of its image, so its Jacobian columns are evaluated on
+     * that image alone. */
+    std::vector<int> offsets(num_images + 1, 0);
+    for (int k = 0; k < num_images; ++k)
+        offsets[k + 1] = offsets[k] + 2 * static_cast<int>(image_points[used[k]].size());
+    int const num_res = offsets[num_images];
+    int const num_params = static_cast<int>(params.size());
+    auto evaluate = [&](const std::vector<double> &p, std::vector<double> *res) {
+      res->resize(num_res);
+      double cost = 0;
+      for (int k = 0; k < num_images; ++k) {
+          Residuals(p.data(), &p[NUM_INTRINSICS + NUM_POSE * k], board_points[used[k]],
+                    image_points[used[k]], res->data() + offsets[k]);
+      }
+      for (double r : *res)
+          cost += r * r;
+      return cost;
+    };
+
+    std::vector<double> res, res_step(num_res), jac(static_cast<std::size_t>(num_res) * num_params);
+    double cost = evaluate(params, &res);
+    double lambda = 1e-3;
+    for (int iter = 0; iter < 100; ++iter) {
+        std::fill(jac.begin(), jac.end(), 0.0);
+        for (int c = 0; c < num_params; ++c) {
+            int const k = c < NUM_INTRINSICS ? -1 : (c - NUM_INTRINSICS) / NUM_POSE;
+            std::vector<double> p = params;
+            double const h = 1e-6 * std::max(1.0, std::abs(p[c]));
+            p[c] += h;
+            for (int img = 0; img < num_images; ++img) {
+                if (k >= 0 && img != k)
+                    continue;
+                Residuals(p.data(), &p[NUM_INTRINSICS + NUM_POSE * img], board_points[used[img]],
+                          image_points[used[img]], res_step.data() + offsets[img]);
+                for (int r = offsets[img]; r < offsets[img + 1]; ++r)
+                    jac[static_cast<std::size_t>(r) * num_params + c] = (res_step[r] - res[r]) / h;
+            }
+        }
+
+        std::vector<double> JtJ(static_cast<std::size_t>(num_params) * num_params, 0.0);
+        std::vector<double> Jtr(num_params, 0.0);
+        for (int r = 0; r < num_res; ++r) {
+            const double *row = &jac[static_cast<std::size_t>(r) * num_params];
+            for (int a = 0; a < num_params; ++a) {
+                if (row[a] == 0.0)
+                    continue;
+                Jtr[a] -= row[a] * res[r];
+                for (int b = 0; b <= a; ++b)
+                    JtJ[a * num_params + b] += row[a] * row[b];
+            }
+        }
+        for (int a = 0; a < num_params; ++a)
+            for (int b = 0; b < a; ++b)
+                JtJ[b * num_params + a] = JtJ[a * num_params + b];
+
+        bool improved = false;
+        while (lambda < 1e10) {
+            std::vector<double> A = JtJ, delta = Jtr;
+            for (int a = 0; a < num_params; ++a)
+                A[a * num_params + a] += lambda * std::max(JtJ[a * num_params + a], 1e-12);
+            if (CholeskySolve(A, &delta, num_params)) {
+                std::vector<double> candidate = params;
+                for (int a = 0; a < num_params; ++a)
+                    candidate[a] += delta[a];
+                std::vector<double> candidate_res;
+                double const candidate_cost = evaluate(candidate, &candidate_res);
+                if (candidate_cost < cost) {
+                    bool const converged = cost - candidate_cost < 1e-10 * cost;
+                    params.swap(candidate);
+                    res.swap(candidate_res);
+                    cost = candidate_cost;
+                    lambda = std::max(lambda * 0.1, 1e-12);
+                    improved = !converged;
+                    break;
+                }
+            }
+            lambda *= 10.0;
+        }
+        if (!improved)
+            break;
+    }
+
+    CameraCalibration calib;
+    calib.fx = params[0], calib.fy = params[1];
+    calib.cx = params[2], calib.cy = params[3];
+    calib.k1 = params[4], calib.k2 = params[5];
+    calib.width = width, calib.height = height;
+    calib.rms = std::sqrt(cost / (num_res / 2));
+    calib.poses.assign(image_points.size(), CameraCalibration::Pose{false, math::Matrix3d(0.0), math::Vec3d(0.0)});
+    for (int k = 0; k < num_images; ++k) {
+        const double *pose = &params[NUM_INTRINSICS + NUM_POSE * k];
+        CameraCalibration::Pose &out = calib.poses[used[k]];
+        out.valid = true;
+        out.R = RotationFromVector(math::Vec3d(pose[0], pose[1], pose[2]));
+        out.t = math::Vec3d(pose[3], pose[4], pose[5]);
+    }
+    return calib;
+}
+
+math::Matrix4d ThermalVisualTransform(const CameraCalibration &visual,
+                                      const CameraCalibration &thermal,
+                                      int visual_width, int visual_height) {
+    /* Thermal from visual camera coordinates, Rt_thermal * Rt_visual^-1 of
+     * every image both cameras calibrated on. */
+    math::Matrix3d R_sum(0.0);
+    math::Vec3d t_sum(0.0);
+    int num_pairs = 0;
+    for (std::size_t i = 0; i < std::min(visual.poses.size(), thermal.poses.size()); ++i) {
+        auto const &pv = visual.poses[i];
+        auto const &pt = thermal.poses[i];
+        if (!pv.valid || !pt.valid)
+            continue;
+        math::Matrix3d const R = pt.R * pv.R.transposed();
+        R_sum += R;
+        t_sum += pt.t - R * pv.t;
+        num_pairs++;
+    }
+    if (num_pairs == 0)
+        throw std::runtime_error("No image with a grid in both cameras");
+    math::Matrix3d const R = Orthonormalize(R_sum / num_pairs);
+    math::Vec3d const t = t_sum / num_pairs;
+
+    math::Matrix4d Rt = Identity<4>();
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j)
+            Rt(i, j) = R(i, j);
+        Rt(i, 3) = t[i];
+    }
+
+    math::Matrix4d K_thermal = Identity<4>();
+    K_thermal(0, 0) = thermal.fx, K_thermal(0, 2) = thermal.cx;
+    K_thermal(1, 1) = thermal.fy, K_thermal(1, 2) = thermal.cy;
+
+    double const sx = static_cast<double>(visual_width) / visual.width;
+    double const sy = static_cast<double>(visual_height) / visual.height;
+    double const fx = visual.fx * sx, cx = visual.cx * sx;
+    double const fy = visual.fy * sy, cy = visual.cy * sy;
+    math::Matrix4d K_visual_inv = Identity<4>();
+    K_visual_inv(0, 0) = 1.0 / fx, K_visual_inv(0, 2) = -cx / fx;
+    K_visual_inv(1, 1) = 1.0 / fy, K_visual_inv(1, 2) = -cy / fy;
+    return K_thermal * Rt * K_visual_inv;
+}
+
+void SaveCalibration(const std::string &path, const math::Matrix4d &W) {
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+        throw std::runtime_error("Cannot write calibration file " + path);
+    for (int i = 0; i < 4; ++i)
+        std::fprintf(file, "%.18e %.18e %.18e %.18e\n", W(i, 0), W(i, 1), W(i, 2), W(i, 3));
+    if (std::fclose(file) != 0)
+        throw std::runtime_error("Cannot write calibration file " + path);
+}
+
+} // namespace Thermal
@@ -0,0 +1,272 @@
+#include "thermal/MutualInformation.hpp"
+#include "filter/Convolution.hpp"
+#include "filter/Kernel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Thermal {
+
+namespace {
+
+/* Samples per histogram chunk below which another chunk does not pay off. */
+constexpr std::size_t MIN_CHUNK_SAMPLES = 1 << 16;
+
+/* Merged bins per parallel block. */
+constexpr int MERGE_BLOCK = 4096;
+
+int NumChunks(std::size_t n, const MIOptions &opts) {
+    std::size_t chunks = opts.num_threads > 0
+                         ? static_cast<std::size_t>(opts.num_threads)
+                         : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    chunks = std::min(chunks, std::max<std::size_t>(n / MIN_CHUNK_SAMPLES, 1));
+    return static_cast<int>(chunks);
+}
+
+/** Cubic B-spline weights of the bins floor(t) - 1 ... floor(t) + 2. */
+inline void SplineWeights(float t, int *base, float *w) {
+    float const b = std::floor(t);
+    float const f = t - b;
+    float const f2 = f * f;
+    float const f3 = f2 * f;
+    *base = static_cast<int>(b) - 1;
+    w[0] = (1.f - f) * (1.f - f) * (1.f - f) / 6.f;
+    w[1] = (3.f * f3 - 6.f * f2 + 4.f) / 6.f;
+    w[2] = (-3.f * f3 + 3.f * f2 + 3.f * f + 1.f) / 6.f;
+    w[3] = f3 / 6.f;
+}
+
+/** Joint histogram of the samples for which 'bin_func(i, &a, &b)' returns
+ * true, hard binned into chunk private counters. */
+template<typename BinFunc>
+std::vector<double> CountHistogram(std::size_t n, int bins, int num_chunks, BinFunc bin_func) {
+    std::size_t const size = static_cast<std::size_t>(bins) * bins;
+    std::vector<std::vector<std::uint32_t>> chunks(num_chunks);
+#pragma omp parallel for schedule(static) if(num_chunks > 1)
+    for (int c = 0; c < num_chunks; ++c) {
+        std::vector<std::uint32_t> &counts = chunks[c];
+        counts.assign(size, 0);
+        std::size_t const begin = n * c / num_chunks;
+        std::size_t const end = n * (c + 1) / num_chunks;
+        int a, b;
+        for (std::size_t i = begin; i < end; ++i)
+            if (bin_func(i, &a, &b))
+                counts[a * bins + b]++;
+    }
+
+    std::vector<double> joint(size);
+    int const num_blocks = static_cast<int>((size + MERGE_BLOCK - 1) / MERGE_BLOCK);
+#pragma omp parallel for schedule(static) if(num_chunks > 1)
+    for (int k = 0; k < num_blocks; ++k) {
+        std::size_t const begin = static_cast<std::size_t>(k) * MERGE_BLOCK;
+        std::size_t const end = std::min(begin + MERGE_BLOCK, size);
+        for (std::size_t i = begin; i < end; ++i) {
+            std::uint32_t sum = 0;
+            for (auto const &counts : chunks)
+                sum += counts[i];
+            joint[i] = sum;
+        }
+    }
+    return joint;
+}
+
+/** Joint histogram with every sample spread over 4 x 4 bins, 'coord_func(i,
+ * &ta, &tb)' gives the continuous bin coordinates in [0, bins - 1]. */
+template<typename CoordFunc>
+std::vector<double> ParzenHistogram(std::size_t n, int bins, int num_chunks, CoordFunc coord_func) {
+    std::size_t const size = static_cast<std::size_t>(bins) * bins;
+    std::vector<std::vector<float>> chunks(num_chunks);
+#pragma omp parallel for schedule(static) if(num_chunks > 1)
+    for (int c = 0; c < num_chunks; ++c) {
+        std::vector<float> &hist = chunks[c];
+        hist.assign(size, 0.f);
+        std::size_t const begin = n * c / num_chunks;
+        std::size_t const end = n * (c + 1) / num_chunks;
+        float ta, tb;
+        int base_a, base_b;
+        float wa[4], wb[4];
+        for (std::size_t i = begin; i < end; ++i) {
+            if (!coord_func(i, &ta, &tb))
+                continue;
+            SplineWeights(ta, &base_a, wa);
+            SplineWeights(tb, &base_b, wb);
+            for (int j = 0; j < 4; ++j) {
+                int const a = std::min(std::max(base_a + j, 0), bins - 1);
+                float *row = hist.data() + static_cast<std::size_t>(a) * bins;
+                for (int k = 0; k < 4; ++k)
+                    row[std::min(std::max(base_b + k, 0), bins - 1)] += wa[j] * wb[k];
+            }
+        }
+    }
+
+    std::vector<double> joint(size);
+    int const num_blocks = static_cast<int>((size + MERGE_BLOCK - 1) / MERGE_BLOCK);
+#pragma omp parallel for schedule(static) if(num_chunks > 1)
+    for (int k = 0; k < num_blocks; ++k) {
+        std::size_t const begin = static_cast<std::size_t>(k) * MERGE_BLOCK;
+        std::size_t const end = std::min(begin + MERGE_BLOCK, size);
+        for (std::size_t i = begin; i < end; ++i) {
+            double sum = 0;
+            for (auto const &hist : chunks)
+                sum += hist[i];
+            joint[i] = sum;
+        }
+    }
+    return joint;
+}
+
+/** Smooth the joint histogram with zero padding, like the constant mode of
+ * ndimage.gaussian_filter, and compute MI from it. */
+float HistogramMI(std::vector<double> const &joint, int bins, const MIOptions &opts) {
+    std::vector<float> smoothed(joint.begin(), joint.end());
+    if (opts.sigma > 0.f) {
+        int const radius = std::max(1, static_cast<int>(4.f * opts.sigma + 0.5f));
+        int const padded = bins + 2 * radius;
+        std::vector<float> hist(static_cast<std::size_t>(padded) * padded, 0.f);
+        for (int y = 0; y < bins; ++y)
+            std::copy(joint.begin() + static_cast<std::size_t>(y) * bins,
+                      joint.begin() + static_cast<std::size_t>(y + 1) * bins,
+                      hist.begin() + static_cast<std::size_t>(y + radius) * padded + radius);
+        std::vector<float> const kernel = Filter::GaussKernel(radius, opts.sigma);
+        std::vector<float> column(padded);
+        Filter::DispatchTaps(static_cast<int>(kernel.size()), [&](auto taps) {
+          for (int y = 0; y < bins; ++y) {
+              Filter::Convolve1D(taps, hist.data() + static_cast<std::size_t>(y) * padded, padded, padded,
+                                 kernel.data(), column.data());
+              Filter::Convolve1D(taps, column.data(), 1, bins,
+                                 kernel.data(), smoothed.data() + static_cast<std::size_t>(y) * bins);
+          }
+        });
+    }
+
+    double const eps = std::numeric_limits<double>::epsilon();
+    double total = 0;
+    for (float v : smoothed)
+        total += v + eps;
+    std::vector<double> marginal_a(bins, 0.0);
+    std::vector<double> marginal_b(bins, 0.0);
+    double joint_sum = 0;
+    for (int a = 0; a < bins; ++a)
+        for (int b = 0; b < bins; ++b) {
+            double const p = (smoothed[static_cast<std::size_t>(a) * bins + b] + eps) / total;
+            joint_sum += p * std::log(p);
+            marginal_a[a] += p;
+            marginal_b[b] += p;
+        }
+    double marginal_sum = 0;
+    for (int k = 0; k < bins; ++k)
+        marginal_sum += marginal_a[k] * std::log(marginal_a[k]) + marginal_b[k] * std::log(marginal_b[k]);
+    if (opts.normalized)
+        return static_cast<float>(marginal_sum / joint_sum - 1.0);
+    return static_cast<float>(joint_sum - marginal_sum);
+}
+
+void CheckImages(const mve::ImageBase &a, const mve::ImageBase &b, const mve::ByteImage *mask) {
+    if (a.channels() != 1 || b.channels() != 1)
+        throw std::invalid_argument("Single channel images expected");
+    if (a.width() != b.width() || a.height() != b.height())
+        throw std::invalid_argument("Images differ in size");
+    if (mask != nullptr && (mask->width() != a.width() || mask->height() != a.height()))
+        throw std::invalid_argument("Mask differs in size");
+}
+
+} // namespace
+
+float MutualInformation(const std::uint8_t *a, const std::uint8_t *b, std::size_t n,
+                        const std::uint8_t *mask, const MIOptions &opts) {
+    int const bins = opts.bins;
+    if (bins < 2 || bins > 256)
+        throw std::invalid_argument("Byte samples need 2 to 256 bins");
+    int const num_chunks = NumChunks(n, opts);
+
+    std::vector<double> joint;
+    if (opts.parzen) {
+        float const factor = (bins - 1) / 255.f;
+        joint = ParzenHistogram(n, bins, num_chunks, [&](std::size_t i, float *ta, float *tb) {
+          if (mask != nullptr && mask[i] == 0)
+              return false;
+          *ta = a[i] * factor;
+          *tb = b[i] * factor;
+          return true;
+        });
+    } else {
+        /* Bytes map to bins through a table, the same equal width bins
+         * numpy.histogram2d uses over [0, 255]. */
+        int lut[256];
+        for (int v = 0; v < 256; ++v)
+            lut[v] = std::min(v * bins / 255, bins - 1);
+        joint = CountHistogram(n, bins, num_chunks, [&](std::size_t i, int *ba, int *bb) {
+          if (mask != nullptr && mask[i] == 0)
+              return false;
+          *ba = lut[a[i]];
+          *bb = lut[b[i]];
+          return true;
+        });
+    }
+    return HistogramMI(joint, bins, opts);
+}
+
+float MutualInformation(const mve::ByteImage &a, const mve::ByteImage &b,
+                        const MIOptions &opts, const mve::ByteImage *mask) {
+    CheckImages(a, b, mask);
+    return MutualInformation(a.get_data_pointer(), b.get_data_pointer(), a.get_pixel_amount(),
+                             mask != nullptr ? mask->get_data_pointer() : nullptr, opts);
+}
+
+float MutualInformation(const mve::FloatImage &a, const mve::FloatImage &b,
+                        const MIOptions &opts, const mve::ByteImage *mask) {
+    CheckImages(a, b, mask);
+    if (opts.bins < 2)
+        throw std::invalid_argument("At least 2 bins expected");
+    std::size_t const n = a.get_pixel_amount();
+    const float *pa = a.get_data_pointer();
+    const float *pb = b.get_data_pointer();
+    const std::uint8_t *pm = mask != nullptr ? mask->get_data_pointer() : nullptr;
+    auto valid = [&](std::size_t i) {
+      return (pm == nullptr || pm[i] != 0) && std::isfinite(pa[i]) && std::isfinite(pb[i]);
+    };
+
+    float lo_a = std::numeric_limits<float>::max(), hi_a = -lo_a;
+    float lo_b = lo_a, hi_b = -lo_a;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (!valid(i))
+            continue;
+        lo_a = std::min(lo_a, pa[i]);
+        hi_a = std::max(hi_a, pa[i]);
+        lo_b = std::min(lo_b, pb[i]);
+        hi_b = std::max(hi_b, pb[i]);
+    }
+    if (hi_a < lo_a)
+        return 0.f;
+
+    int const bins = opts.bins;
+    int const num_chunks = NumChunks(n, opts);
+    std::vector<double> joint;
+    if (opts.parzen) {
+        float const fa = hi_a > lo_a ? (bins - 1) / (hi_a - lo_a) : 0.f;
+        float const fb = hi_b > lo_b ? (bins - 1) / (hi_b - lo_b) : 0.f;
+        joint = ParzenHistogram(n, bins, num_chunks, [&](std::size_t i, float *ta, float *tb) {
+          if (!valid(i))
+              return false;
+          *ta = (pa[i] - lo_a) * fa;
+          *tb = (pb[i] - lo_b) * fb;
+          return true;
+        });
+    } else {
+        float const fa = hi_a > lo_a ? bins / (hi_a - lo_a) : 0.f;
+        float const fb = hi_b > lo_b ? bins / (hi_b - lo_b) : 0.f;
+        joint = CountHistogram(n, bins, num_chunks, [&](std::size_t i, int *ba, int *bb) {
+          if (!valid(i))
+              return false;
+          *ba = std::min(static_cast<int>((pa[i] - lo_a) * fa), bins - 1);
+          *bb = std::min(static_cast<int>((pb[i] - lo_b) * fb), bins - 1);
+          return true;
+        });
+    }
+    return HistogramMI(joint, bins, opts);
+}
+
+} // namespace Thermal
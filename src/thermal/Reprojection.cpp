@@ -0,0 +1,148 @@
+#include "thermal/Reprojection.hpp"
+#include "filter/Kernel.hpp"
+#include "mve/image_tools.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace Thermal {
+
+namespace {
+
+/** Bilinear sample of channel 'c' at (u, v), taps outside of 'img' read 0. */
+inline float SampleBilinear(const mve::ByteImage &img, float u, float v, int c) {
+    int const w = img.width();
+    int const h = img.height();
+    // also rejects NaN and coordinates too large for int
+    if (!(u > -1.f && v > -1.f && u < w && v < h))
+        return 0.f;
+    int const x0 = static_cast<int>(std::floor(u));
+    int const y0 = static_cast<int>(std::floor(v));
+    float const fx = u - x0;
+    float const fy = v - y0;
+    auto tap = [&](int x, int y) -> float {
+      if (x < 0 || y < 0 || x >= w || y >= h)
+          return 0.f;
+      return img.at(x, y, c);
+    };
+    float const top = tap(x0, y0) + fx * (tap(x0 + 1, y0) - tap(x0, y0));
+    float const bottom = tap(x0, y0 + 1) + fx * (tap(x0 + 1, y0 + 1) - tap(x0, y0 + 1));
+    return top + fy * (bottom - top);
+}
+
+inline uint8_t SaturateByte(float value) {
+    return static_cast<uint8_t>(std::min(255.f, std::max(0.f, value + 0.5f)));
+}
+
+} // namespace
+
+math::Matrix4f LoadCalibration(const std::string &path) {
+    std::ifstream in(path);
+    if (!in.good())
+        throw std::runtime_error("Cannot open calibration file " + path);
+    math::Matrix4f W;
+    for (int i = 0; i < 16; ++i) {
+        double value;
+        if (!(in >> value))
+            throw std::runtime_error("Expected a 4x4 matrix in " + path);
+        W[i] = static_cast<float>(value);
+    }
+    return W;
+}
+
+void ProjectRow(const math::Matrix4f &W, int y, const float *depth, int width,
+                float depth_scale, float *u, float *v) {
+    /* Only x and 1/z change along a row, the y and constant columns of W
+     * fold into one offset per output coordinate. */
+    float const bx = W(0, 1) * y + W(0, 2);
+    float const by = W(1, 1) * y + W(1, 2);
+    float const bz = W(2, 1) * y + W(2, 2);
+    int x = 0;
+#if defined(__AVX__)
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const one = _mm256_set1_ps(1.f);
+    __m256 const invalid = _mm256_set1_ps(-2.f);
+    __m256 const scale = _mm256_set1_ps(depth_scale);
+    __m256 const lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    for (; x + 8 <= width; x += 8) {
+        __m256 const xs = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+        __m256 const d = _mm256_mul_ps(_mm256_loadu_ps(depth + x), scale);
+        __m256 valid = _mm256_cmp_ps(d, zero, _CMP_GT_OQ);
+        __m256 const inv_d = _mm256_and_ps(valid, _mm256_div_ps(one, d));
+        __m256 const px = Filter::MulAdd(_mm256_set1_ps(W(0, 0)), xs,
+                                         Filter::MulAdd(_mm256_set1_ps(W(0, 3)), inv_d, _mm256_set1_ps(bx)));
+        __m256 const py = Filter::MulAdd(_mm256_set1_ps(W(1, 0)), xs,
+                                         Filter::MulAdd(_mm256_set1_ps(W(1, 3)), inv_d, _mm256_set1_ps(by)));
+        __m256 const pz = Filter::MulAdd(_mm256_set1_ps(W(2, 0)), xs,
+                                         Filter::MulAdd(_mm256_set1_ps(W(2, 3)), inv_d, _mm256_set1_ps(bz)));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(pz, zero, _CMP_GT_OQ));
+        __m256 const inv_z = _mm256_div_ps(one, pz);
+        _mm256_storeu_ps(u + x, _mm256_blendv_ps(invalid, _mm256_mul_ps(px, inv_z), valid));
+        _mm256_storeu_ps(v + x, _mm256_blendv_ps(invalid, _mm256_mul_ps(py, inv_z), valid));
+    }
+#endif
+    for (; x < width; ++x) {
+        float const d = depth[x] * depth_scale;
+        u[x] = v[x] = -2.f;
+        if (!(d > 0.f))
+            continue;
+        float const inv_d = 1.f / d;
+        float const pz = W(2, 0) * x + W(2, 3) * inv_d + bz;
+        if (!(pz > 0.f))
+            continue;
+        u[x] = (W(0, 0) * x + W(0, 3) * inv_d + bx) / pz;
+        v[x] = (W(1, 0) * x + W(1, 3) * inv_d + by) / pz;
+    }
+}
+
+mve::ByteImage::Ptr ReprojectImage(const mve::ByteImage::ConstPtr &src,
+                                   const mve::FloatImage::ConstPtr &depth,
+                                   const math::Matrix4f &W, float depth_scale,
+                                   int width, int height) {
+    if (depth->channels() != 1)
+        throw std::invalid_argument("Single channel depth map expected");
+
+    mve::FloatImage::ConstPtr dm = depth;
+    if (dm->width() != width || dm->height() != height)
+        dm = mve::image::rescale<float>(dm, mve::image::RESCALE_LINEAR, width, height);
+
+    int const channels = src->channels();
+    mve::ByteImage::Ptr out = mve::ByteImage::create(width, height, channels);
+    std::vector<float> u(width);
+    std::vector<float> v(width);
+    for (int y = 0; y < height; ++y) {
+        ProjectRow(W, y, dm->get_data_pointer() + static_cast<std::size_t>(y) * width, width,
+                   depth_scale, u.data(), v.data());
+        uint8_t *row = out->get_data_pointer() + static_cast<std::size_t>(y) * width * channels;
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c)
+                row[x * channels + c] = SaturateByte(SampleBilinear(*src, u[x], v[x], c));
+        }
+    }
+    return out;
+}
+
+mve::ByteImage::Ptr BlendImages(const mve::ByteImage::ConstPtr &visual,
+                                const mve::ByteImage::ConstPtr &thermal,
+                                float thermal_weight) {
+    if (visual->width() != thermal->width() || visual->height() != thermal->height())
+        throw std::invalid_argument("Blended images differ in size");
+
+    int const channels = visual->channels();
+    int const thermal_channels = thermal->channels();
+    mve::ByteImage::Ptr out = mve::ByteImage::create(visual->width(), visual->height(), channels);
+    float const visual_weight = 1.f - thermal_weight;
+    int const num_pixels = visual->get_pixel_amount();
+    for (int p = 0; p < num_pixels; ++p) {
+        for (int c = 0; c < channels; ++c) {
+            float const t = thermal->at(p * thermal_channels + std::min(c, thermal_channels - 1));
+            out->at(p * channels + c) = SaturateByte(visual_weight * visual->at(p * channels + c)
+                                                         + thermal_weight * t);
+        }
+    }
+    return out;
+}
+
+} // namespace Thermal
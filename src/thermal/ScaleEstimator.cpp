@@ -0,0 +1,223 @@
+#include "thermal/ScaleEstimator.hpp"
+#include "thermal/MutualInformation.hpp"
+#include "thermal/Reprojection.hpp"
+#include "mve/image_tools.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+/** W between the grids of a pyramid level, whose pixel x covers the full
+ * size pixels around a * x + b. */
+math::Matrix4f LevelTransform(const math::Matrix4f &W, int level) {
+    float const a = static_cast<float>(1 << level);
+    float const b = (a - 1.f) * 0.5f;
+    math::Matrix4f S;
+    std::fill(S.begin(), S.begin() + 16, 0.f);
+    S(0, 0) = a;
+    S(0, 2) = b;
+    S(1, 1) = a;
+    S(1, 2) = b;
+    S(2, 2) = 1.f;
+    S(3, 3) = 1.f;
+    math::Matrix4f T_inv;
+    std::fill(T_inv.begin(), T_inv.begin() + 16, 0.f);
+    T_inv(0, 0) = 1.f / a;
+    T_inv(0, 2) = -b / a;
+    T_inv(1, 1) = 1.f / a;
+    T_inv(1, 2) = -b / a;
+    T_inv(2, 2) = 1.f;
+    T_inv(3, 3) = 1.f;
+    return T_inv * W * S;
+}
+
+/** Bytes spanning the range of 'values', as cv2.normalize with NORM_MINMAX. */
+void Normalize(std::vector<float> const &values, std::vector<uint8_t> *bytes) {
+    auto range = std::minmax_element(values.begin(), values.end());
+    float const lo = *range.first;
+    float const span = *range.second - lo;
+    float const factor = span > 0.f ? 255.f / span : 0.f;
+    bytes->resize(values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+        (*bytes)[i] = static_cast<uint8_t>((values[i] - lo) * factor + 0.5f);
+}
+
+} // namespace
+
+ScaleEstimator::ScaleEstimator(const Options &opts, const math::Matrix4f &W)
+    : m_opts(opts), m_W(W) {
+    if (m_opts.min_scale <= 0.f || m_opts.max_scale < m_opts.min_scale)
+        throw std::invalid_argument("Invalid scale search range");
+}
+
+ScaleEstimator::ViewScale ScaleEstimator::EstimateView(int view_id,
+                                                       const mve::FloatImage::ConstPtr &visual_depth,
+                                                       int width, int height,
+                                                       const mve::FloatImage::ConstPtr &thermal_depth,
+                                                       int thermal_width, int thermal_height) const {
+    /* The thermal depth is only compared by its ordering, so it is stored as
+     * bytes with 0 left for missing depth. */
+    mve::FloatImage::ConstPtr tdm = thermal_depth;
+    if (tdm->width() != thermal_width || tdm->height() != thermal_height)
+        tdm = mve::image::rescale<float>(tdm, mve::image::RESCALE_LINEAR, thermal_width, thermal_height);
+    float lo = std::numeric_limits<float>::max();
+    float hi = 0.f;
+    for (float d : *tdm)
+        if (d > 0.f) {
+            lo = std::min(lo, d);
+            hi = std::max(hi, d);
+        }
+    mve::ByteImage::Ptr thermal = mve::ByteImage::create(thermal_width, thermal_height, 1);
+    float const factor = hi > lo ? 254.f / (hi - lo) : 0.f;
+    for (int p = 0; p < thermal->get_pixel_amount(); ++p)
+        thermal->at(p) = tdm->at(p) > 0.f ? static_cast<uint8_t>(1.5f + (tdm->at(p) - lo) * factor) : 0;
+
+    std::vector<Level> levels(1);
+    levels[0].depth = visual_depth->duplicate();
+    if (visual_depth->width() != width || visual_depth->height() != height)
+        levels[0].depth = mve::image::rescale<float>(visual_depth, mve::image::RESCALE_LINEAR, width, height);
+    levels[0].thermal = thermal;
+    levels[0].W = m_W;
+    for (int l = 1; l < m_opts.num_levels; ++l) {
+        Level const &prev = levels.back();
+        if (prev.depth->width() < 32 || prev.depth->height() < 32)
+            break;
+        Level level;
+        level.depth = mve::image::rescale_half_size_subsample<float>(prev.depth);
+        level.thermal = mve::image::rescale_half_size_gaussian<uint8_t>(prev.thermal);
+        level.W = LevelTransform(m_W, l);
+        levels.push_back(level);
+    }
+
+    ViewScale result;
+    result.view_id = view_id;
+    result.scale = m_opts.min_scale;
+    result.score = 0.f;
+    double log_lo = std::log(m_opts.min_scale);
+    double log_hi = std::log(m_opts.max_scale);
+    int const num_samples = std::max(m_opts.num_samples, 3);
+    for (int l = static_cast<int>(levels.size()) - 1; l >= 0; --l) {
+        double const step = (log_hi - log_lo) / (num_samples - 1);
+        int best = -1;
+        float best_score = -std::numeric_limits<float>::max();
+        for (int k = 0; k < num_samples; ++k) {
+            float const score = Score(levels[l], static_cast<float>(std::exp(log_lo + k * step)));
+            if (score > best_score) {
+                best_score = score;
+                best = k;
+            }
+        }
+        result.scale = static_cast<float>(std::exp(log_lo + best * step));
+        result.score = best_score;
+        /* The next level searches between the neighbors of the best sample. */
+        double const center = log_lo + best * step;
+        log_lo = std::max(std::log(static_cast<double>(m_opts.min_scale)), center - step);
+        log_hi = std::min(std::log(static_cast<double>(m_opts.max_scale)), center + step);
+    }
+    return result;
+}
+
+float ScaleEstimator::Score(const Level &level, float scale) const {
+    int const width = level.depth->width();
+    int const height = level.depth->height();
+    mve::ByteImage::Ptr mapped = Thermal::ReprojectImage(level.thermal, level.depth, level.W, scale,
+                                                         width, height);
+
+    /* Bounding box of the covered pixels, as cv2.boundingRect. */
+    int x0 = width, y0 = height, x1 = -1, y1 = -1;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            if (mapped->at(x, y, 0) != 0) {
+                x0 = std::min(x0, x);
+                x1 = std::max(x1, x);
+                y0 = std::min(y0, y);
+                y1 = std::max(y1, y);
+            }
+    if (x1 < x0)
+        return 0.f;
+
+    std::size_t const area = static_cast<std::size_t>(x1 - x0 + 1) * (y1 - y0 + 1);
+    std::vector<float> depth_values;
+    std::vector<float> thermal_values;
+    depth_values.reserve(area);
+    thermal_values.reserve(area);
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x) {
+            depth_values.push_back(level.depth->at(x, y, 0));
+            thermal_values.push_back(mapped->at(x, y, 0));
+        }
+    std::vector<uint8_t> depth_bytes;
+    std::vector<uint8_t> thermal_bytes;
+    Normalize(depth_values, &depth_bytes);
+    Normalize(thermal_values, &thermal_bytes);
+
+    /* Views are scored in parallel already, so the histogram is not. */
+    Thermal::MIOptions mi_opts = m_opts.mi_options;
+    mi_opts.num_threads = 1;
+    float const coverage = static_cast<float>(area) / (width * height);
+    return coverage * Thermal::MutualInformation(depth_bytes.data(), thermal_bytes.data(), area,
+                                                 nullptr, mi_opts);
+}
+
+float ScaleEstimator::Consensus(const std::vector<ViewScale> &scales) const {
+    if (scales.empty())
+        throw std::invalid_argument("No view scales to combine");
+
+    auto weighted_mean = [](const std::vector<const ViewScale *> &band) {
+      double sum = 0, weight = 0;
+      for (auto s : band) {
+          sum += s->score * s->scale;
+          weight += s->score;
+      }
+      if (weight <= 0) {
+          sum = 0;
+          for (auto s : band)
+              sum += s->scale;
+          return static_cast<float>(sum / band.size());
+      }
+      return static_cast<float>(sum / weight);
+    };
+
+    std::vector<const ViewScale *> all;
+    for (auto const &s : scales)
+        all.push_back(&s);
+    std::size_t const sample_size = std::max(1, m_opts.ransac_sample_size);
+    if (all.size() <= sample_size)
+        return weighted_mean(all);
+
+    /* Band model: the weighted mean of a random sample, scored by the other
+     * views within the threshold, fewer total distance breaks ties. */
+    std::mt19937 rng(0);
+    std::size_t best_inliers = 0;
+    double best_dist = 0;
+    float best_center = weighted_mean(all);
+    for (int it = 0; it < m_opts.ransac_iterations; ++it) {
+        std::shuffle(all.begin(), all.end(), rng);
+        std::vector<const ViewScale *> sample(all.begin(), all.begin() + sample_size);
+        float const center = weighted_mean(sample);
+        std::size_t inliers = 0;
+        double dist = 0;
+        for (std::size_t i = sample_size; i < all.size(); ++i) {
+            float const d = std::abs(all[i]->scale - center);
+            if (d < m_opts.ransac_threshold) {
+                ++inliers;
+                dist += d;
+            }
+        }
+        if (inliers > best_inliers || (inliers == best_inliers && dist < best_dist)) {
+            best_inliers = inliers;
+            best_dist = dist;
+            best_center = center;
+        }
+    }
+
+    std::vector<const ViewScale *> band;
+    for (auto s : all)
+        if (std::abs(s->scale - best_center) < m_opts.ransac_threshold)
+            band.push_back(s);
+    return band.empty() ? best_center : weighted_mean(band);
+}